@@ -0,0 +1,356 @@
+#!/usr/bin/env python3
+"""
+TCP Fleet Verdict Distribution Daemon
+Dr. Sam Mitchell - Hardware Security Engineer
+
+Spreads validation verdicts and descriptor pack updates across a fleet so
+hosts stop recomputing them independently and start warm after a module
+load.
+
+  serve  origin node: sends each new peer a full cache snapshot, then
+         streams incremental snapshots (verdicts cached since the last
+         push) every --interval seconds, and pushes --pack whenever the
+         file changes
+  join   connects to an upstream node, imports every snapshot into
+         /dev/tcp_security and installs packs through
+         /proc/tcp_kernel_descriptors; with --listen it relays everything
+         to its own peers, so a fleet fans out as a tree instead of every
+         host connecting to the origin
+
+Frames are b'TCPF', a type byte and a u32 length, then the payload.
+Snapshots are signed by the exporting kernel and forwarded unchanged;
+each importing kernel checks them under a key derived from its own
+pqc_key. Packs carry an HMAC-SHA256 over a version and the pack under
+the fleet key, a second key the module derives from pqc_key and hands
+out through TCP_IOC_FLEET_KEY, so the daemon never holds pqc_key itself;
+peers install only versions newer than the last they applied, which is
+kept in --state so a restart cannot roll a host back to an older pack.
+"""
+
+import argparse
+import hashlib
+import hmac
+import os
+import queue
+import socket
+import struct
+import sys
+import threading
+import time
+from pathlib import Path
+from typing import Callable, List, Optional, Tuple
+
+from tcp_hardware_userspace import (export_cache_snapshot, import_cache_snapshot,
+                                    read_fleet_key)
+
+FRAME = struct.Struct('<4sBI')
+FRAME_MAGIC = b'TCPF'
+FRAME_SNAPSHOT = 1
+FRAME_PACK = 2
+FRAME_MAX = 4 << 20
+
+PACK_VERSION = struct.Struct('<Q')
+PACK_MAC_SIZE = 32
+
+DESCRIPTOR_PROC = Path("/proc/tcp_kernel_descriptors")
+DEFAULT_STATE = Path("/var/lib/tcp_security/fleet_pack_version")
+DEFAULT_PORT = 7861
+DEFAULT_INTERVAL = 5.0
+
+# A peer that falls this many frames behind is dropped; it rejoins with a full snapshot
+PEER_QUEUE_FRAMES = 64
+PEER_SEND_TIMEOUT = 30.0
+
+
+def log(msg: str) -> None:
+    print(f"tcp-fleet: {msg}", file=sys.stderr, flush=True)
+
+
+def frame(kind: int, payload: bytes) -> bytes:
+    return FRAME.pack(FRAME_MAGIC, kind, len(payload)) + payload
+
+
+def _recv_exact(sock: socket.socket, n: int) -> bytes:
+    buf = bytearray()
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError("peer closed the connection")
+        buf += chunk
+    return bytes(buf)
+
+
+def read_frame(sock: socket.socket) -> Tuple[int, bytes]:
+    magic, kind, length = FRAME.unpack(_recv_exact(sock, FRAME.size))
+    if magic != FRAME_MAGIC or length > FRAME_MAX:
+        raise ConnectionError("malformed frame")
+    return kind, _recv_exact(sock, length)
+
+
+def snapshot_entries(snapshot: bytes) -> int:
+    """Entry count from a struct tcp_snapshot_header"""
+    return struct.unpack_from('<I', snapshot, 12)[0]
+
+
+def seal_pack(key: bytes, version: int, pack: bytes) -> bytes:
+    body = PACK_VERSION.pack(version) + pack
+    return hmac.new(key, body, hashlib.sha256).digest() + body
+
+
+def open_pack(key: bytes, payload: bytes) -> Tuple[int, bytes]:
+    """Version and pack of a sealed pack; raises ValueError when the MAC is wrong"""
+    mac, body = payload[:PACK_MAC_SIZE], payload[PACK_MAC_SIZE:]
+    if len(body) < PACK_VERSION.size or not hmac.compare_digest(
+            mac, hmac.new(key, body, hashlib.sha256).digest()):
+        raise ValueError("pack signature mismatch")
+    return PACK_VERSION.unpack_from(body)[0], body[PACK_VERSION.size:]
+
+
+def load_applied_version(path: Path) -> int:
+    """Last pack version installed on this host, 0 before the first"""
+    try:
+        return int(path.read_text().strip())
+    except FileNotFoundError:
+        return 0
+
+
+def save_applied_version(path: Path, version: int) -> None:
+    """Record an installed version; replaced atomically so a crash keeps the old one"""
+    path.parent.mkdir(parents=True, exist_ok=True)
+    tmp = path.with_name(path.name + ".tmp")
+    with open(tmp, 'w') as f:
+        f.write(f"{version}\n")
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(tmp, path)
+
+
+def install_pack(pack: bytes) -> None:
+    """Swap in a descriptor pack; the proc file takes it in a single write()"""
+    with open(DESCRIPTOR_PROC, 'wb', buffering=0) as f:
+        f.write(pack)
+
+
+class Peer:
+    """One downstream connection; its own thread writes, so a stalled peer stalls only itself"""
+
+    def __init__(self, sock: socket.socket, addr: str,
+                 greeting: Callable[[], List[bytes]],
+                 on_close: Callable[["Peer"], None]):
+        self.sock = sock
+        self.addr = addr
+        self.frames: "queue.Queue[Optional[bytes]]" = queue.Queue(PEER_QUEUE_FRAMES)
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        sock.settimeout(PEER_SEND_TIMEOUT)
+        self.writer = threading.Thread(target=self._write, args=(greeting, on_close),
+                                       daemon=True)
+
+    def send(self, data: bytes) -> bool:
+        """Queue a frame without blocking; False when the peer is too far behind"""
+        try:
+            self.frames.put_nowait(data)
+            return True
+        except queue.Full:
+            return False
+
+    def close(self) -> None:
+        """Make the writer exit, mid-send or idle"""
+        try:
+            self.sock.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+        try:
+            self.frames.put_nowait(None)
+        except queue.Full:
+            pass
+
+    def _write(self, greeting: Callable[[], List[bytes]],
+               on_close: Callable[["Peer"], None]) -> None:
+        try:
+            # Frames broadcast meanwhile queue up behind the greeting
+            for f in greeting():
+                self.sock.sendall(f)
+            while True:
+                data = self.frames.get()
+                if data is None:
+                    break
+                self.sock.sendall(data)
+        except OSError as e:
+            log(f"peer {self.addr}: {e}")
+        finally:
+            on_close(self)
+            self.sock.close()
+
+
+class PeerHub:
+    """Accepts downstream peers and queues every broadcast frame to each of them"""
+
+    def __init__(self, port: int, greeting: Callable[[], List[bytes]]):
+        self.greeting = greeting
+        self.peers: List[Peer] = []
+        self.lock = threading.Lock()
+        self.server = socket.create_server(("", port), family=socket.AF_INET6,
+                                           dualstack_ipv6=True)
+        threading.Thread(target=self._accept, daemon=True).start()
+
+    def _accept(self) -> None:
+        while True:
+            sock, addr = self.server.accept()
+            peer = Peer(sock, addr[0], self.greeting, self._remove)
+            with self.lock:
+                self.peers.append(peer)
+                count = len(self.peers)
+            peer.writer.start()
+            log(f"peer {addr[0]} joined ({count} peers)")
+
+    def _remove(self, peer: Peer) -> None:
+        with self.lock:
+            if peer in self.peers:
+                self.peers.remove(peer)
+
+    def broadcast(self, data: bytes) -> None:
+        with self.lock:
+            lagging = [peer for peer in self.peers if not peer.send(data)]
+        for peer in lagging:
+            log(f"peer {peer.addr}: {PEER_QUEUE_FRAMES} frames behind, dropping it")
+            self._remove(peer)
+            peer.close()
+
+
+def full_snapshot_frames() -> List[bytes]:
+    try:
+        return [frame(FRAME_SNAPSHOT, export_cache_snapshot())]
+    except OSError as e:
+        log(f"cache export failed: {e}")
+        return []
+
+
+def serve(args: argparse.Namespace, key: bytes) -> int:
+    pack_frame: Optional[bytes] = None
+    pack_digest = None
+
+    hub = PeerHub(args.port, lambda: full_snapshot_frames() +
+                  ([pack_frame] if pack_frame else []))
+    log(f"serving on port {args.port}")
+
+    # Deltas overlap by half an interval so no verdict falls between two exports
+    window_ms = int(args.interval * 1500)
+    while True:
+        if args.pack:
+            try:
+                pack = Path(args.pack).read_bytes()
+                digest = hashlib.sha256(pack).digest()
+                if digest != pack_digest:
+                    pack_digest = digest
+                    pack_frame = frame(FRAME_PACK, seal_pack(key, time.time_ns(), pack))
+                    hub.broadcast(pack_frame)
+                    log(f"pushed {args.pack} ({len(pack)} bytes)")
+            except OSError as e:
+                log(f"cannot read {args.pack}: {e}")
+
+        try:
+            delta = export_cache_snapshot(max_age_ms=window_ms)
+            if snapshot_entries(delta):
+                hub.broadcast(frame(FRAME_SNAPSHOT, delta))
+        except OSError as e:
+            log(f"cache export failed: {e}")
+
+        time.sleep(args.interval)
+
+
+def join(args: argparse.Namespace, key: bytes) -> int:
+    host, _, port = args.upstream.rpartition(':')
+    try:
+        applied_version = load_applied_version(args.state)
+    except (OSError, ValueError) as e:
+        # Starting from 0 would accept any older pack
+        log(f"cannot read {args.state}: {e}")
+        return 1
+    last_pack: Optional[bytes] = None
+    hub = None
+    if args.listen:
+        hub = PeerHub(args.listen, lambda: full_snapshot_frames() +
+                      ([last_pack] if last_pack else []))
+
+    backoff = 1.0
+    while True:
+        try:
+            with socket.create_connection((host, int(port)), timeout=None) as sock:
+                log(f"joined {args.upstream}")
+                backoff = 1.0
+                while True:
+                    kind, payload = read_frame(sock)
+                    data = frame(kind, payload)
+
+                    if kind == FRAME_SNAPSHOT:
+                        try:
+                            stored = import_cache_snapshot(payload)
+                            log(f"imported {stored} verdicts")
+                        except OSError as e:
+                            log(f"snapshot rejected: {os.strerror(e.errno)}")
+                            continue
+                    elif kind == FRAME_PACK:
+                        try:
+                            version, pack = open_pack(key, payload)
+                        except ValueError as e:
+                            log(f"pack rejected: {e}")
+                            continue
+                        if version < applied_version or (
+                                version == applied_version and last_pack):
+                            continue
+                        # Reinstalling the version applied before a restart is
+                        # harmless and covers a module reloaded meanwhile
+                        if DESCRIPTOR_PROC.exists():
+                            install_pack(pack)
+                            log(f"installed descriptor pack ({len(pack)} bytes)")
+                        if version > applied_version:
+                            save_applied_version(args.state, version)
+                            applied_version = version
+                        last_pack = data
+                    else:
+                        continue
+
+                    if hub:
+                        hub.broadcast(data)
+        except (OSError, ConnectionError) as e:
+            log(f"upstream {args.upstream}: {e}, retrying in {backoff:.0f}s")
+            time.sleep(backoff)
+            backoff = min(backoff * 2, 60.0)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Distribute TCP verdicts and descriptor packs")
+    sub = parser.add_subparsers(dest="role", required=True)
+
+    p = sub.add_parser("serve", help="origin node")
+    p.add_argument("--port", type=int, default=DEFAULT_PORT)
+    p.add_argument("--interval", type=float, default=DEFAULT_INTERVAL,
+                   help="seconds between incremental snapshots")
+    p.add_argument("--pack", help="descriptor pack to push when it changes")
+
+    p = sub.add_parser("join", help="import from an upstream node")
+    p.add_argument("upstream", help="host:port of the origin or a relay")
+    p.add_argument("--listen", type=int, metavar="PORT",
+                   help="relay to downstream peers on this port")
+    p.add_argument("--state", type=Path, default=DEFAULT_STATE,
+                   help="file recording the last pack version installed")
+
+    args = parser.parse_args()
+    if os.geteuid() != 0:
+        print("ERROR: Cache import and export require root privileges", file=sys.stderr)
+        return 1
+    try:
+        key = read_fleet_key()
+    except OSError as e:
+        print(f"Error: cannot read the fleet key (module loaded without pqc_key?): {e}",
+              file=sys.stderr)
+        return 1
+
+    try:
+        return serve(args, key) if args.role == "serve" else join(args, key)
+    except KeyboardInterrupt:
+        return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
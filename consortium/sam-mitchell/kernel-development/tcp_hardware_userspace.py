@@ -12,6 +12,7 @@ import sys
 import struct
 import mmap
 import ctypes
+import fcntl
 import threading
 import time
 from pathlib import Path
@@ -22,6 +23,247 @@ import numpy as np
 # Import consortium frameworks
 sys.path.append(str(Path(__file__).parent.parent))
 
+# Batch validation ioctl ABI (tcp_security_ioctl.h)
+TCP_BATCH_MAX = 4096
+_BATCH_STRUCT = struct.Struct('<QQIIII')  # struct tcp_validate_batch
+
+
+def _iowr(magic: str, nr: int, size: int) -> int:
+    """Linux _IOWR() encoding"""
+    return (3 << 30) | (size << 16) | (ord(magic) << 8) | nr
+
+
+TCP_IOC_VALIDATE_BATCH = _iowr('T', 1, _BATCH_STRUCT.size)
+
+# Quantum descriptor signing (security_level 5+): truncated HMAC-SHA256
+# over magic, version, command_hash and security_flags, under the key the
+# module was loaded with (pqc_key=<64 hex digits>)
+PQC_SIGNED_LEN = 13
+PQC_SIGNATURE = slice(19, 30)
+
+
+def sign_quantum_descriptor(descriptor: bytes, key: bytes) -> bytes:
+    """Return the 32-byte quantum descriptor with its pqc_signature filled in"""
+    import hmac
+    import hashlib
+    
+    if len(descriptor) != 32 or descriptor[:4] != b'TCPQ':
+        raise ValueError("Not a 32-byte TCPQ descriptor")
+    tag = hmac.new(key, descriptor[:PQC_SIGNED_LEN], hashlib.sha256).digest()
+    signed = bytearray(descriptor)
+    signed[PQC_SIGNATURE] = tag[:PQC_SIGNATURE.stop - PQC_SIGNATURE.start]
+    return bytes(signed)
+
+
+# Submission/completion rings (tcp_security_ioctl.h)
+_RING_SETUP_STRUCT = struct.Struct('<IiIIII')  # struct tcp_ring_setup
+_SQE_STRUCT = struct.Struct('<QII32s')         # struct tcp_sqe
+_CQE_STRUCT = struct.Struct('<QiI')            # struct tcp_cqe
+TCP_RING_ENTER_ASYNC = 1
+
+
+def _iow(magic: str, nr: int, size: int) -> int:
+    """Linux _IOW() encoding"""
+    return (1 << 30) | (size << 16) | (ord(magic) << 8) | nr
+
+
+TCP_IOC_RING_SETUP = _iowr('T', 2, _RING_SETUP_STRUCT.size)
+TCP_IOC_RING_ENTER = _iow('T', 3, 4)
+
+
+class TCPValidationRing:
+    """
+    Shared submission/completion rings on /dev/tcp_security. submit()
+    queues descriptors with no syscall, enter() has the kernel consume all
+    of them in one ioctl (or from a worker with async_=True), and reap()
+    collects (user_data, result) pairs. With use_eventfd the kernel
+    signals an eventfd whenever completions are posted; wait() blocks on
+    it. Python issues no memory barriers, so the index protocol relies on
+    x86 store ordering.
+    """
+    
+    _SQ_HEAD, _CQ_TAIL, _SQ_TAIL, _CQ_HEAD = 0, 4, 64, 68
+    
+    def __init__(self, entries: int = 256, dev_path: str = "/dev/tcp_security",
+                 use_eventfd: bool = False):
+        self.dev = open(dev_path, 'rb+', buffering=0)
+        self.eventfd = os.eventfd(0, os.EFD_CLOEXEC) if use_eventfd else -1
+        try:
+            setup = bytearray(_RING_SETUP_STRUCT.pack(entries, self.eventfd, 0, 0, 0, 0))
+            fcntl.ioctl(self.dev, TCP_IOC_RING_SETUP, setup)
+            (_, _, self.cq_entries, self.sqes_offset,
+             self.cqes_offset, size) = _RING_SETUP_STRUCT.unpack(setup)
+            self.sq_entries = entries
+            self.ring = mmap.mmap(self.dev.fileno(), size, mmap.MAP_SHARED,
+                                  mmap.PROT_READ | mmap.PROT_WRITE)
+        except OSError:
+            self.close()
+            raise
+        self.sq_tail = 0
+        self.cq_head = 0
+    
+    def _load(self, offset: int) -> int:
+        return struct.unpack_from('<I', self.ring, offset)[0]
+    
+    def _store(self, offset: int, value: int):
+        struct.pack_into('<I', self.ring, offset, value & 0xFFFFFFFF)
+    
+    def submit(self, descriptor: bytes, user_data: int = 0) -> bool:
+        """Queue one descriptor; False when the submission ring is full"""
+        if len(descriptor) not in (24, 32):
+            raise ValueError("Descriptors are 24 or 32 bytes")
+        if (self.sq_tail - self._load(self._SQ_HEAD)) & 0xFFFFFFFF >= self.sq_entries:
+            return False
+        slot = self.sqes_offset + (self.sq_tail % self.sq_entries) * _SQE_STRUCT.size
+        _SQE_STRUCT.pack_into(self.ring, slot, user_data, len(descriptor), 0, descriptor)
+        self.sq_tail = (self.sq_tail + 1) & 0xFFFFFFFF
+        self._store(self._SQ_TAIL, self.sq_tail)
+        return True
+    
+    def enter(self, async_: bool = False) -> int:
+        """Have the kernel consume every submitted descriptor"""
+        flags = bytearray(struct.pack('<I', TCP_RING_ENTER_ASYNC if async_ else 0))
+        return fcntl.ioctl(self.dev, TCP_IOC_RING_ENTER, flags)
+    
+    def reap(self) -> List[Tuple[int, int]]:
+        """Collect all posted completions as (user_data, result)"""
+        completions = []
+        tail = self._load(self._CQ_TAIL)
+        while self.cq_head != tail:
+            slot = self.cqes_offset + (self.cq_head % self.cq_entries) * _CQE_STRUCT.size
+            user_data, result, _ = _CQE_STRUCT.unpack_from(self.ring, slot)
+            completions.append((user_data, result))
+            self.cq_head = (self.cq_head + 1) & 0xFFFFFFFF
+        self._store(self._CQ_HEAD, self.cq_head)
+        return completions
+    
+    def wait(self) -> int:
+        """Block until completions are posted; returns the signal count"""
+        if self.eventfd < 0:
+            raise RuntimeError("Ring was set up without an eventfd")
+        return os.eventfd_read(self.eventfd)
+    
+    def validate_many(self, descriptors: List[bytes]) -> List[int]:
+        """Validate descriptors through the ring, results in input order"""
+        results: List[int] = [0] * len(descriptors)
+        pending = 0
+        for i, descriptor in enumerate(descriptors):
+            while not self.submit(descriptor, i):
+                self.enter()
+                for user_data, result in self.reap():
+                    results[user_data] = result
+                    pending -= 1
+            pending += 1
+        while pending:
+            self.enter()
+            for user_data, result in self.reap():
+                results[user_data] = result
+                pending -= 1
+        return results
+    
+    def close(self):
+        if getattr(self, 'ring', None) is not None:
+            self.ring.close()
+            self.ring = None
+        if self.eventfd >= 0:
+            os.close(self.eventfd)
+            self.eventfd = -1
+        self.dev.close()
+    
+    def __enter__(self):
+        return self
+    
+    def __exit__(self, *exc):
+        self.close()
+
+
+# Validation cache snapshots (tcp_security_ioctl.h)
+_SNAPSHOT_XFER_STRUCT = struct.Struct('<QIIII')    # struct tcp_snapshot_xfer
+SNAPSHOT_HEADER_SIZE = 56                          # struct tcp_snapshot_header
+SNAPSHOT_ENTRY_SIZE = 16                           # struct tcp_snapshot_entry
+TCP_SNAPSHOT_MAX_ENTRIES = 65536
+TCP_IOC_CACHE_EXPORT = _iowr('T', 4, _SNAPSHOT_XFER_STRUCT.size)
+TCP_IOC_CACHE_IMPORT = _iowr('T', 5, _SNAPSHOT_XFER_STRUCT.size)
+
+
+def export_cache_snapshot(max_age_ms: int = 0, max_entries: int = TCP_SNAPSHOT_MAX_ENTRIES,
+                          dev_path: str = "/dev/tcp_security") -> bytes:
+    """Signed snapshot of the validation cache; max_age_ms > 0 exports only recent verdicts"""
+    buf = ctypes.create_string_buffer(SNAPSHOT_HEADER_SIZE + max_entries * SNAPSHOT_ENTRY_SIZE)
+    xfer = bytearray(_SNAPSHOT_XFER_STRUCT.pack(ctypes.addressof(buf), len(buf), 0,
+                                                max_age_ms, 0))
+    with open(dev_path, 'rb', buffering=0) as dev:
+        fcntl.ioctl(dev, TCP_IOC_CACHE_EXPORT, xfer)
+    _, length, _, _, _ = _SNAPSHOT_XFER_STRUCT.unpack(xfer)
+    return buf.raw[:length]
+
+
+def import_cache_snapshot(snapshot: bytes, dev_path: str = "/dev/tcp_security") -> int:
+    """Verify a snapshot from a host with the same pqc_key and warm the cache; returns entries stored"""
+    buf = ctypes.create_string_buffer(snapshot, len(snapshot))
+    xfer = bytearray(_SNAPSHOT_XFER_STRUCT.pack(ctypes.addressof(buf), len(snapshot), 0, 0, 0))
+    with open(dev_path, 'rb', buffering=0) as dev:
+        fcntl.ioctl(dev, TCP_IOC_CACHE_IMPORT, xfer)
+    return _SNAPSHOT_XFER_STRUCT.unpack(xfer)[2]
+
+
+# Fleet pack key (tcp_security_ioctl.h)
+FLEET_KEY_SIZE = 32                                # struct tcp_fleet_key
+
+
+def _ior(magic: str, nr: int, size: int) -> int:
+    """Linux _IOR() encoding"""
+    return (2 << 30) | (size << 16) | (ord(magic) << 8) | nr
+
+
+TCP_IOC_FLEET_KEY = _ior('T', 6, FLEET_KEY_SIZE)
+
+
+def read_fleet_key(dev_path: str = "/dev/tcp_security") -> bytes:
+    """Descriptor pack MAC key the module derives from its pqc_key"""
+    key = bytearray(FLEET_KEY_SIZE)
+    with open(dev_path, 'rb', buffering=0) as dev:
+        fcntl.ioctl(dev, TCP_IOC_FLEET_KEY, key)
+    return bytes(key)
+
+
+# Raw statistics (struct tcp_security_raw in tcp_security_ioctl.h)
+TCP_RAW_STATS_PROC = "/proc/tcp_security_raw"
+TCP_RAW_MAGIC = 0x52504354
+TCP_NR_STAGES = 6
+_RAW_HEADER_STRUCT = struct.Struct('<IHHIBBHQ')
+_RAW_COUNTERS = ('validation_count', 'cache_hits', 'cache_bypasses', 'security_violations',
+                 'total_time_ns', 'attest_queued', 'attest_inline', 'attest_batches',
+                 'attest_completed', 'pqc_verified', 'pqc_cached', 'pqc_rejected')
+_RAW_STRUCT = struct.Struct(_RAW_HEADER_STRUCT.format + 'Q' * len(_RAW_COUNTERS) + 'II' +
+                            'Q' * (2 * TCP_NR_STAGES))
+
+
+def read_raw_statistics(fd: Optional[int] = None) -> Dict[str, Any]:
+    """One counter snapshot; pass an fd held open on TCP_RAW_STATS_PROC to scrape repeatedly"""
+    if fd is None:
+        with open(TCP_RAW_STATS_PROC, 'rb', buffering=0) as f:
+            data = f.read(_RAW_STRUCT.size)
+    else:
+        data = os.pread(fd, _RAW_STRUCT.size, 0)
+    if len(data) < _RAW_STRUCT.size:
+        raise ValueError(f"{TCP_RAW_STATS_PROC}: short read ({len(data)} bytes)")
+    
+    fields = _RAW_STRUCT.unpack(data)
+    magic, _, _, features, level, stages, _, snapshot_ns = fields[:8]
+    if magic != TCP_RAW_MAGIC:
+        raise ValueError(f"{TCP_RAW_STATS_PROC}: bad magic 0x{magic:08x}")
+    
+    counters = fields[8:8 + len(_RAW_COUNTERS)]
+    rest = fields[8 + len(_RAW_COUNTERS):]
+    stats = dict(zip(_RAW_COUNTERS, counters))
+    stats.update(hardware_features=features, security_level=level, stages=stages,
+                 snapshot_ns=snapshot_ns, attest_pending=rest[0],
+                 stage_runs=list(rest[2:2 + TCP_NR_STAGES]),
+                 stage_cycles=list(rest[2 + TCP_NR_STAGES:]))
+    return stats
+
+
 @dataclass
 class KernelStats:
     """Kernel module statistics"""
@@ -119,6 +361,37 @@ class TCPKernelInterface:
             'security_level': 'KERNEL_ENFORCED'
         }
     
+    def validate_descriptors_batch(self, descriptors: List[bytes]) -> List[bool]:
+        """Validate a whole manifest of same-sized descriptors in one ioctl"""
+        
+        if not descriptors:
+            return []
+        
+        if not os.path.exists(self.dev_path):
+            return [self.validate_descriptor_kernel(d).get('valid', False)
+                    for d in descriptors]
+        
+        desc_len = len(descriptors[0])
+        if any(len(d) != desc_len for d in descriptors):
+            raise ValueError("All descriptors in a batch must have the same length")
+        
+        results: List[bool] = []
+        with open(self.dev_path, 'rb', buffering=0) as dev:
+            for start in range(0, len(descriptors), TCP_BATCH_MAX):
+                chunk = descriptors[start:start + TCP_BATCH_MAX]
+                payload = ctypes.create_string_buffer(b''.join(chunk))
+                bitmap = (ctypes.c_uint64 * ((len(chunk) + 63) // 64))()
+                request = bytearray(_BATCH_STRUCT.pack(
+                    ctypes.addressof(payload), ctypes.addressof(bitmap),
+                    len(chunk), desc_len, 0, 0))
+                
+                fcntl.ioctl(dev, TCP_IOC_VALIDATE_BATCH, request)
+                
+                results.extend(bool(bitmap[i // 64] >> (i % 64) & 1)
+                               for i in range(len(chunk)))
+        
+        return results
+    
     def _validate_userspace_fallback(self, descriptor: bytes) -> Dict[str, Any]:
         """Userspace fallback validation"""
         result = self.userspace_validator.validate_descriptor_kernel_space(descriptor)
@@ -136,6 +409,22 @@ class TCPKernelInterface:
         
         if not self.kernel_available:
             return None
+        
+        # Binary counters when the module has them: no text parsing
+        if os.path.exists(TCP_RAW_STATS_PROC):
+            try:
+                raw = read_raw_statistics()
+                validations = raw['validation_count']
+                return KernelStats(
+                    total_validations=validations,
+                    cache_hits=raw['cache_hits'],
+                    cache_hit_rate=100.0 * raw['cache_hits'] / validations if validations else 0.0,
+                    security_violations=raw['security_violations'],
+                    average_time_ns=raw['total_time_ns'] // validations if validations else 0,
+                    hardware_features=raw['hardware_features']
+                )
+            except (OSError, ValueError) as e:
+                print(f"Error reading raw kernel stats: {e}")
             
         try:
             with open(self.proc_path, 'r') as f:
@@ -18,8 +18,43 @@
 #include <linux/seq_file.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/bitmap.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
 #include <linux/crypto.h>
+#include <linux/crc32.h>
+#include <linux/version.h>
+#include <linux/log2.h>
+#include <linux/hash.h>
+#include <linux/atomic.h>
+#include <linux/capability.h>
+#include <linux/llist.h>
+#include <linux/workqueue.h>
+#include <linux/siphash.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/eventfd.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+#include <linux/jump_label.h>
+#include <linux/mutex.h>
+#include <linux/sort.h>
+#include <linux/timex.h>
 #include <crypto/hash.h>
+#include <crypto/algapi.h>
+
+/* SHA256 library helper (no transform or descriptor state needed) */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+#include <crypto/sha2.h>
+#define TCP_HAVE_LIB_SHA256 1
+#else
+#include <crypto/sha.h>
+#endif
+
+#include "tcp_security_ioctl.h"
+#include "tcp_engine.h"
 
 #define TCP_MODULE_NAME "tcp_security"
 #define TCP_MODULE_VERSION "1.0"
@@ -42,8 +77,8 @@ struct tcp_classical_descriptor {
     u32 command_hash;       /* Command identifier */
     u32 security_flags;     /* Security and capability flags */
     u8  performance_data[6]; /* Performance metrics */
-    u16 reserved;           /* Reserved for future use */
-    u16 checksum;           /* CRC16 checksum */
+    u8  reserved[4];        /* Reserved for future use */
+    u16 checksum;           /* CRC16 over bytes 0-21 */
 } __packed;
 
 struct tcp_quantum_descriptor {
@@ -60,26 +95,275 @@ struct tcp_quantum_descriptor {
 struct tcp_validation_context {
     u32 hardware_features;   /* Available hardware features */
     u8  security_level;      /* Current security level */
+};
+
+/* Validation statistics - per-CPU so validators never share a cache line */
+struct tcp_validation_stats {
     u64 validation_count;    /* Total validations performed */
     u64 cache_hits;          /* Cache hit count */
+    u64 cache_bypasses;      /* First sightings kept out of the cache */
     u64 security_violations; /* Security violation count */
     u64 total_time_ns;       /* Total validation time */
-    spinlock_t lock;         /* Protection for statistics */
+    u64 attest_queued;       /* Attestations handed to the worker */
+    u64 attest_inline;       /* Attested inline: policy or full queue */
+    u64 attest_batches;      /* Worker runs (one TPM round trip each) */
+    u64 attest_completed;    /* Queued attestations resolved */
+    u64 pqc_verified;        /* Quantum signatures verified by HMAC */
+    u64 pqc_cached;          /* Quantum signatures found already verified */
+    u64 pqc_rejected;        /* Quantum signatures that failed */
 };
 
 /* Global validation context */
-static struct tcp_validation_context tcp_ctx;
+static struct tcp_validation_context tcp_ctx = {
+    .security_level = 1,     /* Basic security by default */
+};
+static DEFINE_PER_CPU(struct tcp_validation_stats, tcp_cpu_stats);
+
+/* Sum the per-CPU statistics at read time */
+static void tcp_stats_snapshot(struct tcp_validation_stats *sum)
+{
+    tcp_percpu_sum(sum, &tcp_cpu_stats, cpu_possible_mask);
+}
+
+/* Statistics of the CPUs currently on one node */
+static void tcp_stats_snapshot_node(struct tcp_validation_stats *sum, int node)
+{
+    tcp_percpu_sum(sum, &tcp_cpu_stats, cpumask_of_node(node));
+}
+
+/*
+ * Latency histograms
+ *
+ * Per-CPU log2 histograms of tcp_validate_descriptor_kernel() time, kept
+ * separately for cache hits, cache misses that validated and misses that
+ * were rejected. Bucket b counts samples in [2^b, 2^(b+1)) ns (bucket 0
+ * also takes 0 and 1 ns, the last bucket takes everything above). Batch
+ * validation is amortized over many descriptors and is not sampled.
+ * The histogram type and /proc/tcp_security_latency, which reports them
+ * with percentiles and is reset by writing to it, are tcp_kernel's
+ * (tcp_engine.h).
+ */
+static DEFINE_PER_CPU(struct tcp_latency_hist, tcp_cpu_latency);
+
+/*
+ * Validation cache for performance
+ *
+ * Set-associative: the truncated SHA256 selects one set of TCP_CACHE_WAYS
+ * entries, so a lookup touches a single set under that set's own lock
+ * instead of scanning the whole cache. Eviction within a set uses CLOCK
+ * (second chance), and entries older than cache_ttl_ms are treated as
+ * misses.
+ *
+ * Every node with memory has its own shard of TCP_CACHE_SETS sets,
+ * allocated on that node, and each CPU uses the shard of its nearest
+ * node, so sets and their locks stay in local memory and never bounce
+ * between sockets. Shards are independent caches: a descriptor used on
+ * two nodes is validated once per node. Anything that invalidates
+ * cached results flushes every shard.
+ *
+ * A flush also advances tcp_cache_gen. Writers sample the generation
+ * before computing a verdict and store it only if the generation is
+ * unchanged when they hold the set lock, so a verdict computed under
+ * the old level or stages (an attestation still queued, say) cannot
+ * land in the cache after the flush that invalidated it.
+ */
+#define TCP_CACHE_SIZE 16384                       /* Total entries (power of 2) */
+#define TCP_CACHE_WAYS 8                           /* Entries per set */
+#define TCP_CACHE_SETS (TCP_CACHE_SIZE / TCP_CACHE_WAYS)
 
-/* Validation cache for performance */
-#define TCP_CACHE_SIZE 10000
 struct tcp_cache_entry {
-    u8 descriptor_hash[8];   /* SHA256 truncated to 8 bytes */
-    u8 validation_result;    /* Cached validation result */
-    u64 timestamp;           /* Cache timestamp */
+    u64 descriptor_hash;     /* SHA256 truncated to 8 bytes */
+    u64 timestamp;           /* Insertion time, for TTL expiry */
+    s8  validation_result;   /* Cached validation result */
+    u8  referenced;          /* CLOCK reference bit */
+    u8  valid;               /* Entry holds a cached result */
+};
+
+struct tcp_cache_set {
+    spinlock_t lock;         /* Protects this set only */
+    u8 clock_hand;           /* Next eviction candidate */
+    struct tcp_cache_entry ways[TCP_CACHE_WAYS];
+} ____cacheline_aligned_in_smp;
+
+static struct tcp_cache_set *tcp_cache_shard[MAX_NUMNODES];
+static int tcp_cache_home = NUMA_NO_NODE;  /* Shard for nodes onlined later */
+static atomic_t tcp_cache_gen = ATOMIC_INIT(0);  /* Advanced by every flush */
+
+static unsigned int cache_ttl_ms = 60000;
+module_param(cache_ttl_ms, uint, 0644);
+MODULE_PARM_DESC(cache_ttl_ms, "Validation cache entry lifetime in ms (0 = no expiry)");
+
+/*
+ * Attestation policy. Inline runs SGX and TPM checks on the validation
+ * path; the other two queue them for the attestation worker and either
+ * admit the descriptor meanwhile or refuse it with -EAGAIN until its
+ * result lands in the cache. See "Asynchronous hardware attestation".
+ */
+#define TCP_ATTEST_INLINE       0
+#define TCP_ATTEST_OPTIMISTIC   1
+#define TCP_ATTEST_HOLD         2
+
+/* Cached result of a descriptor whose attestation is still queued */
+#define TCP_RESULT_PENDING      2
+
+static unsigned int attest_policy = TCP_ATTEST_OPTIMISTIC;
+module_param(attest_policy, uint, 0644);
+MODULE_PARM_DESC(attest_policy, "Hardware attestation: 0 = inline, 1 = async and admit, 2 = async and hold");
+
+/* What a descriptor with attestation in flight validates as */
+static inline int tcp_attest_provisional(void)
+{
+    return READ_ONCE(attest_policy) == TCP_ATTEST_HOLD ? -EAGAIN : 1;
+}
+
+/*
+ * Cache doorkeeper
+ *
+ * A bloom filter over command_hash values admits a descriptor to the
+ * validation cache only once its command has been seen before. First
+ * sightings skip the SHA256 and the cache entirely and are validated
+ * directly, so one-off descriptors cost no hashing and never evict
+ * useful entries. Reading command_hash is a plain load, the filter is
+ * 8 KiB, and it is cleared after TCP_DOORKEEPER_RESET insertions to
+ * bound the false positive rate. A false positive only sends a first
+ * sighting down the normal cached path.
+ */
+#define TCP_DOORKEEPER_BITS     (1 << 16)
+#define TCP_DOORKEEPER_PROBES   3
+#define TCP_DOORKEEPER_RESET    (TCP_DOORKEEPER_BITS / 8)
+
+static DECLARE_BITMAP(tcp_doorkeeper, TCP_DOORKEEPER_BITS);
+static atomic_t tcp_doorkeeper_inserts = ATOMIC_INIT(0);
+
+/* command_hash of a descriptor; false for a malformed length */
+static inline bool tcp_descriptor_command(const void *descriptor, size_t len,
+                                          u32 *command_hash)
+{
+    size_t offset;
+    
+    if (len == 24) {
+        offset = offsetof(struct tcp_classical_descriptor, command_hash);
+    } else if (len == 32) {
+        offset = offsetof(struct tcp_quantum_descriptor, command_hash);
+    } else {
+        return false;
+    }
+    memcpy(command_hash, (const u8 *)descriptor + offset, sizeof(*command_hash));
+    return true;
+}
+
+/* Double hashing: probe i is h1 + i * h2 */
+static void tcp_doorkeeper_probes(u32 command_hash, unsigned long *bits)
+{
+    u32 h1 = hash_32(command_hash, 32);
+    u32 h2 = hash_32(command_hash ^ 0x9e3779b9, 32) | 1;
+    int i;
+    
+    for (i = 0; i < TCP_DOORKEEPER_PROBES; i++) {
+        bits[i] = (h1 + i * h2) & (TCP_DOORKEEPER_BITS - 1);
+    }
+}
+
+static bool tcp_doorkeeper_seen(u32 command_hash)
+{
+    unsigned long bits[TCP_DOORKEEPER_PROBES];
+    int i;
+    
+    tcp_doorkeeper_probes(command_hash, bits);
+    for (i = 0; i < TCP_DOORKEEPER_PROBES; i++) {
+        if (!test_bit(bits[i], tcp_doorkeeper)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* True when the descriptor should use the cache; records first sightings */
+static bool tcp_doorkeeper_admit(const void *descriptor, size_t len)
+{
+    unsigned long bits[TCP_DOORKEEPER_PROBES];
+    bool seen = true;
+    u32 command_hash;
+    int i;
+    
+    if (!tcp_descriptor_command(descriptor, len, &command_hash)) {
+        return true;  /* Malformed: let validation reject and cache it */
+    }
+    
+    tcp_doorkeeper_probes(command_hash, bits);
+    for (i = 0; i < TCP_DOORKEEPER_PROBES; i++) {
+        if (!test_bit(bits[i], tcp_doorkeeper)) {
+            seen = false;
+        }
+    }
+    
+    if (seen) {
+        return true;
+    }
+    
+    for (i = 0; i < TCP_DOORKEEPER_PROBES; i++) {
+        set_bit(bits[i], tcp_doorkeeper);
+    }
+    if (atomic_inc_return(&tcp_doorkeeper_inserts) >= TCP_DOORKEEPER_RESET) {
+        atomic_set(&tcp_doorkeeper_inserts, 0);
+        bitmap_zero(tcp_doorkeeper, TCP_DOORKEEPER_BITS);
+    }
+    
+    return false;
+}
+
+/*
+ * Command profile
+ *
+ * With profile=1 every validation counts a hit for its command_hash in a
+ * per-CPU table of TCP_PROFILE_SLOTS slots. Each slot keeps the heaviest
+ * command among those hashing to it (Misra-Gries with one counter: a
+ * hit on the tracked command counts up, any other counts down and takes
+ * the slot over at zero), so the table stays 8 KiB per CPU however many
+ * commands arrive, and a command making up most of its slot's traffic is
+ * never lost. Counts are lower bounds, and hits racing on one CPU may be
+ * dropped. /proc/tcp_security_profile merges the CPUs. Off, the hook is a
+ * patched-out branch.
+ */
+#define TCP_PROFILE_SLOTS       1024
+
+struct tcp_profile_slot {
+    u32 command_hash;
+    u32 count;
+};
+
+struct tcp_profile {
+    u64 hits;                /* Every profiled validation */
+    struct tcp_profile_slot slots[TCP_PROFILE_SLOTS];
 };
 
-static struct tcp_cache_entry *tcp_cache;
-static u32 tcp_cache_head = 0;
+static DEFINE_STATIC_KEY_FALSE(tcp_profile_key);
+static struct tcp_profile __percpu *tcp_profile;
+
+static inline void tcp_profile_hit(const void *descriptor, size_t len)
+{
+    struct tcp_profile_slot *slot;
+    struct tcp_profile *p;
+    u32 command_hash;
+    
+    if (!static_branch_unlikely(&tcp_profile_key) ||
+        !tcp_descriptor_command(descriptor, len, &command_hash)) {
+        return;
+    }
+    
+    p = get_cpu_ptr(tcp_profile);
+    p->hits++;
+    slot = &p->slots[hash_32(command_hash, ilog2(TCP_PROFILE_SLOTS))];
+    if (slot->command_hash == command_hash) {
+        slot->count++;
+    } else if (slot->count) {
+        slot->count--;
+    } else {
+        slot->command_hash = command_hash;
+        slot->count = 1;
+    }
+    put_cpu_ptr(tcp_profile);
+}
 
 /* Hardware feature detection */
 static u32 tcp_detect_hardware_features(void)
@@ -120,284 +404,1978 @@ static u32 tcp_detect_hardware_features(void)
     return features;
 }
 
+/* Shard used by CPUs of a node */
+static inline struct tcp_cache_set *tcp_cache_node(int node)
+{
+    return tcp_cache_shard[node] ?: tcp_cache_shard[tcp_cache_home];
+}
+
+static inline struct tcp_cache_set *tcp_cache_set_for(int node, u64 descriptor_hash)
+{
+    return &tcp_cache_node(node)[descriptor_hash & (TCP_CACHE_SETS - 1)];
+}
+
+static inline bool tcp_cache_expired(const struct tcp_cache_entry *entry, u64 now)
+{
+    u64 ttl_ns = (u64)READ_ONCE(cache_ttl_ms) * NSEC_PER_MSEC;
+    
+    return ttl_ns && now - entry->timestamp > ttl_ns;
+}
+
 /* Fast cache lookup */
-static int tcp_cache_lookup(const u8 *descriptor_hash, u8 *result)
+static int tcp_cache_lookup(u64 descriptor_hash, u64 now, int *result)
 {
+    struct tcp_cache_set *set = tcp_cache_set_for(numa_mem_id(), descriptor_hash);
     struct tcp_cache_entry *entry;
+    int hit = 0;
     u32 i;
     
-    for (i = 0; i < TCP_CACHE_SIZE; i++) {
-        entry = &tcp_cache[i];
-        if (memcmp(entry->descriptor_hash, descriptor_hash, 8) == 0) {
-            *result = entry->validation_result;
-            return 1; /* Cache hit */
+    spin_lock(&set->lock);
+    for (i = 0; i < TCP_CACHE_WAYS; i++) {
+        entry = &set->ways[i];
+        if (!entry->valid || entry->descriptor_hash != descriptor_hash) {
+            continue;
+        }
+        
+        if (tcp_cache_expired(entry, now)) {
+            entry->valid = 0;
+            break;
+        }
+        
+        entry->referenced = 1;
+        *result = entry->validation_result;
+        if (*result == TCP_RESULT_PENDING) {
+            *result = tcp_attest_provisional();
         }
+        hit = 1;
+        break;
     }
+    spin_unlock(&set->lock);
     
-    return 0; /* Cache miss */
+    return hit;
 }
 
-/* Cache validation result */
-static void tcp_cache_store(const u8 *descriptor_hash, u8 result)
+/* Pick a slot in a locked set: free or expired first, then CLOCK */
+static struct tcp_cache_entry *tcp_cache_victim(struct tcp_cache_set *set, u64 now)
 {
     struct tcp_cache_entry *entry;
+    u32 i;
     
-    entry = &tcp_cache[tcp_cache_head];
-    memcpy(entry->descriptor_hash, descriptor_hash, 8);
-    entry->validation_result = result;
-    entry->timestamp = ktime_get_ns();
+    for (i = 0; i < TCP_CACHE_WAYS; i++) {
+        entry = &set->ways[i];
+        if (!entry->valid || tcp_cache_expired(entry, now)) {
+            return entry;
+        }
+    }
     
-    tcp_cache_head = (tcp_cache_head + 1) % TCP_CACHE_SIZE;
+    /* Second chance: at most one full sweep clears every reference bit */
+    for (;;) {
+        entry = &set->ways[set->clock_hand];
+        set->clock_hand = (set->clock_hand + 1) % TCP_CACHE_WAYS;
+        if (!entry->referenced) {
+            return entry;
+        }
+        entry->referenced = 0;
+    }
 }
 
-/* Hardware-accelerated CRC16 calculation */
-static u16 tcp_hardware_crc16(const u8 *data, size_t len)
+/* Sample the flush generation before computing a verdict to store */
+static inline unsigned int tcp_cache_gen_read(void)
+{
+    return atomic_read_acquire(&tcp_cache_gen);
+}
+
+/* Cache a validation result in a node's shard, unless flushed since gen */
+static void tcp_cache_store_node(int node, u64 descriptor_hash, u64 now, int result,
+                                 unsigned int gen)
 {
-    /* Use CPU CRC32 instruction if available, fallback to software */
-    struct crypto_shash *tfm;
-    u32 crc = 0;
-    int err;
+    struct tcp_cache_set *set = tcp_cache_set_for(node, descriptor_hash);
+    struct tcp_cache_entry *entry = NULL;
+    u32 i;
     
-    tfm = crypto_alloc_shash("crc32", 0, 0);
-    if (IS_ERR(tfm)) {
-        /* Fallback to simple checksum */
-        size_t i;
-        for (i = 0; i < len; i++) {
-            crc += data[i];
+    spin_lock(&set->lock);
+    if (atomic_read(&tcp_cache_gen) != gen) {
+        spin_unlock(&set->lock);
+        return;
+    }
+    for (i = 0; i < TCP_CACHE_WAYS; i++) {
+        if (set->ways[i].valid &&
+            set->ways[i].descriptor_hash == descriptor_hash) {
+            entry = &set->ways[i];
+            break;
         }
-        return crc & 0xFFFF;
+    }
+    if (!entry) {
+        entry = tcp_cache_victim(set, now);
     }
     
-    /* Use hardware CRC32 */
-    err = crypto_shash_digest(tfm, data, len, (u8 *)&crc);
-    crypto_free_shash(tfm);
-    
-    return err ? 0 : (crc & 0xFFFF);
+    entry->descriptor_hash = descriptor_hash;
+    entry->timestamp = now;
+    entry->validation_result = result;
+    entry->referenced = 0;
+    entry->valid = 1;
+    spin_unlock(&set->lock);
 }
 
-/* eBPF security monitor */
-static int tcp_ebpf_security_check(const void *descriptor, size_t len)
+/* Cache validation result in this CPU's shard */
+static void tcp_cache_store(u64 descriptor_hash, u64 now, int result, unsigned int gen)
 {
-    /* Integration point for eBPF security monitoring
-     * In production, this would load and execute eBPF programs
-     * for real-time behavioral analysis
-     */
+    tcp_cache_store_node(numa_mem_id(), descriptor_hash, now, result, gen);
+}
+
+static void tcp_cache_exit(void)
+{
+    int node;
     
-    /* Simulate eBPF check - 50ns target */
-    return (len == 24 || len == 32) ? 1 : 0;
+    for_each_node(node) {
+        kvfree(tcp_cache_shard[node]);
+        tcp_cache_shard[node] = NULL;
+    }
+    tcp_cache_home = NUMA_NO_NODE;
 }
 
-/* LSM security hook integration */
-static int tcp_lsm_security_check(const void *descriptor, size_t len)
+/* Allocate one shard per node with memory, every set empty */
+static int tcp_cache_init(void)
 {
-    /* LSM security policy check - 10ns target */
-    const struct tcp_classical_descriptor *tcp_desc;
+    struct tcp_cache_set *shard;
+    int node;
+    u32 i;
     
-    if (len == 24) {
-        tcp_desc = (const struct tcp_classical_descriptor *)descriptor;
+    for_each_node_state(node, N_MEMORY) {
+        shard = kvzalloc_node(array_size(TCP_CACHE_SETS, sizeof(*shard)),
+                              GFP_KERNEL, node);
+        if (!shard) {
+            tcp_cache_exit();
+            return -ENOMEM;
+        }
         
-        /* Check for dangerous security flags */
-        if (tcp_desc->security_flags & 0x0001) { /* DESTRUCTIVE */
-            return 0; /* Deny destructive operations by default */
+        for (i = 0; i < TCP_CACHE_SETS; i++) {
+            spin_lock_init(&shard[i].lock);
         }
+        tcp_cache_shard[node] = shard;
     }
+    tcp_cache_home = numa_mem_id();
     
-    return 1; /* Allow by default */
+    return 0;
 }
 
-/* SGX enclave validation */
-static int tcp_sgx_validation(const void *descriptor, size_t len)
+/* Drop every cached result on every node, e.g. when the security level changes */
+static void tcp_cache_flush(void)
 {
-    /* SGX secure enclave validation - 100ns target
-     * In production, would execute validation inside SGX enclave
-     */
+    struct tcp_cache_set *shard;
+    int node;
+    u32 i;
     
-    if (!(tcp_ctx.hardware_features & TCP_HW_SGX)) {
-        return 1; /* Skip if SGX not available */
-    }
+    /* Order the caller's level or stage update before the new generation */
+    smp_mb__before_atomic();
+    atomic_inc(&tcp_cache_gen);
     
-    /* Simulate SGX enclave validation */
-    return 1; /* Success */
+    for_each_node(node) {
+        shard = tcp_cache_shard[node];
+        if (!shard) {
+            continue;
+        }
+        
+        for (i = 0; i < TCP_CACHE_SETS; i++) {
+            spin_lock(&shard[i].lock);
+            memset(shard[i].ways, 0, sizeof(shard[i].ways));
+            shard[i].clock_hand = 0;
+            spin_unlock(&shard[i].lock);
+        }
+    }
 }
 
-/* TPM hardware attestation */
-static int tcp_tpm_attestation(const void *descriptor, size_t len)
+/*
+ * Descriptor hashing and checksums
+ *
+ * Nothing on the validation path allocates. The CRC uses the crc32_le()
+ * library routine, which picks the arch-accelerated implementation
+ * itself and matches the "crc32" shash with its default zero seed. The
+ * SHA256 cache key uses the sha256() library helper where available;
+ * older kernels use one transform allocated at init with a per-CPU
+ * shash_desc.
+ */
+#ifndef TCP_HAVE_LIB_SHA256
+static struct crypto_shash *tcp_sha256_tfm;
+static struct shash_desc __percpu *tcp_sha256_desc;
+#endif
+
+static int tcp_crypto_init(void)
 {
-    /* TPM 2.0 hardware attestation - 1μs target */
+#ifndef TCP_HAVE_LIB_SHA256
+    size_t desc_size;
+    int ret;
     
-    if (!(tcp_ctx.hardware_features & TCP_HW_TPM)) {
-        return 1; /* Skip if TPM not available */
+    tcp_sha256_tfm = crypto_alloc_shash("sha256", 0, 0);
+    if (IS_ERR(tcp_sha256_tfm)) {
+        ret = PTR_ERR(tcp_sha256_tfm);
+        tcp_sha256_tfm = NULL;
+        return ret;
     }
     
-    /* Simulate TPM attestation */
-    return 1; /* Success */
+    desc_size = sizeof(struct shash_desc) + crypto_shash_descsize(tcp_sha256_tfm);
+    tcp_sha256_desc = __alloc_percpu(desc_size, __alignof__(struct shash_desc));
+    if (!tcp_sha256_desc) {
+        crypto_free_shash(tcp_sha256_tfm);
+        tcp_sha256_tfm = NULL;
+        return -ENOMEM;
+    }
+#endif
+    return 0;
 }
 
-/* Core TCP descriptor validation */
-static int tcp_validate_descriptor_kernel(const void *descriptor, size_t len)
+static void tcp_crypto_exit(void)
 {
-    const struct tcp_classical_descriptor *classical;
-    const struct tcp_quantum_descriptor *quantum;
-    u8 descriptor_hash[8];
-    u8 cached_result;
-    u64 start_time, end_time;
-    u16 calculated_crc;
-    int result = 0;
+#ifndef TCP_HAVE_LIB_SHA256
+    free_percpu(tcp_sha256_desc);
+    crypto_free_shash(tcp_sha256_tfm);
+#endif
+}
+
+/* SHA256 of the descriptor, truncated to 8 bytes for the cache key */
+static u64 tcp_descriptor_hash(const void *descriptor, size_t len)
+{
+    u8 full_hash[32];
+    u64 hash;
+#ifdef TCP_HAVE_LIB_SHA256
+    sha256(descriptor, len, full_hash);
+#else
+    struct shash_desc *desc;
     
-    start_time = ktime_get_ns();
+    desc = get_cpu_ptr(tcp_sha256_desc);
+    desc->tfm = tcp_sha256_tfm;
+    crypto_shash_digest(desc, descriptor, len, full_hash);
+    put_cpu_ptr(tcp_sha256_desc);
+#endif
     
-    /* Calculate descriptor hash for cache lookup */
-    {
-        struct crypto_shash *tfm;
-        u8 full_hash[32];
-        
-        tfm = crypto_alloc_shash("sha256", 0, 0);
-        if (!IS_ERR(tfm)) {
-            crypto_shash_digest(tfm, descriptor, len, full_hash);
-            memcpy(descriptor_hash, full_hash, 8);
-            crypto_free_shash(tfm);
-        } else {
-            /* Fallback hash */
-            memset(descriptor_hash, 0, 8);
-            memcpy(descriptor_hash, descriptor, min(len, 8UL));
-        }
+    memcpy(&hash, full_hash, sizeof(hash));
+    return hash;
+}
+
+/*
+ * Quantum descriptor signatures
+ *
+ * From security_level TCP_LEVEL_QUANTUM_SAFE up, a 32-byte descriptor is
+ * accepted only if its pqc_signature verifies under the pqc_key given at
+ * load. Eleven bytes cannot hold a lattice signature, so the field
+ * carries a truncated HMAC-SHA256 tag. A symmetric tag loses only half
+ * its strength to Grover. It covers the descriptor's identity: magic,
+ * version, command_hash and security_flags. Performance data is
+ * telemetry and is not signed, so a command's descriptors keep
+ * verifying as its measurements change.
+ *
+ * The key is set on the HMAC transform once at load, and the transform
+ * precomputes its padded key state then. Each verify after that costs
+ * two SHA256 compressions. Verified (identity, tag) pairs are kept as
+ * keyed SipHash fingerprints in a direct-mapped table that is read and
+ * written without locks. A signature verified once therefore costs one
+ * SipHash afterwards. Batch validation checks signatures only for the
+ * descriptors its cache lookups miss, TCP_PQC_BATCH_CHUNK at a time
+ * under one per-CPU descriptor, and hands each verdict to the software
+ * checks so no signature is checked twice.
+ *
+ * pqc_key itself only signs descriptors. Cache snapshots and fleet
+ * descriptor packs are MACed under subkeys derived from it as
+ * HMAC-SHA256(pqc_key, label), one label per use, so userspace that
+ * handles snapshots or packs never holds the descriptor signing key
+ * and a MAC made for one use is never accepted for another.
+ */
+#define TCP_LEVEL_QUANTUM_SAFE  5
+#define TCP_PQC_KEY_SIZE        32
+#define TCP_PQC_SIGNED_LEN      offsetof(struct tcp_quantum_descriptor, performance_data)
+#define TCP_PQC_VERIFIED_SLOTS  4096    /* Fingerprint table size (power of 2) */
+#define TCP_PQC_BATCH_CHUNK     16      /* Cache misses verified per pass */
+#define TCP_KEY_LABEL_SNAPSHOT  "tcp_security cache snapshot v1"
+#define TCP_KEY_LABEL_FLEET     "tcp_security fleet pack v1"
+
+static char *pqc_key;
+module_param(pqc_key, charp, 0400);
+MODULE_PARM_DESC(pqc_key, "Quantum descriptor signing key, 64 hex digits");
+
+static struct crypto_shash *tcp_pqc_tfm;
+static struct shash_desc __percpu *tcp_pqc_desc;
+static struct crypto_shash *tcp_snapshot_tfm;      /* Keyed with the snapshot subkey */
+static u8 tcp_fleet_key[TCP_PQC_KEY_SIZE];         /* Handed to fleet daemons */
+static siphash_key_t tcp_pqc_fp_key;
+static u64 *tcp_pqc_verified;
+
+static inline bool tcp_pqc_active(void)
+{
+    return READ_ONCE(tcp_ctx.security_level) >= TCP_LEVEL_QUANTUM_SAFE;
+}
+
+/* What the caller of the software checks knows about the signature */
+enum tcp_pqc_state {
+    TCP_PQC_UNCHECKED,       /* Verify it in the software checks */
+    TCP_PQC_GOOD,            /* Already verified by the batch pass */
+    TCP_PQC_BAD,             /* Already rejected by the batch pass */
+};
+
+/* A batch descriptor the cache could not answer, awaiting validation */
+struct tcp_batch_miss {
+    u64 descriptor_hash;     /* Cache key, when keyed */
+    u32 index;               /* Position in the batch */
+    u8 keyed;
+    u8 pqc;                  /* enum tcp_pqc_state */
+};
+
+/* Derive the subkey for one use of pqc_key from its label */
+static int tcp_pqc_derive(const char *label, u8 *subkey)
+{
+    SHASH_DESC_ON_STACK(desc, tcp_pqc_tfm);
+    int ret;
+    
+    desc->tfm = tcp_pqc_tfm;
+    ret = crypto_shash_digest(desc, (const u8 *)label, strlen(label), subkey);
+    shash_desc_zero(desc);
+    return ret;
+}
+
+static int tcp_pqc_init(void)
+{
+    u8 key[TCP_PQC_KEY_SIZE];
+    size_t desc_size;
+    int ret;
+    
+    if (!pqc_key || !*pqc_key) {
+        return 0;  /* No key: nothing verifies in quantum-safe mode */
     }
     
-    /* Check cache first */
-    if (tcp_cache_lookup(descriptor_hash, &cached_result)) {
-        spin_lock(&tcp_ctx.lock);
-        tcp_ctx.cache_hits++;
-        spin_unlock(&tcp_ctx.lock);
-        return cached_result;
+    if (strlen(pqc_key) != 2 * TCP_PQC_KEY_SIZE ||
+        hex2bin(key, pqc_key, TCP_PQC_KEY_SIZE)) {
+        return -EINVAL;
     }
     
-    /* Validate descriptor format */
-    if (len == 24) {
-        /* Classical 24-byte descriptor */
-        classical = (const struct tcp_classical_descriptor *)descriptor;
-        
-        if (classical->magic != TCP_MAGIC_CLASSICAL) {
-            result = -EINVAL;
-            goto out;
-        }
-        
-        /* Verify checksum */
-        calculated_crc = tcp_hardware_crc16((const u8 *)descriptor, 22);
-        if (calculated_crc != classical->checksum) {
-            result = -EINVAL;
-            goto out;
-        }
-        
-    } else if (len == 32) {
-        /* Quantum-safe 32-byte descriptor */
-        quantum = (const struct tcp_quantum_descriptor *)descriptor;
-        
-        if (quantum->magic != TCP_MAGIC_QUANTUM) {
-            result = -EINVAL;
-            goto out;
-        }
-        
-        if (quantum->version < 3) {
-            result = -EINVAL; /* Not quantum-safe */
-            goto out;
-        }
-        
-        /* TODO: Verify post-quantum signature */
-        
-    } else {
-        result = -EINVAL;
-        goto out;
+    tcp_pqc_verified = kvcalloc(TCP_PQC_VERIFIED_SLOTS, sizeof(*tcp_pqc_verified),
+                                GFP_KERNEL);
+    if (!tcp_pqc_verified) {
+        ret = -ENOMEM;
+        goto err_key;
     }
+    get_random_bytes(&tcp_pqc_fp_key, sizeof(tcp_pqc_fp_key));
     
-    /* Hardware security checks */
-    if (!tcp_lsm_security_check(descriptor, len)) {
-        result = -EACCES;
-        goto out;
+    tcp_pqc_tfm = crypto_alloc_shash("hmac(sha256)", 0, 0);
+    if (IS_ERR(tcp_pqc_tfm)) {
+        ret = PTR_ERR(tcp_pqc_tfm);
+        goto err_table;
     }
     
-    if (!tcp_ebpf_security_check(descriptor, len)) {
-        result = -EACCES;
-        goto out;
+    ret = crypto_shash_setkey(tcp_pqc_tfm, key, sizeof(key));
+    if (!ret) {
+        ret = tcp_pqc_derive(TCP_KEY_LABEL_FLEET, tcp_fleet_key);
+    }
+    if (!ret) {
+        ret = tcp_pqc_derive(TCP_KEY_LABEL_SNAPSHOT, key);
+    }
+    if (ret) {
+        goto err_tfm;
     }
     
-    if (!tcp_sgx_validation(descriptor, len)) {
-        result = -EACCES;
-        goto out;
+    tcp_snapshot_tfm = crypto_alloc_shash("hmac(sha256)", 0, 0);
+    if (IS_ERR(tcp_snapshot_tfm)) {
+        ret = PTR_ERR(tcp_snapshot_tfm);
+        goto err_tfm;
     }
     
-    if (!tcp_tpm_attestation(descriptor, len)) {
-        result = -EACCES;
-        goto out;
+    ret = crypto_shash_setkey(tcp_snapshot_tfm, key, sizeof(key));
+    if (ret) {
+        goto err_snapshot;
     }
     
-    result = 1; /* Success */
+    desc_size = sizeof(struct shash_desc) + crypto_shash_descsize(tcp_pqc_tfm);
+    tcp_pqc_desc = __alloc_percpu(desc_size, __alignof__(struct shash_desc));
+    if (!tcp_pqc_desc) {
+        ret = -ENOMEM;
+        goto err_snapshot;
+    }
     
-out:
-    /* Cache result */
-    tcp_cache_store(descriptor_hash, result > 0 ? 1 : 0);
+    memzero_explicit(key, sizeof(key));
+    return 0;
     
-    /* Update statistics */
-    end_time = ktime_get_ns();
-    spin_lock(&tcp_ctx.lock);
-    tcp_ctx.validation_count++;
-    tcp_ctx.total_time_ns += (end_time - start_time);
-    if (result <= 0) {
-        tcp_ctx.security_violations++;
+err_snapshot:
+    crypto_free_shash(tcp_snapshot_tfm);
+err_tfm:
+    crypto_free_shash(tcp_pqc_tfm);
+err_table:
+    kvfree(tcp_pqc_verified);
+    tcp_pqc_verified = NULL;
+err_key:
+    tcp_pqc_tfm = NULL;
+    tcp_snapshot_tfm = NULL;
+    memzero_explicit(tcp_fleet_key, sizeof(tcp_fleet_key));
+    memzero_explicit(key, sizeof(key));
+    return ret;
+}
+
+static void tcp_pqc_exit(void)
+{
+    free_percpu(tcp_pqc_desc);
+    if (tcp_pqc_tfm) {
+        crypto_free_shash(tcp_snapshot_tfm);
+        crypto_free_shash(tcp_pqc_tfm);
     }
-    spin_unlock(&tcp_ctx.lock);
+    memzero_explicit(tcp_fleet_key, sizeof(tcp_fleet_key));
+    kvfree(tcp_pqc_verified);
+}
+
+/* Keyed fingerprint of the signed identity and its tag; never zero */
+static u64 tcp_pqc_fingerprint(const struct tcp_quantum_descriptor *quantum)
+{
+    u8 buf[TCP_PQC_SIGNED_LEN + sizeof(quantum->pqc_signature)];
     
-    return result;
+    memcpy(buf, quantum, TCP_PQC_SIGNED_LEN);
+    memcpy(buf + TCP_PQC_SIGNED_LEN, quantum->pqc_signature,
+           sizeof(quantum->pqc_signature));
+    return siphash(buf, sizeof(buf), &tcp_pqc_fp_key) | 1;
 }
 
-/* Proc filesystem interface for statistics */
-static int tcp_proc_show(struct seq_file *m, void *v)
+/* HMAC over the signed identity, compared in constant time */
+static bool tcp_pqc_hmac_ok(struct shash_desc *desc,
+                            const struct tcp_quantum_descriptor *quantum)
 {
-    u64 avg_time_ns = 0;
-    u64 cache_hit_rate = 0;
+    u8 mac[SHA256_DIGEST_SIZE];
+    bool ok;
     
-    spin_lock(&tcp_ctx.lock);
+    ok = !crypto_shash_digest(desc, (const u8 *)quantum, TCP_PQC_SIGNED_LEN, mac) &&
+         !crypto_memneq(mac, quantum->pqc_signature, sizeof(quantum->pqc_signature));
+    memzero_explicit(mac, sizeof(mac));
+    return ok;
+}
+
+/*
+ * Check one signature against the fingerprint table, then by HMAC with
+ * the caller's per-CPU descriptor. Counts into the caller's tallies.
+ */
+static bool tcp_pqc_check(struct shash_desc *desc,
+                          const struct tcp_quantum_descriptor *quantum,
+                          unsigned int *verified, unsigned int *cached)
+{
+    u64 fp = tcp_pqc_fingerprint(quantum);
+    u64 *slot = &tcp_pqc_verified[fp & (TCP_PQC_VERIFIED_SLOTS - 1)];
     
-    if (tcp_ctx.validation_count > 0) {
-        avg_time_ns = tcp_ctx.total_time_ns / tcp_ctx.validation_count;
+    if (READ_ONCE(*slot) == fp) {
+        (*cached)++;
+        return true;
     }
     
-    if (tcp_ctx.validation_count > 0) {
-        cache_hit_rate = (tcp_ctx.cache_hits * 100) / tcp_ctx.validation_count;
+    if (!tcp_pqc_hmac_ok(desc, quantum)) {
+        return false;
     }
     
-    seq_printf(m, "TCP Kernel Security Module Statistics\n");
-    seq_printf(m, "=====================================\n");
-    seq_printf(m, "Hardware Features: 0x%08x\n", tcp_ctx.hardware_features);
-    seq_printf(m, "Security Level: %u\n", tcp_ctx.security_level);
-    seq_printf(m, "Total Validations: %llu\n", tcp_ctx.validation_count);
-    seq_printf(m, "Cache Hits: %llu\n", tcp_ctx.cache_hits);
-    seq_printf(m, "Cache Hit Rate: %llu%%\n", cache_hit_rate);
-    seq_printf(m, "Security Violations: %llu\n", tcp_ctx.security_violations);
-    seq_printf(m, "Average Time (ns): %llu\n", avg_time_ns);
+    WRITE_ONCE(*slot, fp);
+    (*verified)++;
+    return true;
+}
+
+/* Signature check for a single quantum descriptor */
+static bool tcp_pqc_verify(const struct tcp_quantum_descriptor *quantum)
+{
+    unsigned int verified = 0, cached = 0;
+    struct shash_desc *desc;
+    bool ok;
     
-    /* Hardware feature breakdown */
-    seq_printf(m, "\nHardware Features:\n");
-    if (tcp_ctx.hardware_features & TCP_HW_LSM)
-        seq_printf(m, "  LSM Security Hooks: Enabled\n");
-    if (tcp_ctx.hardware_features & TCP_HW_EBPF)
-        seq_printf(m, "  eBPF Monitoring: Enabled\n");
-    if (tcp_ctx.hardware_features & TCP_HW_SGX)
-        seq_printf(m, "  Intel SGX: Enabled\n");
-    if (tcp_ctx.hardware_features & TCP_HW_CET)
-        seq_printf(m, "  Intel CET: Enabled\n");
-    if (tcp_ctx.hardware_features & TCP_HW_TPM)
-        seq_printf(m, "  TPM 2.0: Enabled\n");
+    if (!tcp_pqc_tfm) {
+        this_cpu_inc(tcp_cpu_stats.pqc_rejected);
+        return false;
+    }
     
-    spin_unlock(&tcp_ctx.lock);
+    desc = get_cpu_ptr(tcp_pqc_desc);
+    desc->tfm = tcp_pqc_tfm;
+    ok = tcp_pqc_check(desc, quantum, &verified, &cached);
+    put_cpu_ptr(tcp_pqc_desc);
     
-    return 0;
+    this_cpu_add(tcp_cpu_stats.pqc_verified, verified);
+    this_cpu_add(tcp_cpu_stats.pqc_cached, cached);
+    if (!ok) {
+        this_cpu_inc(tcp_cpu_stats.pqc_rejected);
+    }
+    return ok;
 }
 
-static int tcp_proc_open(struct inode *inode, struct file *file)
+/*
+ * Signature check for up to TCP_PQC_BATCH_CHUNK batch cache misses under
+ * one per-CPU descriptor. Records each verdict in the miss for the
+ * software checks, which count nothing further.
+ */
+static void tcp_pqc_verify_batch(const u8 *base, struct tcp_batch_miss *miss,
+                                 unsigned int n)
 {
-    return single_open(file, tcp_proc_show, NULL);
-}
-
+    unsigned int i, verified = 0, cached = 0, rejected = 0;
+    struct shash_desc *desc;
+    
+    if (!tcp_pqc_tfm) {
+        for (i = 0; i < n; i++) {
+            miss[i].pqc = TCP_PQC_BAD;
+        }
+        rejected = n;
+        goto out;
+    }
+    
+    desc = get_cpu_ptr(tcp_pqc_desc);
+    desc->tfm = tcp_pqc_tfm;
+    for (i = 0; i < n; i++) {
+        const struct tcp_quantum_descriptor *quantum =
+            (const void *)(base + (size_t)miss[i].index * sizeof(*quantum));
+        
+        if (tcp_pqc_check(desc, quantum, &verified, &cached)) {
+            miss[i].pqc = TCP_PQC_GOOD;
+        } else {
+            miss[i].pqc = TCP_PQC_BAD;
+            rejected++;
+        }
+    }
+    put_cpu_ptr(tcp_pqc_desc);
+    
+out:
+    this_cpu_add(tcp_cpu_stats.pqc_verified, verified);
+    this_cpu_add(tcp_cpu_stats.pqc_cached, cached);
+    this_cpu_add(tcp_cpu_stats.pqc_rejected, rejected);
+}
+
+/*
+ * Validation stages
+ *
+ * Validation runs as a pipeline: prefilter, cache, format, attestation,
+ * then the LSM and eBPF policy stages, which also run on cache hits
+ * (TCP_STAGE_* in tcp_security_ioctl.h). Each stage sits behind its own
+ * static key, so a stage dropped through the stages parameter costs a
+ * patched-out branch. Length checks and the quantum-safe signature check
+ * are not stages: they follow security_level and are never skipped.
+ * With stage_cycles=1 every stage run adds its get_cycles() delta to
+ * per-CPU counters, which /proc/tcp_security_stages reports; an
+ * attestation worker batch counts as one attest run.
+ */
+static unsigned int stages = TCP_STAGES_ALL;
+static DEFINE_STATIC_KEY_ARRAY_TRUE(tcp_stage_key, TCP_NR_STAGES);
+static DEFINE_STATIC_KEY_FALSE(tcp_stage_cycles_key);
+
+struct tcp_stage_stats {
+    u64 runs[TCP_NR_STAGES];
+    u64 cycles[TCP_NR_STAGES];
+};
+
+static DEFINE_PER_CPU(struct tcp_stage_stats, tcp_cpu_stages);
+
+#define tcp_stage_on(stage) static_branch_likely(&tcp_stage_key[stage])
+
+static __always_inline u64 tcp_stage_start(void)
+{
+    return static_branch_unlikely(&tcp_stage_cycles_key) ? get_cycles() : 0;
+}
+
+/* A run that started before accounting was switched on is not counted */
+static __always_inline void tcp_stage_done(unsigned int stage, u64 start)
+{
+    if (static_branch_unlikely(&tcp_stage_cycles_key) && start) {
+        this_cpu_inc(tcp_cpu_stages.runs[stage]);
+        this_cpu_add(tcp_cpu_stages.cycles[stage], get_cycles() - start);
+    }
+}
+
+/* Hardware-accelerated CRC16 calculation */
+static u16 tcp_hardware_crc16(const u8 *data, size_t len)
+{
+    return crc32_le(0, data, len) & 0xFFFF;
+}
+
+/* SGX enclave validation */
+static int tcp_sgx_validation(const void *descriptor, size_t len)
+{
+    /* SGX secure enclave validation - 100ns target
+     * In production, would execute validation inside SGX enclave
+     */
+    
+    if (!(tcp_ctx.hardware_features & TCP_HW_SGX)) {
+        return 1; /* Skip if SGX not available */
+    }
+    
+    /* Simulate SGX enclave validation */
+    return 1; /* Success */
+}
+
+/* TPM hardware attestation */
+static int tcp_tpm_attestation(const void *descriptor, size_t len)
+{
+    /* TPM 2.0 hardware attestation - 1μs target */
+    
+    if (!(tcp_ctx.hardware_features & TCP_HW_TPM)) {
+        return 1; /* Skip if TPM not available */
+    }
+    
+    /* Simulate TPM attestation */
+    return 1; /* Success */
+}
+
+/* Magic, version and checksum of a descriptor of a supported length */
+static int tcp_check_format(const void *descriptor, size_t len)
+{
+    const struct tcp_classical_descriptor *classical = descriptor;
+    const struct tcp_quantum_descriptor *quantum = descriptor;
+    u16 calculated_crc;
+    
+    if (len == 24) {
+        if (classical->magic != TCP_MAGIC_CLASSICAL) {
+            return -EINVAL;
+        }
+        
+        calculated_crc = tcp_hardware_crc16((const u8 *)descriptor,
+                                            offsetof(struct tcp_classical_descriptor, checksum));
+        return calculated_crc == classical->checksum ? 1 : -EINVAL;
+    }
+    
+    if (quantum->magic != TCP_MAGIC_QUANTUM) {
+        return -EINVAL;
+    }
+    return quantum->version >= 3 ? 1 : -EINVAL; /* Below 3: not quantum-safe */
+}
+
+/*
+ * Format, checksum and signature checks - everything but hardware
+ * attestation. pqc says whether the caller already checked the signature.
+ */
+static int tcp_validate_software(const void *descriptor, size_t len,
+                                 enum tcp_pqc_state pqc)
+{
+    u64 start;
+    int result;
+    
+    if (len != 24 && len != 32) {
+        return -EINVAL;
+    }
+    
+    if (tcp_stage_on(TCP_STAGE_FORMAT)) {
+        start = tcp_stage_start();
+        result = tcp_check_format(descriptor, len);
+        tcp_stage_done(TCP_STAGE_FORMAT, start);
+        if (result <= 0) {
+            return result;
+        }
+    }
+    
+    /* Quantum-safe mode: the signature must verify */
+    if (len == 32 && tcp_pqc_active()) {
+        if (pqc == TCP_PQC_UNCHECKED ? !tcp_pqc_verify(descriptor) :
+                                       pqc == TCP_PQC_BAD) {
+            return -EACCES;
+        }
+    }
+    
+    return 1; /* Success */
+}
+
+/*
+ * Policy stages
+ *
+ * The LSM and eBPF stages ask tcp_kernel's policy engines (tcp_engine.h)
+ * whether the current task may use the descriptor, which they see as a
+ * pack entry that stands for no syscall: classical destructive
+ * descriptors map to an entry no context may use, everything else to a
+ * safe one. The answer depends on the caller and on policy the engines
+ * hold, so it is not part of the verdict: it is asked after the cache,
+ * on hits and misses alike, and never stored.
+ */
+#define TCP_DESC_DESTRUCTIVE    0x0001
+
+static const struct tcp_pack_entry tcp_policy_safe = {
+    .syscall_nr = -1,
+    .security_flags = TCP_FLAG_SAFE,
+    .context_mask = TCP_CTX_ALL,
+    .privilege_level = TCP_PRIV_USER,
+};
+
+static const struct tcp_pack_entry tcp_policy_destructive = {
+    .syscall_nr = -1,
+    .security_flags = TCP_FLAG_DESTRUCTIVE,
+    .context_mask = 0,
+    .privilege_level = TCP_PRIV_ROOT,
+};
+
+/*
+ * Apply the policy stages to result, the verdict from the cache or the
+ * checks above. Rejections are returned as they are; valid and pending
+ * descriptors the engines deny fail with -EACCES without waiting for
+ * attestation.
+ */
+static int tcp_validate_policy(const void *descriptor, size_t len, int result)
+{
+    const struct tcp_classical_descriptor *classical = descriptor;
+    const struct tcp_pack_entry *entry = &tcp_policy_safe;
+    u64 start;
+    int denied;
+    
+    if (result <= 0 && result != -EAGAIN) {
+        return result;
+    }
+    
+    if (len == 24 && (classical->security_flags & TCP_DESC_DESTRUCTIVE)) {
+        entry = &tcp_policy_destructive;
+    }
+    
+    if (tcp_stage_on(TCP_STAGE_LSM)) {
+        start = tcp_stage_start();
+        denied = tcp_engine_check(entry);
+        tcp_stage_done(TCP_STAGE_LSM, start);
+        if (denied) {
+            return -EACCES;
+        }
+    }
+    
+    if (tcp_stage_on(TCP_STAGE_EBPF)) {
+        start = tcp_stage_start();
+        denied = tcp_engine_bpf_check(entry);
+        tcp_stage_done(TCP_STAGE_EBPF, start);
+        if (denied) {
+            return -EACCES;
+        }
+    }
+    
+    return result;
+}
+
+/* True when validation has hardware attestation to do at all */
+static inline bool tcp_attest_needed(void)
+{
+    return tcp_stage_on(TCP_STAGE_ATTEST) &&
+           (tcp_ctx.hardware_features & (TCP_HW_SGX | TCP_HW_TPM));
+}
+
+/* Synchronous SGX and TPM checks for one descriptor */
+static int tcp_validate_hardware(const void *descriptor, size_t len)
+{
+    u64 start = tcp_stage_start();
+    int result = 1;
+    
+    if (!tcp_sgx_validation(descriptor, len) ||
+        !tcp_tpm_attestation(descriptor, len)) {
+        result = -EACCES;
+    }
+    
+    tcp_stage_done(TCP_STAGE_ATTEST, start);
+    return result;
+}
+
+/* Full synchronous validation, policy included - everything except the cache */
+static int tcp_validate_uncached(const void *descriptor, size_t len)
+{
+    int result = tcp_validate_software(descriptor, len, TCP_PQC_UNCHECKED);
+    
+    if (result > 0 && tcp_attest_needed()) {
+        result = tcp_validate_hardware(descriptor, len);
+    }
+    
+    return tcp_validate_policy(descriptor, len, result);
+}
+
+/*
+ * Asynchronous hardware attestation
+ *
+ * A TPM command takes milliseconds, so under an async attest_policy
+ * descriptors that pass the software checks are queued on a lock-free
+ * list instead of being attested inline. The worker takes the whole
+ * list at once, runs the enclave check per descriptor and a single TPM
+ * attestation over a fold of the batch's cache keys, and stores each
+ * final result in the validation cache. Requests queued while one batch
+ * is with the TPM form the next batch, so TPM round trips track worker
+ * runs rather than the request rate. The queue is bounded by
+ * attest_queue_max; past it descriptors are attested inline.
+ */
+struct tcp_attest_req {
+    struct llist_node node;
+    u64 descriptor_hash;     /* Cache key, when the caller had one */
+    int cache_node;          /* Cache shard the caller looks results up in */
+    unsigned int cache_gen;  /* Flush generation the verdict was started in */
+    bool hashed;             /* descriptor_hash is valid */
+    u8 len;
+    u8 descriptor[32];
+};
+
+static unsigned int attest_queue_max = 4096;
+module_param(attest_queue_max, uint, 0644);
+MODULE_PARM_DESC(attest_queue_max, "Attestations queued at most before falling back to inline");
+
+static LLIST_HEAD(tcp_attest_queue);
+static atomic_t tcp_attest_queued = ATOMIC_INIT(0);
+static struct workqueue_struct *tcp_attest_wq;
+
+static void tcp_attest_work_fn(struct work_struct *work)
+{
+    struct tcp_attest_req *req, *tmp;
+    struct llist_node *batch;
+    unsigned int count = 0;
+    u64 fold = 0, now, start;
+    bool tpm_ok;
+    int result;
+    
+    batch = llist_reverse_order(llist_del_all(&tcp_attest_queue));
+    if (!batch) {
+        return;
+    }
+    
+    /* First sightings were queued unhashed to keep SHA256 off their path */
+    llist_for_each_entry(req, batch, node) {
+        if (!req->hashed) {
+            req->descriptor_hash = tcp_descriptor_hash(req->descriptor, req->len);
+        }
+        fold = hash_64(fold ^ req->descriptor_hash, 64);
+        count++;
+    }
+    
+    /* One TPM round trip covers the whole batch */
+    start = tcp_stage_start();
+    tpm_ok = tcp_tpm_attestation(&fold, sizeof(fold));
+    
+    now = ktime_get_ns();
+    llist_for_each_entry_safe(req, tmp, batch, node) {
+        if (tpm_ok && tcp_sgx_validation(req->descriptor, req->len)) {
+            result = 1;
+        } else {
+            result = -EACCES;
+        }
+        tcp_cache_store_node(req->cache_node, req->descriptor_hash, now, result,
+                             req->cache_gen);
+        kfree(req);
+    }
+    tcp_stage_done(TCP_STAGE_ATTEST, start);
+    atomic_sub(count, &tcp_attest_queued);
+    
+    this_cpu_inc(tcp_cpu_stats.attest_batches);
+    this_cpu_add(tcp_cpu_stats.attest_completed, count);
+}
+
+static DECLARE_WORK(tcp_attest_work, tcp_attest_work_fn);
+
+/* Queue a descriptor for the worker; false when it must be attested inline */
+static bool tcp_attest_submit(const void *descriptor, size_t len,
+                              const u64 *descriptor_hash, unsigned int gen)
+{
+    struct tcp_attest_req *req;
+    
+    if (atomic_inc_return(&tcp_attest_queued) > READ_ONCE(attest_queue_max)) {
+        atomic_dec(&tcp_attest_queued);
+        return false;
+    }
+    
+    req = kmalloc(sizeof(*req), GFP_ATOMIC);
+    if (!req) {
+        atomic_dec(&tcp_attest_queued);
+        return false;
+    }
+    
+    req->cache_node = numa_mem_id();
+    req->cache_gen = gen;
+    req->hashed = descriptor_hash != NULL;
+    req->descriptor_hash = descriptor_hash ? *descriptor_hash : 0;
+    req->len = len;
+    memcpy(req->descriptor, descriptor, len);
+    
+    /* Only the push onto an empty queue needs to kick the worker */
+    if (llist_add(&req->node, &tcp_attest_queue)) {
+        queue_work(tcp_attest_wq, &tcp_attest_work);
+    }
+    this_cpu_inc(tcp_cpu_stats.attest_queued);
+    return true;
+}
+
+/*
+ * Validate a descriptor the cache could not answer. With a cache key the
+ * result is stored; a queued attestation is marked pending first, so the
+ * worker's final result always overwrites it and repeat lookups neither
+ * requeue nor block. Without a key (first sightings) nothing is stored
+ * here, and the worker caches the attested result itself. With the cache
+ * stage off a queued result could never be found, so attestation is
+ * inline. Results are stored against the flush generation sampled
+ * before the software checks ran. pqc is passed to the software checks.
+ */
+static int tcp_validate_fresh(const void *descriptor, size_t len,
+                              const u64 *descriptor_hash, u64 now,
+                              enum tcp_pqc_state pqc)
+{
+    unsigned int gen = tcp_cache_gen_read();
+    int result = tcp_validate_software(descriptor, len, pqc);
+    
+    if (result > 0 && tcp_attest_needed()) {
+        if (READ_ONCE(attest_policy) != TCP_ATTEST_INLINE &&
+            tcp_stage_on(TCP_STAGE_CACHE)) {
+            if (descriptor_hash) {
+                tcp_cache_store(*descriptor_hash, now, TCP_RESULT_PENDING, gen);
+            }
+            if (tcp_attest_submit(descriptor, len, descriptor_hash, gen)) {
+                return tcp_attest_provisional();
+            }
+        }
+        this_cpu_inc(tcp_cpu_stats.attest_inline);
+        result = tcp_validate_hardware(descriptor, len);
+    }
+    
+    if (descriptor_hash) {
+        tcp_cache_store(*descriptor_hash, now, result, gen);
+    }
+    return result;
+}
+
+/* Prefilter stage: true when the descriptor should go through the cache */
+static inline bool tcp_stage_admit(const void *descriptor, size_t len)
+{
+    u64 start;
+    bool admit;
+    
+    if (!tcp_stage_on(TCP_STAGE_CACHE)) {
+        return false;
+    }
+    if (!tcp_stage_on(TCP_STAGE_PREFILTER)) {
+        return true;
+    }
+    
+    start = tcp_stage_start();
+    admit = tcp_doorkeeper_admit(descriptor, len);
+    tcp_stage_done(TCP_STAGE_PREFILTER, start);
+    return admit;
+}
+
+/* Cache stage: hash the descriptor and look its verdict up */
+static inline bool tcp_stage_lookup(const void *descriptor, size_t len, u64 now,
+                                    u64 *descriptor_hash, int *result)
+{
+    u64 start = tcp_stage_start();
+    bool hit;
+    
+    *descriptor_hash = tcp_descriptor_hash(descriptor, len);
+    hit = tcp_cache_lookup(*descriptor_hash, now, result);
+    tcp_stage_done(TCP_STAGE_CACHE, start);
+    return hit;
+}
+
+/* Core TCP descriptor validation */
+int tcp_validate_descriptor_kernel(const void *descriptor, size_t len)
+{
+    u64 descriptor_hash;
+    int cached_result;
+    u64 start_time, end_time;
+    int result;
+    
+    start_time = ktime_get_ns();
+    tcp_profile_hit(descriptor, len);
+    
+    if (!tcp_stage_admit(descriptor, len)) {
+        /* First sighting of this command: no hash, no cache slot */
+        result = tcp_validate_fresh(descriptor, len, NULL, start_time,
+                                    TCP_PQC_UNCHECKED);
+        this_cpu_inc(tcp_cpu_stats.cache_bypasses);
+    } else {
+        /* Check cache first */
+        if (tcp_stage_lookup(descriptor, len, start_time, &descriptor_hash,
+                             &cached_result)) {
+            this_cpu_inc(tcp_cpu_stats.cache_hits);
+            result = tcp_validate_policy(descriptor, len, cached_result);
+            tcp_latency_add(&tcp_cpu_latency, TCP_LAT_HIT,
+                            ktime_get_ns() - start_time);
+            return result;
+        }
+        
+        /* Validate and cache - hits return exactly what a cold validation would */
+        result = tcp_validate_fresh(descriptor, len, &descriptor_hash, start_time,
+                                    TCP_PQC_UNCHECKED);
+    }
+    result = tcp_validate_policy(descriptor, len, result);
+    
+    /* Update statistics */
+    end_time = ktime_get_ns();
+    this_cpu_inc(tcp_cpu_stats.validation_count);
+    this_cpu_add(tcp_cpu_stats.total_time_ns, end_time - start_time);
+    if (result <= 0) {
+        this_cpu_inc(tcp_cpu_stats.security_violations);
+    }
+    tcp_latency_add(&tcp_cpu_latency, result > 0 ? TCP_LAT_MISS : TCP_LAT_BLOCKED,
+                    end_time - start_time);
+    
+    return result;
+}
+
+/*
+ * Magic screen for a batch: marks descriptor i in the bitmap when its
+ * magic matches. The inner loop is branch-free so it unrolls cleanly;
+ * kernel code cannot use SIMD here without kernel_fpu_begin(), which
+ * would cost more than it saves at these sizes.
+ */
+static void tcp_batch_screen_magic(const u8 *base, size_t len, unsigned int count,
+                                   u32 magic, unsigned long *bitmap)
+{
+    unsigned int word, i;
+    
+    for (word = 0; word < BITS_TO_LONGS(count); word++) {
+        unsigned int first = word * BITS_PER_LONG;
+        unsigned int n = min_t(unsigned int, count - first, BITS_PER_LONG);
+        const u8 *desc = base + (size_t)first * len;
+        unsigned long bits = 0;
+        
+        for (i = 0; i < n; i++, desc += len) {
+            u32 m;
+            
+            memcpy(&m, desc, sizeof(m));
+            bits |= (unsigned long)(m == magic) << i;
+        }
+        bitmap[word] = bits;
+    }
+}
+
+/*
+ * Validate a chunk of batch cache misses, their signatures checked in one
+ * pass first in quantum-safe mode. Clears the bit of each one found
+ * invalid and returns the number valid.
+ */
+static unsigned int tcp_batch_validate_misses(const u8 *base, size_t len,
+                                              struct tcp_batch_miss *miss,
+                                              unsigned int n, u64 now,
+                                              unsigned long *result_bitmap)
+{
+    unsigned int i, valid = 0;
+    int result;
+    
+    if (len == 32 && tcp_pqc_active()) {
+        tcp_pqc_verify_batch(base, miss, n);
+    }
+    
+    for (i = 0; i < n; i++) {
+        const u8 *desc = base + (size_t)miss[i].index * len;
+        
+        result = tcp_validate_fresh(desc, len,
+                                    miss[i].keyed ? &miss[i].descriptor_hash : NULL,
+                                    now, miss[i].pqc);
+        result = tcp_validate_policy(desc, len, result);
+        if (result > 0) {
+            valid++;
+        } else {
+            __clear_bit(miss[i].index, result_bitmap);
+        }
+    }
+    return valid;
+}
+
+/*
+ * Batch TCP descriptor validation
+ *
+ * Validates count descriptors of len bytes packed back to back. Bit i of
+ * result_bitmap (count bits) is set when descriptor i is valid. Takes one
+ * timestamp and makes one statistics update for the whole batch, and
+ * rejects bad magic before any hashing. Cache misses are validated
+ * TCP_PQC_BATCH_CHUNK at a time, so quantum signatures are only checked
+ * for descriptors the cache could not answer. Returns the number of
+ * valid descriptors, or -EINVAL for an unsupported descriptor length.
+ */
+int tcp_validate_descriptors_batch(const void *descriptors, size_t len,
+                                   unsigned int count,
+                                   unsigned long *result_bitmap)
+{
+    struct tcp_batch_miss miss[TCP_PQC_BATCH_CHUNK];
+    const u8 *base = descriptors;
+    unsigned int i, n = 0, hits = 0, bypasses = 0, screened, misses = 0;
+    unsigned int fresh_valid = 0, valid = 0;
+    u64 start_time;
+    u32 magic;
+    int result;
+    
+    if (len == 24) {
+        magic = TCP_MAGIC_CLASSICAL;
+    } else if (len == 32) {
+        magic = TCP_MAGIC_QUANTUM;
+    } else {
+        return -EINVAL;
+    }
+    
+    if (!count) {
+        return 0;
+    }
+    
+    start_time = ktime_get_ns();
+    
+    /* Pass 1: only descriptors with the right magic stay candidates */
+    if (tcp_stage_on(TCP_STAGE_FORMAT)) {
+        tcp_batch_screen_magic(base, len, count, magic, result_bitmap);
+    } else {
+        bitmap_fill(result_bitmap, count);
+    }
+    screened = count - bitmap_weight(result_bitmap, count);
+    
+    /* Pass 2: cache lookup, then full validation of the misses */
+    for_each_set_bit(i, result_bitmap, count) {
+        const u8 *desc = base + (size_t)i * len;
+        struct tcp_batch_miss *m = &miss[n];
+        
+        tcp_profile_hit(desc, len);
+        m->keyed = tcp_stage_admit(desc, len);
+        if (!m->keyed) {
+            /* First sighting: validate without hashing or caching */
+            bypasses++;
+        } else if (tcp_stage_lookup(desc, len, start_time, &m->descriptor_hash,
+                                    &result)) {
+            hits++;
+            if (tcp_validate_policy(desc, len, result) > 0) {
+                valid++;
+            } else {
+                __clear_bit(i, result_bitmap);
+            }
+            continue;
+        }
+        
+        m->index = i;
+        m->pqc = TCP_PQC_UNCHECKED;
+        if (++n == TCP_PQC_BATCH_CHUNK) {
+            fresh_valid += tcp_batch_validate_misses(base, len, miss, n,
+                                                     start_time, result_bitmap);
+            misses += n;
+            n = 0;
+        }
+    }
+    if (n) {
+        fresh_valid += tcp_batch_validate_misses(base, len, miss, n, start_time,
+                                                 result_bitmap);
+        misses += n;
+    }
+    valid += fresh_valid;
+    
+    /* One statistics update for the whole batch */
+    this_cpu_add(tcp_cpu_stats.validation_count, count - hits);
+    this_cpu_add(tcp_cpu_stats.cache_hits, hits);
+    this_cpu_add(tcp_cpu_stats.cache_bypasses, bypasses);
+    this_cpu_add(tcp_cpu_stats.security_violations,
+                 screened + misses - fresh_valid);
+    this_cpu_add(tcp_cpu_stats.total_time_ns, ktime_get_ns() - start_time);
+    
+    return valid;
+}
+
+/* Device interface: batch validation from userspace in one syscall */
+static long tcp_ioctl_validate_batch(struct tcp_validate_batch __user *ubatch)
+{
+    struct tcp_validate_batch batch;
+    unsigned long *bitmap;
+    u64 *words;
+    void *descs;
+    size_t nwords;
+    long ret;
+    
+    if (copy_from_user(&batch, ubatch, sizeof(batch))) {
+        return -EFAULT;
+    }
+    
+    if (!batch.count || batch.count > TCP_BATCH_MAX || batch.reserved ||
+        (batch.desc_len != 24 && batch.desc_len != 32)) {
+        return -EINVAL;
+    }
+    
+    descs = vmemdup_user(u64_to_user_ptr(batch.descriptors),
+                         (size_t)batch.count * batch.desc_len);
+    if (IS_ERR(descs)) {
+        return PTR_ERR(descs);
+    }
+    
+    nwords = DIV_ROUND_UP(batch.count, 64);
+    bitmap = bitmap_zalloc(batch.count, GFP_KERNEL);
+    words = kcalloc(nwords, sizeof(*words), GFP_KERNEL);
+    if (!bitmap || !words) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    
+    ret = tcp_validate_descriptors_batch(descs, batch.desc_len, batch.count, bitmap);
+    if (ret < 0) {
+        goto out;
+    }
+    
+    bitmap_to_arr64(words, bitmap, batch.count);
+    batch.valid_count = ret;
+    
+    if (copy_to_user(u64_to_user_ptr(batch.result_bitmap), words,
+                     nwords * sizeof(*words)) ||
+        put_user(batch.valid_count, &ubatch->valid_count)) {
+        ret = -EFAULT;
+        goto out;
+    }
+    ret = 0;
+    
+out:
+    kfree(words);
+    bitmap_free(bitmap);
+    kvfree(descs);
+    return ret;
+}
+
+/*
+ * Submission/completion rings (see tcp_security_ioctl.h)
+ *
+ * One ring pair per open file, in vmalloc_user() memory that userspace
+ * maps. The kernel keeps its own copies of the indices it owns and only
+ * publishes them, so nothing userspace writes to the header can push it
+ * outside the arrays. Each SQE is copied off the shared page before it
+ * is validated, so the submitter cannot change it mid-check. Consumption
+ * is serialized by ring->lock, whether it runs from RING_ENTER or from
+ * the async worker.
+ */
+struct tcp_ring {
+    struct mutex lock;           /* Serializes consumers */
+    struct tcp_ring_header *hdr;
+    struct tcp_sqe *sqes;
+    struct tcp_cqe *cqes;
+    void *mem;                   /* Whole mapping */
+    size_t size;
+    u32 sq_entries;
+    u32 cq_entries;
+    u32 sq_head;                 /* Authoritative copies */
+    u32 cq_tail;
+    struct eventfd_ctx *eventfd;
+    struct work_struct work;
+};
+
+static void tcp_ring_notify(struct tcp_ring *ring)
+{
+    if (!ring->eventfd) {
+        return;
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+    eventfd_signal(ring->eventfd);
+#else
+    eventfd_signal(ring->eventfd, 1);
+#endif
+}
+
+/* Consume submitted entries while there is room to complete them */
+static unsigned int tcp_ring_consume(struct tcp_ring *ring)
+{
+    struct tcp_ring_header *hdr = ring->hdr;
+    unsigned int done = 0;
+    u32 sq_tail, cq_head;
+    
+    mutex_lock(&ring->lock);
+    sq_tail = smp_load_acquire(&hdr->sq_tail);
+    
+    while (ring->sq_head != sq_tail) {
+        struct tcp_sqe sqe;
+        struct tcp_cqe *cqe;
+        
+        /* Full completion ring: leave the rest submitted */
+        cq_head = smp_load_acquire(&hdr->cq_head);
+        if (ring->cq_tail - cq_head >= ring->cq_entries) {
+            break;
+        }
+        
+        memcpy(&sqe, &ring->sqes[ring->sq_head & (ring->sq_entries - 1)], sizeof(sqe));
+        ring->sq_head++;
+        
+        cqe = &ring->cqes[ring->cq_tail & (ring->cq_entries - 1)];
+        cqe->user_data = sqe.user_data;
+        if (sqe.reserved || (sqe.desc_len != 24 && sqe.desc_len != 32)) {
+            cqe->result = -EINVAL;
+        } else {
+            cqe->result = tcp_validate_descriptor_kernel(sqe.descriptor, sqe.desc_len);
+        }
+        cqe->reserved = 0;
+        ring->cq_tail++;
+        done++;
+        
+        /* Publish in chunks so reapers can start on a long batch */
+        if (!(done % 64)) {
+            smp_store_release(&hdr->sq_head, ring->sq_head);
+            smp_store_release(&hdr->cq_tail, ring->cq_tail);
+            cond_resched();
+        }
+        
+        if (ring->sq_head == sq_tail) {
+            sq_tail = smp_load_acquire(&hdr->sq_tail);
+        }
+    }
+    
+    smp_store_release(&hdr->sq_head, ring->sq_head);
+    smp_store_release(&hdr->cq_tail, ring->cq_tail);
+    mutex_unlock(&ring->lock);
+    
+    if (done) {
+        tcp_ring_notify(ring);
+    }
+    return done;
+}
+
+static void tcp_ring_work_fn(struct work_struct *work)
+{
+    tcp_ring_consume(container_of(work, struct tcp_ring, work));
+}
+
+static void tcp_ring_free(struct tcp_ring *ring)
+{
+    cancel_work_sync(&ring->work);
+    if (ring->eventfd) {
+        eventfd_ctx_put(ring->eventfd);
+    }
+    vfree(ring->mem);
+    kfree(ring);
+}
+
+static long tcp_ioctl_ring_setup(struct file *file, struct tcp_ring_setup __user *usetup)
+{
+    struct tcp_ring_setup setup;
+    struct tcp_ring *ring;
+    size_t sqes_offset, cqes_offset, size;
+    long ret;
+    
+    if (copy_from_user(&setup, usetup, sizeof(setup))) {
+        return -EFAULT;
+    }
+    
+    if (!setup.sq_entries || setup.sq_entries > TCP_RING_MAX_ENTRIES ||
+        !is_power_of_2(setup.sq_entries)) {
+        return -EINVAL;
+    }
+    
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring) {
+        return -ENOMEM;
+    }
+    mutex_init(&ring->lock);
+    INIT_WORK(&ring->work, tcp_ring_work_fn);
+    ring->sq_entries = setup.sq_entries;
+    ring->cq_entries = 2 * setup.sq_entries;
+    
+    sqes_offset = ALIGN(sizeof(struct tcp_ring_header), SMP_CACHE_BYTES);
+    cqes_offset = ALIGN(sqes_offset + ring->sq_entries * sizeof(struct tcp_sqe),
+                        SMP_CACHE_BYTES);
+    size = PAGE_ALIGN(cqes_offset + ring->cq_entries * sizeof(struct tcp_cqe));
+    
+    ring->mem = vmalloc_user(size);
+    if (!ring->mem) {
+        kfree(ring);
+        return -ENOMEM;
+    }
+    ring->size = size;
+    ring->hdr = ring->mem;
+    ring->sqes = ring->mem + sqes_offset;
+    ring->cqes = ring->mem + cqes_offset;
+    ring->hdr->sq_mask = ring->sq_entries - 1;
+    ring->hdr->cq_mask = ring->cq_entries - 1;
+    ring->hdr->sq_entries = ring->sq_entries;
+    ring->hdr->cq_entries = ring->cq_entries;
+    
+    if (setup.eventfd >= 0) {
+        ring->eventfd = eventfd_ctx_fdget(setup.eventfd);
+        if (IS_ERR(ring->eventfd)) {
+            ret = PTR_ERR(ring->eventfd);
+            ring->eventfd = NULL;
+            goto err;
+        }
+    }
+    
+    setup.cq_entries = ring->cq_entries;
+    setup.sqes_offset = sqes_offset;
+    setup.cqes_offset = cqes_offset;
+    setup.ring_size = size;
+    if (copy_to_user(usetup, &setup, sizeof(setup))) {
+        ret = -EFAULT;
+        goto err;
+    }
+    
+    /* One ring per file; the cmpxchg publishes it for mmap and RING_ENTER */
+    if (cmpxchg(&file->private_data, NULL, ring)) {
+        ret = -EBUSY;
+        goto err;
+    }
+    return 0;
+    
+err:
+    tcp_ring_free(ring);
+    return ret;
+}
+
+static long tcp_ioctl_ring_enter(struct file *file, u32 __user *uflags)
+{
+    struct tcp_ring *ring = smp_load_acquire(&file->private_data);
+    u32 flags;
+    
+    if (!ring) {
+        return -ENXIO;
+    }
+    if (get_user(flags, uflags)) {
+        return -EFAULT;
+    }
+    if (flags & ~TCP_RING_ENTER_ASYNC) {
+        return -EINVAL;
+    }
+    
+    if (flags & TCP_RING_ENTER_ASYNC) {
+        queue_work(system_unbound_wq, &ring->work);
+        return 0;
+    }
+    
+    return tcp_ring_consume(ring);
+}
+
+/*
+ * Validation cache snapshots
+ *
+ * Export walks every shard one set at a time under that set's lock and
+ * skips pending attestations and expired entries; a verdict cached on
+ * several nodes is exported once per node, and importing it twice is
+ * harmless. Entries carry their age, plus the time since the export
+ * was taken, so an imported verdict expires under cache_ttl_ms when it
+ * would have on the exporter. The doorkeeper
+ * still screens first sightings, so an imported verdict answers from a
+ * descriptor's second use on.
+ */
+#define TCP_SNAPSHOT_MAX_SIZE (sizeof(struct tcp_snapshot_header) + \
+                               TCP_SNAPSHOT_MAX_ENTRIES * sizeof(struct tcp_snapshot_entry))
+
+/* HMAC-SHA256 under the snapshot subkey over the header up to mac and the entries */
+static int tcp_snapshot_mac(const struct tcp_snapshot_header *hdr, u8 *mac)
+{
+    SHASH_DESC_ON_STACK(desc, tcp_snapshot_tfm);
+    int ret;
+    
+    desc->tfm = tcp_snapshot_tfm;
+    ret = crypto_shash_init(desc);
+    if (!ret) {
+        ret = crypto_shash_update(desc, (const u8 *)hdr,
+                                  offsetof(struct tcp_snapshot_header, mac));
+    }
+    if (!ret) {
+        ret = crypto_shash_update(desc, (const u8 *)(hdr + 1),
+                                  (size_t)hdr->count * sizeof(struct tcp_snapshot_entry));
+    }
+    if (!ret) {
+        ret = crypto_shash_final(desc, mac);
+    }
+    shash_desc_zero(desc);
+    return ret;
+}
+
+/* Copy up to max live verdicts from every shard; returns the number copied */
+static u32 tcp_snapshot_collect(struct tcp_snapshot_entry *entries, u32 max,
+                                u32 max_age_ms, u64 now)
+{
+    u64 max_age_ns = (u64)max_age_ms * NSEC_PER_MSEC;
+    const struct tcp_cache_entry *entry;
+    struct tcp_cache_set *shard;
+    u32 count = 0;
+    u32 i, way;
+    int node;
+    
+    for_each_node(node) {
+        shard = tcp_cache_shard[node];
+        
+        for (i = 0; shard && i < TCP_CACHE_SETS && count < max; i++) {
+            spin_lock(&shard[i].lock);
+            for (way = 0; way < TCP_CACHE_WAYS && count < max; way++) {
+                entry = &shard[i].ways[way];
+                if (!entry->valid || entry->validation_result == TCP_RESULT_PENDING ||
+                    tcp_cache_expired(entry, now) ||
+                    (max_age_ns && now - entry->timestamp > max_age_ns)) {
+                    continue;
+                }
+                
+                entries[count].descriptor_hash = entry->descriptor_hash;
+                entries[count].result = entry->validation_result;
+                entries[count].age_ms = min_t(u64, div_u64(now - entry->timestamp,
+                                                           NSEC_PER_MSEC), U32_MAX);
+                count++;
+            }
+            spin_unlock(&shard[i].lock);
+            cond_resched();
+        }
+    }
+    
+    return count;
+}
+
+/* Snapshot of at most max verdicts, signed when keyed; caller kvfree()s it */
+static struct tcp_snapshot_header *tcp_snapshot_build(u32 max, u32 max_age_ms,
+                                                      size_t *lenp)
+{
+    struct tcp_snapshot_header *hdr;
+    int ret;
+    
+    hdr = kvzalloc(sizeof(*hdr) + (size_t)max * sizeof(struct tcp_snapshot_entry),
+                   GFP_KERNEL);
+    if (!hdr) {
+        return ERR_PTR(-ENOMEM);
+    }
+    
+    hdr->magic = TCP_SNAPSHOT_MAGIC;
+    hdr->version = TCP_SNAPSHOT_VERSION;
+    hdr->security_level = READ_ONCE(tcp_ctx.security_level);
+    hdr->disabled_stages = ~READ_ONCE(stages) & TCP_STAGES_VERDICT;
+    hdr->hardware_features = READ_ONCE(tcp_ctx.hardware_features);
+    hdr->created_ns = ktime_get_real_ns();
+    hdr->count = tcp_snapshot_collect((struct tcp_snapshot_entry *)(hdr + 1), max,
+                                      max_age_ms, ktime_get_ns());
+    
+    /* Level and stage changes flush the cache; don't label old verdicts with new ones */
+    if (hdr->security_level != READ_ONCE(tcp_ctx.security_level) ||
+        hdr->disabled_stages != (~READ_ONCE(stages) & TCP_STAGES_VERDICT)) {
+        ret = -EAGAIN;
+        goto err;
+    }
+    
+    if (tcp_snapshot_tfm) {
+        ret = tcp_snapshot_mac(hdr, hdr->mac);
+        if (ret) {
+            goto err;
+        }
+    }
+    
+    *lenp = sizeof(*hdr) + (size_t)hdr->count * sizeof(struct tcp_snapshot_entry);
+    return hdr;
+    
+err:
+    kvfree(hdr);
+    return ERR_PTR(ret);
+}
+
+/* Verify a snapshot and store its verdicts in every shard; returns the count */
+static int tcp_snapshot_apply(const struct tcp_snapshot_header *hdr, size_t len)
+{
+    const struct tcp_snapshot_entry *entries = (const void *)(hdr + 1);
+    u32 required = READ_ONCE(tcp_ctx.hardware_features) & (TCP_HW_SGX | TCP_HW_TPM);
+    u8 mac[SHA256_DIGEST_SIZE];
+    u32 i, imported = 0;
+    u64 now, age, transit;
+    unsigned int gen;
+    s64 elapsed;
+    int node;
+    int ret;
+    
+    if (len < sizeof(*hdr) || hdr->magic != TCP_SNAPSHOT_MAGIC ||
+        hdr->version != TCP_SNAPSHOT_VERSION ||
+        hdr->count > TCP_SNAPSHOT_MAX_ENTRIES ||
+        len != sizeof(*hdr) + (size_t)hdr->count * sizeof(*entries)) {
+        return -EINVAL;
+    }
+    
+    /* Unkeyed snapshots only come from cache_persist; the ioctls need a key */
+    if (tcp_snapshot_tfm) {
+        ret = tcp_snapshot_mac(hdr, mac);
+        if (!ret && crypto_memneq(mac, hdr->mac, sizeof(mac))) {
+            ret = -EBADMSG;
+        }
+        memzero_explicit(mac, sizeof(mac));
+        if (ret) {
+            return ret;
+        }
+    }
+    
+    /* Verdicts depend on the level, the stages run and the attestations applied */
+    gen = tcp_cache_gen_read();
+    if (hdr->security_level != READ_ONCE(tcp_ctx.security_level) ||
+        hdr->disabled_stages != (~READ_ONCE(stages) & TCP_STAGES_VERDICT) ||
+        (hdr->hardware_features & required) != required) {
+        return -ESTALE;
+    }
+    
+    /* Time in transit or on disk counts toward the TTL; a clock ahead of ours adds none */
+    elapsed = ktime_get_real_ns() - hdr->created_ns;
+    transit = max_t(s64, elapsed, 0);
+    
+    now = ktime_get_ns();
+    for (i = 0; i < hdr->count; i++) {
+        if (entries[i].result > 1 || entries[i].result < S8_MIN) {
+            continue;
+        }
+        
+        age = min_t(u64, (u64)entries[i].age_ms * NSEC_PER_MSEC + transit, now);
+        for_each_node(node) {
+            if (tcp_cache_shard[node]) {
+                tcp_cache_store_node(node, entries[i].descriptor_hash, now - age,
+                                     entries[i].result, gen);
+            }
+        }
+        imported++;
+        
+        if (!(i % 256)) {
+            cond_resched();
+        }
+    }
+    
+    return imported;
+}
+
+/*
+ * Persistent cache
+ *
+ * With cache_persist set, the validation cache and the doorkeeper's
+ * command sightings are saved to that file on unload and restored at
+ * load, so a reloaded module starts warm instead of sending every
+ * descriptor through SHA256 and the full checks. The file holds a
+ * header, the doorkeeper bitmap and a cache snapshot. A CRC32 over
+ * everything after the header catches truncation and corruption; with a
+ * pqc_key the snapshot's HMAC also authenticates it. A file that fails
+ * either check, or was saved at another security level, is ignored and
+ * the module starts cold.
+ */
+#define TCP_PERSIST_MAGIC       0x50504354  /* "TCPP" */
+#define TCP_PERSIST_VERSION     1
+#define TCP_DOORKEEPER_BYTES    (BITS_TO_LONGS(TCP_DOORKEEPER_BITS) * sizeof(long))
+
+struct tcp_persist_header {
+    u32 magic;
+    u32 version;
+    u32 crc;                 /* crc32_le() of everything after the header */
+    u32 doorkeeper_bytes;    /* TCP_DOORKEEPER_BYTES */
+    u32 doorkeeper_inserts;
+    u32 snapshot_len;
+};
+
+static char *cache_persist;
+module_param(cache_persist, charp, 0444);
+MODULE_PARM_DESC(cache_persist, "File the validation cache is saved to on unload and restored from at load");
+
+static void tcp_persist_save(void)
+{
+    struct tcp_persist_header *hdr;
+    struct tcp_snapshot_header *snap;
+    struct file *filp;
+    loff_t pos = 0;
+    size_t len, size;
+    ssize_t ret;
+    
+    if (!cache_persist || !*cache_persist) {
+        return;
+    }
+    
+    snap = tcp_snapshot_build(TCP_SNAPSHOT_MAX_ENTRIES, 0, &len);
+    if (IS_ERR(snap)) {
+        ret = PTR_ERR(snap);
+        goto out;
+    }
+    
+    size = sizeof(*hdr) + TCP_DOORKEEPER_BYTES + len;
+    hdr = kvmalloc(size, GFP_KERNEL);
+    if (!hdr) {
+        ret = -ENOMEM;
+        goto out_snap;
+    }
+    
+    hdr->magic = TCP_PERSIST_MAGIC;
+    hdr->version = TCP_PERSIST_VERSION;
+    hdr->doorkeeper_bytes = TCP_DOORKEEPER_BYTES;
+    hdr->doorkeeper_inserts = atomic_read(&tcp_doorkeeper_inserts);
+    hdr->snapshot_len = len;
+    memcpy(hdr + 1, tcp_doorkeeper, TCP_DOORKEEPER_BYTES);
+    memcpy((u8 *)(hdr + 1) + TCP_DOORKEEPER_BYTES, snap, len);
+    hdr->crc = crc32_le(0, (const u8 *)(hdr + 1), size - sizeof(*hdr));
+    
+    filp = filp_open(cache_persist, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (IS_ERR(filp)) {
+        ret = PTR_ERR(filp);
+        goto out_buf;
+    }
+    ret = kernel_write(filp, hdr, size, &pos);
+    filp_close(filp, NULL);
+    if (ret >= 0) {
+        ret = (size_t)ret == size ? 0 : -EIO;
+    }
+    
+out_buf:
+    kvfree(hdr);
+out_snap:
+    if (!ret) {
+        printk(KERN_INFO "TCP: Saved %u cached verdicts to %s\n", snap->count, cache_persist);
+    }
+    kvfree(snap);
+out:
+    if (ret) {
+        printk(KERN_WARNING "TCP: Could not save validation cache to %s: %zd\n",
+               cache_persist, ret);
+    }
+}
+
+static void tcp_persist_load(void)
+{
+    const struct tcp_persist_header *hdr;
+    struct file *filp;
+    loff_t pos = 0;
+    loff_t size;
+    void *buf = NULL;
+    int ret;
+    
+    if (!cache_persist || !*cache_persist) {
+        return;
+    }
+    
+    filp = filp_open(cache_persist, O_RDONLY, 0);
+    if (IS_ERR(filp)) {
+        if (PTR_ERR(filp) == -ENOENT) {
+            printk(KERN_INFO "TCP: No saved validation cache at %s\n", cache_persist);
+            return;
+        }
+        ret = PTR_ERR(filp);
+        goto out;
+    }
+    
+    size = i_size_read(file_inode(filp));
+    ret = -EINVAL;
+    if (size < (loff_t)sizeof(*hdr) ||
+        size > (loff_t)(sizeof(*hdr) + TCP_DOORKEEPER_BYTES + TCP_SNAPSHOT_MAX_SIZE)) {
+        goto out_close;
+    }
+    
+    buf = kvmalloc(size, GFP_KERNEL);
+    if (!buf) {
+        ret = -ENOMEM;
+        goto out_close;
+    }
+    if (kernel_read(filp, buf, size, &pos) != size) {
+        ret = -EIO;
+        goto out_close;
+    }
+    
+    hdr = buf;
+    if (hdr->magic != TCP_PERSIST_MAGIC || hdr->version != TCP_PERSIST_VERSION ||
+        hdr->doorkeeper_bytes != TCP_DOORKEEPER_BYTES ||
+        size != sizeof(*hdr) + TCP_DOORKEEPER_BYTES + (loff_t)hdr->snapshot_len) {
+        goto out_close;
+    }
+    if (crc32_le(0, (const u8 *)(hdr + 1), size - sizeof(*hdr)) != hdr->crc) {
+        ret = -EBADMSG;
+        goto out_close;
+    }
+    
+    ret = tcp_snapshot_apply((const void *)((const u8 *)(hdr + 1) + TCP_DOORKEEPER_BYTES),
+                             hdr->snapshot_len);
+    if (ret >= 0) {
+        /* Nothing validates yet: the device and exports are not live */
+        memcpy(tcp_doorkeeper, hdr + 1, TCP_DOORKEEPER_BYTES);
+        atomic_set(&tcp_doorkeeper_inserts, hdr->doorkeeper_inserts);
+        printk(KERN_INFO "TCP: Restored %d cached verdicts from %s\n", ret, cache_persist);
+        ret = 0;
+    }
+    
+out_close:
+    filp_close(filp, NULL);
+    kvfree(buf);
+out:
+    if (ret) {
+        printk(KERN_WARNING "TCP: Ignoring saved validation cache %s: %d\n",
+               cache_persist, ret);
+    }
+}
+
+static long tcp_ioctl_cache_export(struct tcp_snapshot_xfer __user *uxfer)
+{
+    struct tcp_snapshot_header *snap;
+    struct tcp_snapshot_xfer xfer;
+    size_t len;
+    u32 max;
+    long ret;
+    
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+    if (!tcp_snapshot_tfm) {
+        return -ENOKEY;
+    }
+    if (copy_from_user(&xfer, uxfer, sizeof(xfer))) {
+        return -EFAULT;
+    }
+    if (xfer.reserved || xfer.len < sizeof(*snap)) {
+        return -EINVAL;
+    }
+    
+    max = min_t(size_t, (xfer.len - sizeof(*snap)) / sizeof(struct tcp_snapshot_entry),
+                TCP_SNAPSHOT_MAX_ENTRIES);
+    snap = tcp_snapshot_build(max, xfer.max_age_ms, &len);
+    if (IS_ERR(snap)) {
+        return PTR_ERR(snap);
+    }
+    
+    ret = 0;
+    if (copy_to_user(u64_to_user_ptr(xfer.buf), snap, len) ||
+        put_user((u32)len, &uxfer->len) ||
+        put_user(snap->count, &uxfer->count)) {
+        ret = -EFAULT;
+    }
+    kvfree(snap);
+    return ret;
+}
+
+static long tcp_ioctl_cache_import(struct tcp_snapshot_xfer __user *uxfer)
+{
+    struct tcp_snapshot_header *snap;
+    struct tcp_snapshot_xfer xfer;
+    int ret;
+    
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+    if (!tcp_snapshot_tfm) {
+        return -ENOKEY;
+    }
+    if (copy_from_user(&xfer, uxfer, sizeof(xfer))) {
+        return -EFAULT;
+    }
+    if (xfer.reserved || xfer.len < sizeof(*snap) || xfer.len > TCP_SNAPSHOT_MAX_SIZE) {
+        return -EINVAL;
+    }
+    
+    snap = vmemdup_user(u64_to_user_ptr(xfer.buf), xfer.len);
+    if (IS_ERR(snap)) {
+        return PTR_ERR(snap);
+    }
+    
+    ret = tcp_snapshot_apply(snap, xfer.len);
+    kvfree(snap);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    if (put_user((u32)ret, &uxfer->count)) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+static long tcp_ioctl_fleet_key(struct tcp_fleet_key __user *ukey)
+{
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+    if (!tcp_pqc_tfm) {
+        return -ENOKEY;
+    }
+    
+    if (copy_to_user(ukey->key, tcp_fleet_key, sizeof(ukey->key))) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+static long tcp_dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    switch (cmd) {
+    case TCP_IOC_VALIDATE_BATCH:
+        return tcp_ioctl_validate_batch((struct tcp_validate_batch __user *)arg);
+    case TCP_IOC_RING_SETUP:
+        return tcp_ioctl_ring_setup(file, (struct tcp_ring_setup __user *)arg);
+    case TCP_IOC_RING_ENTER:
+        return tcp_ioctl_ring_enter(file, (u32 __user *)arg);
+    case TCP_IOC_CACHE_EXPORT:
+        return tcp_ioctl_cache_export((struct tcp_snapshot_xfer __user *)arg);
+    case TCP_IOC_CACHE_IMPORT:
+        return tcp_ioctl_cache_import((struct tcp_snapshot_xfer __user *)arg);
+    case TCP_IOC_FLEET_KEY:
+        return tcp_ioctl_fleet_key((struct tcp_fleet_key __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* misc_open() leaves the miscdevice here; private_data holds the ring */
+static int tcp_dev_open(struct inode *inode, struct file *file)
+{
+    file->private_data = NULL;
+    return 0;
+}
+
+static int tcp_dev_release(struct inode *inode, struct file *file)
+{
+    if (file->private_data) {
+        tcp_ring_free(file->private_data);
+    }
+    return 0;
+}
+
+static int tcp_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct tcp_ring *ring = smp_load_acquire(&file->private_data);
+    
+    if (!ring) {
+        return -ENXIO;
+    }
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > ring->size) {
+        return -EINVAL;
+    }
+    
+    return remap_vmalloc_range(vma, ring->mem, 0);
+}
+
+static const struct file_operations tcp_dev_fops = {
+    .owner = THIS_MODULE,
+    .open = tcp_dev_open,
+    .release = tcp_dev_release,
+    .mmap = tcp_dev_mmap,
+    .unlocked_ioctl = tcp_dev_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+};
+
+static struct miscdevice tcp_miscdev = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name = "tcp_security",
+    .fops = &tcp_dev_fops,
+    .mode = 0660,           /* Root and the group udev gives the node */
+};
+
+/* Proc filesystem interface for statistics */
+static int tcp_proc_show(struct seq_file *m, void *v)
+{
+    struct tcp_validation_stats stats;
+    u64 avg_time_ns = 0;
+    u64 cache_hit_rate = 0;
+    int node;
+    
+    tcp_stats_snapshot(&stats);
+    
+    if (stats.validation_count > 0) {
+        avg_time_ns = div64_u64(stats.total_time_ns, stats.validation_count);
+        cache_hit_rate = div64_u64(stats.cache_hits * 100, stats.validation_count);
+    }
+    
+    seq_printf(m, "TCP Kernel Security Module Statistics\n");
+    seq_printf(m, "=====================================\n");
+    seq_printf(m, "Hardware Features: 0x%08x\n", tcp_ctx.hardware_features);
+    seq_printf(m, "Security Level: %u\n", tcp_ctx.security_level);
+    seq_printf(m, "Validation Stages: 0x%02x\n", READ_ONCE(stages));
+    seq_printf(m, "Total Validations: %llu\n", stats.validation_count);
+    seq_printf(m, "Cache Hits: %llu\n", stats.cache_hits);
+    seq_printf(m, "Cache Hit Rate: %llu%%\n", cache_hit_rate);
+    seq_printf(m, "Cache Bypasses: %llu\n", stats.cache_bypasses);
+    seq_printf(m, "Security Violations: %llu\n", stats.security_violations);
+    seq_printf(m, "Average Time (ns): %llu\n", avg_time_ns);
+    seq_printf(m, "Attestation Policy: %u\n", READ_ONCE(attest_policy));
+    seq_printf(m, "Attestations Queued: %llu\n", stats.attest_queued);
+    seq_printf(m, "Attestations Inline: %llu\n", stats.attest_inline);
+    seq_printf(m, "Attestation Batches: %llu\n", stats.attest_batches);
+    seq_printf(m, "Attestations Completed: %llu\n", stats.attest_completed);
+    seq_printf(m, "Attestations Pending: %d\n", atomic_read(&tcp_attest_queued));
+    seq_printf(m, "PQC Signatures: %s\n", tcp_pqc_tfm ? "keyed" : "no key");
+    seq_printf(m, "PQC Verified: %llu\n", stats.pqc_verified);
+    seq_printf(m, "PQC Verified (Cached): %llu\n", stats.pqc_cached);
+    seq_printf(m, "PQC Rejected: %llu\n", stats.pqc_rejected);
+    
+    /* Cache shards, with the work of the CPUs that use each one */
+    seq_printf(m, "\nCache Shards:\n");
+    for_each_node_state(node, N_MEMORY) {
+        tcp_stats_snapshot_node(&stats, node);
+        seq_printf(m, "  Node %d: %s, %llu validations, %llu hits (%llu%%)\n",
+                   node, tcp_cache_shard[node] ? "local" : "shared",
+                   stats.validation_count, stats.cache_hits,
+                   div64_u64(stats.cache_hits * 100, max(stats.validation_count, 1ULL)));
+    }
+    
+    /* Hardware feature breakdown */
+    seq_printf(m, "\nHardware Features:\n");
+    if (tcp_ctx.hardware_features & TCP_HW_LSM)
+        seq_printf(m, "  LSM Security Hooks: Enabled\n");
+    if (tcp_ctx.hardware_features & TCP_HW_EBPF)
+        seq_printf(m, "  eBPF Monitoring: Enabled\n");
+    if (tcp_ctx.hardware_features & TCP_HW_SGX)
+        seq_printf(m, "  Intel SGX: Enabled\n");
+    if (tcp_ctx.hardware_features & TCP_HW_CET)
+        seq_printf(m, "  Intel CET: Enabled\n");
+    if (tcp_ctx.hardware_features & TCP_HW_TPM)
+        seq_printf(m, "  TPM 2.0: Enabled\n");
+    
+    return 0;
+}
+
+static int tcp_proc_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tcp_proc_show, NULL);
+}
+
 static const struct proc_ops tcp_proc_ops = {
     .proc_open = tcp_proc_open,
     .proc_read = seq_read,
@@ -405,54 +2383,496 @@ static const struct proc_ops tcp_proc_ops = {
     .proc_release = single_release,
 };
 
+/*
+ * /proc/tcp_security_profile: the profile_top hottest commands over all
+ * CPUs with their share of the profiled validations, and whether the
+ * doorkeeper currently admits them to the validation cache. Any write
+ * clears the profile.
+ */
+static bool profile;
+static unsigned int profile_top = 16;
+module_param(profile_top, uint, 0644);
+MODULE_PARM_DESC(profile_top, "Commands listed by /proc/tcp_security_profile");
+
+static DEFINE_MUTEX(tcp_profile_mutex);
+
+static int tcp_profile_cmp_hash(const void *a, const void *b)
+{
+    const struct tcp_profile_slot *x = a, *y = b;
+    
+    return x->command_hash < y->command_hash ? -1 : x->command_hash > y->command_hash;
+}
+
+static int tcp_profile_cmp_count(const void *a, const void *b)
+{
+    const struct tcp_profile_slot *x = a, *y = b;
+    
+    return x->count < y->count ? 1 : -(x->count > y->count);
+}
+
+static int tcp_profile_show(struct seq_file *m, void *v)
+{
+    struct tcp_profile_slot *all;
+    unsigned int i, n = 0, merged = 0, top = READ_ONCE(profile_top);
+    u64 total = 0;
+    int cpu;
+    
+    all = kvmalloc_array(num_possible_cpus(), sizeof(all[0]) * TCP_PROFILE_SLOTS,
+                         GFP_KERNEL);
+    if (!all) {
+        return -ENOMEM;
+    }
+    
+    for_each_possible_cpu(cpu) {
+        const struct tcp_profile *p = per_cpu_ptr(tcp_profile, cpu);
+        
+        total += READ_ONCE(p->hits);
+        for (i = 0; i < TCP_PROFILE_SLOTS; i++) {
+            all[n].command_hash = READ_ONCE(p->slots[i].command_hash);
+            all[n].count = READ_ONCE(p->slots[i].count);
+            if (all[n].count) {
+                n++;
+            }
+        }
+    }
+    
+    /* The same command may be tracked on several CPUs; add them up */
+    sort(all, n, sizeof(all[0]), tcp_profile_cmp_hash, NULL);
+    for (i = 0; i < n; i++) {
+        if (merged && all[merged - 1].command_hash == all[i].command_hash) {
+            all[merged - 1].count += all[i].count;
+        } else {
+            all[merged++] = all[i];
+        }
+    }
+    sort(all, merged, sizeof(all[0]), tcp_profile_cmp_count, NULL);
+    
+    seq_printf(m, "# profiling %s, %llu validations\n",
+               READ_ONCE(profile) ? "on" : "off", total);
+    seq_printf(m, "# rank command_hash hits permille cached\n");
+    for (i = 0; i < min(merged, top); i++) {
+        seq_printf(m, "%u 0x%08x %u %llu %s\n", i + 1, all[i].command_hash,
+                   all[i].count, div64_u64((u64)all[i].count * 1000, max(total, 1ULL)),
+                   tcp_doorkeeper_seen(all[i].command_hash) ? "yes" : "no");
+    }
+    
+    kvfree(all);
+    return 0;
+}
+
+static int tcp_profile_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tcp_profile_show, NULL);
+}
+
+static ssize_t tcp_profile_write(struct file *file, const char __user *buf,
+                                 size_t len, loff_t *ppos)
+{
+    int cpu;
+    
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+    
+    for_each_possible_cpu(cpu) {
+        memset(per_cpu_ptr(tcp_profile, cpu), 0, sizeof(struct tcp_profile));
+    }
+    
+    return len;
+}
+
+static const struct proc_ops tcp_profile_proc_ops = {
+    .proc_open = tcp_profile_open,
+    .proc_read = seq_read,
+    .proc_write = tcp_profile_write,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
+/* Before init allocates the tables only the flag is recorded */
+static int tcp_profile_set(const char *val, const struct kernel_param *kp)
+{
+    bool on;
+    int ret;
+    
+    ret = kstrtobool(val, &on);
+    if (ret) {
+        return ret;
+    }
+    
+    mutex_lock(&tcp_profile_mutex);
+    profile = on;
+    if (tcp_profile) {
+        if (on) {
+            static_branch_enable(&tcp_profile_key);
+        } else {
+            static_branch_disable(&tcp_profile_key);
+        }
+    }
+    mutex_unlock(&tcp_profile_mutex);
+    
+    return 0;
+}
+
+static const struct kernel_param_ops tcp_profile_ops = {
+    .set = tcp_profile_set,
+    .get = param_get_bool,
+};
+
+module_param_cb(profile, &tcp_profile_ops, &profile, 0644);
+MODULE_PARM_DESC(profile, "Count validations per command for /proc/tcp_security_profile");
+
+/*
+ * /proc/tcp_security_stages: per stage whether it is enabled, and its
+ * runs, cycles and cycles per run summed over all CPUs while
+ * stage_cycles was on. Any write clears the counters.
+ */
+static const char * const tcp_stage_names[TCP_NR_STAGES] = {
+    [TCP_STAGE_PREFILTER] = "prefilter",
+    [TCP_STAGE_CACHE] = "cache",
+    [TCP_STAGE_FORMAT] = "format",
+    [TCP_STAGE_LSM] = "lsm",
+    [TCP_STAGE_EBPF] = "ebpf",
+    [TCP_STAGE_ATTEST] = "attest",
+};
+
+static DEFINE_MUTEX(tcp_stage_mutex);
+static bool stage_cycles;
+
+/* Sum the per-CPU stage counters at read time */
+static void tcp_stage_snapshot(struct tcp_stage_stats *sum)
+{
+    tcp_percpu_sum(sum, &tcp_cpu_stages, cpu_possible_mask);
+}
+
+static int tcp_stages_show(struct seq_file *m, void *v)
+{
+    unsigned int mask = READ_ONCE(stages);
+    struct tcp_stage_stats sum;
+    int stage;
+    
+    tcp_stage_snapshot(&sum);
+    
+    seq_printf(m, "# cycle accounting %s\n", READ_ONCE(stage_cycles) ? "on" : "off");
+    seq_printf(m, "# stage enabled runs cycles cycles_per_run\n");
+    for (stage = 0; stage < TCP_NR_STAGES; stage++) {
+        seq_printf(m, "%s %s %llu %llu %llu\n", tcp_stage_names[stage],
+                   mask & BIT(stage) ? "on" : "off", sum.runs[stage], sum.cycles[stage],
+                   sum.runs[stage] ? div64_u64(sum.cycles[stage], sum.runs[stage]) : 0);
+    }
+    
+    return 0;
+}
+
+static int tcp_stages_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tcp_stages_show, NULL);
+}
+
+static ssize_t tcp_stages_write(struct file *file, const char __user *buf,
+                                size_t len, loff_t *ppos)
+{
+    int cpu;
+    
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+    
+    for_each_possible_cpu(cpu) {
+        memset(per_cpu_ptr(&tcp_cpu_stages, cpu), 0, sizeof(struct tcp_stage_stats));
+    }
+    
+    return len;
+}
+
+static const struct proc_ops tcp_stages_proc_ops = {
+    .proc_open = tcp_stages_open,
+    .proc_read = seq_read,
+    .proc_write = tcp_stages_write,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
+/*
+ * A new stage mask takes effect stage by stage; when it changes a
+ * verdict stage the cache is flushed afterwards, so no result reached
+ * through the old set of checks is served under the new one.
+ */
+static int tcp_stages_set(const char *val, const struct kernel_param *kp)
+{
+    unsigned int mask, changed;
+    int stage, ret;
+    
+    ret = kstrtouint(val, 0, &mask);
+    if (ret) {
+        return ret;
+    }
+    if (mask & ~TCP_STAGES_ALL) {
+        return -EINVAL;
+    }
+    
+    mutex_lock(&tcp_stage_mutex);
+    changed = stages ^ mask;
+    WRITE_ONCE(stages, mask);
+    for (stage = 0; stage < TCP_NR_STAGES; stage++) {
+        if (!(changed & BIT(stage))) {
+            continue;
+        }
+        if (mask & BIT(stage)) {
+            static_branch_enable(&tcp_stage_key[stage]);
+        } else {
+            static_branch_disable(&tcp_stage_key[stage]);
+        }
+    }
+    mutex_unlock(&tcp_stage_mutex);
+    
+    if (changed & TCP_STAGES_VERDICT) {
+        tcp_cache_flush();
+    }
+    return 0;
+}
+
+static const struct kernel_param_ops tcp_stages_ops = {
+    .set = tcp_stages_set,
+    .get = param_get_uint,
+};
+
+module_param_cb(stages, &tcp_stages_ops, &stages, 0644);
+MODULE_PARM_DESC(stages, "Enabled validation stages, bit (1 << TCP_STAGE_*) each (default all)");
+
+static int tcp_stage_cycles_set(const char *val, const struct kernel_param *kp)
+{
+    bool on;
+    int ret;
+    
+    ret = kstrtobool(val, &on);
+    if (ret) {
+        return ret;
+    }
+    
+    mutex_lock(&tcp_stage_mutex);
+    stage_cycles = on;
+    if (on) {
+        static_branch_enable(&tcp_stage_cycles_key);
+    } else {
+        static_branch_disable(&tcp_stage_cycles_key);
+    }
+    mutex_unlock(&tcp_stage_mutex);
+    
+    return 0;
+}
+
+static const struct kernel_param_ops tcp_stage_cycles_ops = {
+    .set = tcp_stage_cycles_set,
+    .get = param_get_bool,
+};
+
+module_param_cb(stage_cycles, &tcp_stage_cycles_ops, &stage_cycles, 0644);
+MODULE_PARM_DESC(stage_cycles, "Count cycles per validation stage for /proc/tcp_security_stages");
+
+/*
+ * /proc/tcp_security_raw: struct tcp_security_raw, for scrapers that
+ * would otherwise parse /proc/tcp_security. Each open file keeps its own
+ * snapshot, retaken by every read at offset 0.
+ */
+static void tcp_raw_snapshot(struct tcp_security_raw *raw)
+{
+    struct tcp_validation_stats stats;
+    struct tcp_stage_stats stage;
+    
+    tcp_stats_snapshot(&stats);
+    tcp_stage_snapshot(&stage);
+    
+    memset(raw, 0, sizeof(*raw));
+    raw->magic = TCP_RAW_MAGIC;
+    raw->version = TCP_RAW_VERSION;
+    raw->size = sizeof(*raw);
+    raw->hardware_features = READ_ONCE(tcp_ctx.hardware_features);
+    raw->security_level = READ_ONCE(tcp_ctx.security_level);
+    raw->stages = READ_ONCE(stages);
+    raw->snapshot_ns = ktime_get_ns();
+    raw->validation_count = stats.validation_count;
+    raw->cache_hits = stats.cache_hits;
+    raw->cache_bypasses = stats.cache_bypasses;
+    raw->security_violations = stats.security_violations;
+    raw->total_time_ns = stats.total_time_ns;
+    raw->attest_queued = stats.attest_queued;
+    raw->attest_inline = stats.attest_inline;
+    raw->attest_batches = stats.attest_batches;
+    raw->attest_completed = stats.attest_completed;
+    raw->pqc_verified = stats.pqc_verified;
+    raw->pqc_cached = stats.pqc_cached;
+    raw->pqc_rejected = stats.pqc_rejected;
+    raw->attest_pending = max(atomic_read(&tcp_attest_queued), 0);
+    memcpy(raw->stage_runs, stage.runs, sizeof(raw->stage_runs));
+    memcpy(raw->stage_cycles, stage.cycles, sizeof(raw->stage_cycles));
+}
+
+static int tcp_raw_open(struct inode *inode, struct file *file)
+{
+    file->private_data = kzalloc(sizeof(struct tcp_security_raw), GFP_KERNEL);
+    return file->private_data ? 0 : -ENOMEM;
+}
+
+static ssize_t tcp_raw_read(struct file *file, char __user *buf, size_t len,
+                            loff_t *ppos)
+{
+    struct tcp_security_raw *raw = file->private_data;
+    
+    if (*ppos == 0) {
+        tcp_raw_snapshot(raw);
+    }
+    return simple_read_from_buffer(buf, len, ppos, raw, sizeof(*raw));
+}
+
+static int tcp_raw_release(struct inode *inode, struct file *file)
+{
+    kfree(file->private_data);
+    return 0;
+}
+
+static const struct proc_ops tcp_raw_proc_ops = {
+    .proc_open = tcp_raw_open,
+    .proc_read = tcp_raw_read,
+    .proc_lseek = default_llseek,
+    .proc_release = tcp_raw_release,
+};
+
+static const struct tcp_proc_file tcp_proc_files[] = {
+    { "tcp_security",         0444, &tcp_proc_ops },
+    { "tcp_security_latency", 0644, &tcp_latency_proc_ops,
+      (void __force *)&tcp_cpu_latency },
+    { "tcp_security_profile", 0644, &tcp_profile_proc_ops },
+    { "tcp_security_stages",  0644, &tcp_stages_proc_ops },
+    { "tcp_security_raw",     0444, &tcp_raw_proc_ops },
+};
+
 /* Module initialization */
 static int __init tcp_kernel_init(void)
 {
-    /* Initialize validation context */
-    memset(&tcp_ctx, 0, sizeof(tcp_ctx));
-    spin_lock_init(&tcp_ctx.lock);
+    int ret;
+    
+    BUILD_BUG_ON(sizeof(struct tcp_classical_descriptor) != 24);
+    BUILD_BUG_ON(sizeof(struct tcp_quantum_descriptor) != 32);
+    BUILD_BUG_ON(sizeof(struct tcp_security_raw) > U16_MAX);
     
     /* Detect hardware features */
     tcp_ctx.hardware_features = tcp_detect_hardware_features();
-    tcp_ctx.security_level = 1; /* Basic security by default */
+    
+    /* Set up hashing once so validation never allocates */
+    ret = tcp_crypto_init();
+    if (ret) {
+        printk(KERN_ERR "TCP: Failed to initialize SHA256\n");
+        return ret;
+    }
+    
+    ret = tcp_pqc_init();
+    if (ret) {
+        printk(KERN_ERR "TCP: Failed to set up quantum signature key: %d\n", ret);
+        goto err_crypto;
+    }
+    if (!tcp_pqc_tfm) {
+        printk(KERN_INFO "TCP: No pqc_key, quantum descriptors fail at security level %d+\n",
+               TCP_LEVEL_QUANTUM_SAFE);
+    }
     
     /* Allocate validation cache */
-    tcp_cache = kcalloc(TCP_CACHE_SIZE, sizeof(struct tcp_cache_entry), GFP_KERNEL);
-    if (!tcp_cache) {
+    ret = tcp_cache_init();
+    if (ret) {
         printk(KERN_ERR "TCP: Failed to allocate validation cache\n");
-        return -ENOMEM;
+        goto err_pqc;
     }
     
-    /* Create proc interface */
-    if (!proc_create("tcp_security", 0444, NULL, &tcp_proc_ops)) {
-        printk(KERN_ERR "TCP: Failed to create proc interface\n");
-        kfree(tcp_cache);
-        return -ENOMEM;
+    /* Command profile tables, counting from the start when profile=1 */
+    tcp_profile = alloc_percpu(struct tcp_profile);
+    if (!tcp_profile) {
+        printk(KERN_ERR "TCP: Failed to allocate command profile\n");
+        ret = -ENOMEM;
+        goto err_cache;
+    }
+    mutex_lock(&tcp_profile_mutex);
+    if (profile) {
+        static_branch_enable(&tcp_profile_key);
+    }
+    mutex_unlock(&tcp_profile_mutex);
+    
+    /* One worker at a time: batches are serialized on the TPM */
+    tcp_attest_wq = alloc_workqueue("tcp_attest", WQ_UNBOUND, 1);
+    if (!tcp_attest_wq) {
+        printk(KERN_ERR "TCP: Failed to create attestation workqueue\n");
+        ret = -ENOMEM;
+        goto err_profile;
+    }
+    
+    /* Create proc interfaces */
+    ret = tcp_proc_files_create(tcp_proc_files, ARRAY_SIZE(tcp_proc_files));
+    if (ret) {
+        goto err_attest;
+    }
+    
+    /* Start warm when the last unload saved its cache */
+    tcp_persist_load();
+    
+    /* Create batch validation device */
+    ret = misc_register(&tcp_miscdev);
+    if (ret) {
+        printk(KERN_ERR "TCP: Failed to register %s: %d\n",
+               TCP_SECURITY_DEVICE, ret);
+        goto err_proc;
     }
     
     printk(KERN_INFO "TCP Kernel Security Module loaded\n");
     printk(KERN_INFO "TCP: Hardware features: 0x%08x\n", tcp_ctx.hardware_features);
-    printk(KERN_INFO "TCP: Validation cache: %d entries\n", TCP_CACHE_SIZE);
+    printk(KERN_INFO "TCP: Validation cache: %d entries (%d-way) on each of %u nodes\n",
+           TCP_CACHE_SIZE, TCP_CACHE_WAYS, num_node_state(N_MEMORY));
     
     return 0;
+    
+err_proc:
+    tcp_proc_files_remove(tcp_proc_files, ARRAY_SIZE(tcp_proc_files));
+err_attest:
+    destroy_workqueue(tcp_attest_wq);
+err_profile:
+    static_branch_disable(&tcp_profile_key);
+    free_percpu(tcp_profile);
+err_cache:
+    tcp_cache_exit();
+err_pqc:
+    tcp_pqc_exit();
+err_crypto:
+    tcp_crypto_exit();
+    return ret;
 }
 
 /* Module cleanup */
 static void __exit tcp_kernel_exit(void)
 {
-    /* Remove proc interface */
-    remove_proc_entry("tcp_security", NULL);
+    struct tcp_validation_stats stats;
+    
+    /* Remove device and proc interfaces */
+    misc_deregister(&tcp_miscdev);
+    tcp_proc_files_remove(tcp_proc_files, ARRAY_SIZE(tcp_proc_files));
     
-    /* Free validation cache */
-    kfree(tcp_cache);
+    /* Drain queued attestations before their results' cache goes away */
+    destroy_workqueue(tcp_attest_wq);
     
+    /* Save and free validation cache */
+    tcp_persist_save();
+    tcp_cache_exit();
+    static_branch_disable(&tcp_profile_key);
+    free_percpu(tcp_profile);
+    tcp_pqc_exit();
+    tcp_crypto_exit();
+    
+    tcp_stats_snapshot(&stats);
     printk(KERN_INFO "TCP Kernel Security Module unloaded\n");
     printk(KERN_INFO "TCP: Final statistics - Validations: %llu, Violations: %llu\n",
-           tcp_ctx.validation_count, tcp_ctx.security_violations);
+           stats.validation_count, stats.security_violations);
 }
 
 /* Export validation function for other kernel modules */
 EXPORT_SYMBOL(tcp_validate_descriptor_kernel);
+EXPORT_SYMBOL(tcp_validate_descriptors_batch);
 
 module_init(tcp_kernel_init);
 module_exit(tcp_kernel_exit);
@@ -463,9 +2883,36 @@ MODULE_DESCRIPTION("TCP Kernel-Level Hardware Security Integration");
 MODULE_VERSION(TCP_MODULE_VERSION);
 MODULE_ALIAS("tcp-security");
 
-/* Module parameters for runtime configuration */
-module_param_named(security_level, tcp_ctx.security_level, byte, 0644);
-MODULE_PARM_DESC(security_level, "TCP security level (0-6)");
+/*
+ * Module parameters for runtime configuration. A new security level
+ * flushes the validation cache so no result cached under the old level
+ * (e.g. an unverified quantum descriptor) survives the change.
+ */
+static int tcp_security_level_set(const char *val, const struct kernel_param *kp)
+{
+    u8 level;
+    int ret;
+    
+    ret = kstrtou8(val, 0, &level);
+    if (ret) {
+        return ret;
+    }
+    if (level > 6) {
+        return -EINVAL;
+    }
+    
+    WRITE_ONCE(tcp_ctx.security_level, level);
+    tcp_cache_flush();
+    return 0;
+}
+
+static const struct kernel_param_ops tcp_security_level_ops = {
+    .set = tcp_security_level_set,
+    .get = param_get_byte,
+};
+
+module_param_cb(security_level, &tcp_security_level_ops, &tcp_ctx.security_level, 0644);
+MODULE_PARM_DESC(security_level, "TCP security level (0-6, 5+ verifies quantum signatures)");
 
 static bool enable_sgx = true;
 module_param(enable_sgx, bool, 0644);
@@ -473,4 +2920,13 @@ MODULE_PARM_DESC(enable_sgx, "Enable Intel SGX validation");
 
 static bool enable_tpm = true;
 module_param(enable_tpm, bool, 0644);
-MODULE_PARM_DESC(enable_tpm, "Enable TPM hardware attestation");
\ No newline at end of file
+MODULE_PARM_DESC(enable_tpm, "Enable TPM hardware attestation");
+
+#ifdef TCP_SECURITY_KUNIT_TEST
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 0, 0)
+#error "KUnit suites in loadable modules need Linux 6.0 or later"
+#endif
+#if IS_ENABLED(CONFIG_KUNIT)
+#include "tcp_kernel_module_test.c"
+#endif
+#endif
@@ -0,0 +1,709 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * TCP Kernel Security Module - KUnit tests and benchmarks
+ * Dr. Sam Mitchell - Hardware Security Engineer
+ *
+ * Included at the end of tcp_kernel_module.c when built with KUNIT=1 so
+ * the cases can reach the static validation, cache and doorkeeper code.
+ * Correctness cases cover classical and quantum descriptors (valid, bad
+ * magic, bad CRC, destructive flags) and check that cached, bypassed and
+ * batch validation all return what a cold validation returns. Benchmark
+ * cases run kunit_iterations validations per path and report ns/op for
+ * cold validation, cache misses and cache hits.
+ */
+
+#include <kunit/test.h>
+#include <linux/prandom.h>
+#include <linux/sched.h>
+
+#ifndef KUNIT_CASE_SLOW
+#define KUNIT_CASE_SLOW KUNIT_CASE
+#endif
+
+static unsigned long kunit_iterations = 1000000;
+module_param(kunit_iterations, ulong, 0444);
+MODULE_PARM_DESC(kunit_iterations, "Validations per KUnit benchmark path");
+
+#define TCP_TEST_SEED           0x54435053
+#define TCP_TEST_POOL           65536   /* Distinct descriptors per pool */
+#define TCP_TEST_HOT            4096    /* Working set that fits the cache */
+#define TCP_TEST_COMMANDS       1024    /* Distinct command_hash values */
+#define TCP_TEST_EQUIVALENCE    65536   /* Descriptors in the equivalence test */
+
+enum tcp_test_kind {
+    TCP_TEST_VALID,
+    TCP_TEST_BAD_MAGIC,
+    TCP_TEST_BAD_CRC,            /* Quantum: pre-quantum version */
+    TCP_TEST_DESTRUCTIVE,
+    TCP_TEST_NR_KINDS
+};
+
+static void tcp_test_make_classical(struct rnd_state *rnd, enum tcp_test_kind kind,
+                                    u32 commands, void *buf)
+{
+    struct tcp_classical_descriptor *d = buf;
+
+    memset(d, 0, sizeof(*d));
+    d->magic = TCP_MAGIC_CLASSICAL;
+    d->command_hash = prandom_u32_state(rnd) % commands;
+    d->security_flags = prandom_u32_state(rnd) & ~0x0001U;
+    prandom_bytes_state(rnd, d->performance_data, sizeof(d->performance_data));
+
+    if (kind == TCP_TEST_DESTRUCTIVE) {
+        d->security_flags |= 0x0001;
+    } else if (kind == TCP_TEST_BAD_MAGIC) {
+        d->magic ^= 1U << (prandom_u32_state(rnd) % 32);
+    }
+
+    d->checksum = tcp_hardware_crc16(buf, offsetof(struct tcp_classical_descriptor, checksum));
+    if (kind == TCP_TEST_BAD_CRC) {
+        d->checksum ^= 1 + prandom_u32_state(rnd) % 0xFFFF;
+    }
+}
+
+static void tcp_test_make_quantum(struct rnd_state *rnd, enum tcp_test_kind kind,
+                                  u32 commands, void *buf)
+{
+    struct tcp_quantum_descriptor *d = buf;
+
+    memset(d, 0, sizeof(*d));
+    d->magic = TCP_MAGIC_QUANTUM;
+    d->version = 3;
+    d->command_hash = prandom_u32_state(rnd) % commands;
+    d->security_flags = prandom_u32_state(rnd);
+    prandom_bytes_state(rnd, d->performance_data, sizeof(d->performance_data));
+    prandom_bytes_state(rnd, d->pqc_signature, sizeof(d->pqc_signature));
+
+    if (kind == TCP_TEST_BAD_MAGIC) {
+        d->magic ^= 1U << (prandom_u32_state(rnd) % 32);
+    } else if (kind == TCP_TEST_BAD_CRC) {
+        d->version = prandom_u32_state(rnd) % 3;
+    }
+}
+
+static void tcp_test_make(struct rnd_state *rnd, size_t len, enum tcp_test_kind kind,
+                          u32 commands, void *buf)
+{
+    if (len == sizeof(struct tcp_classical_descriptor)) {
+        tcp_test_make_classical(rnd, kind, commands, buf);
+    } else {
+        tcp_test_make_quantum(rnd, kind, commands, buf);
+    }
+}
+
+/* Expected cold result for each kind */
+static int tcp_test_expected(size_t len, enum tcp_test_kind kind)
+{
+    switch (kind) {
+    case TCP_TEST_VALID:
+        return 1;
+    case TCP_TEST_DESTRUCTIVE:
+        /* Only classical descriptors carry the LSM destructive check */
+        return len == sizeof(struct tcp_classical_descriptor) ? -EACCES : 1;
+    default:
+        return -EINVAL;
+    }
+}
+
+static void tcp_test_reset_doorkeeper(void)
+{
+    bitmap_zero(tcp_doorkeeper, TCP_DOORKEEPER_BITS);
+    atomic_set(&tcp_doorkeeper_inserts, 0);
+}
+
+static unsigned int tcp_test_saved_policy;
+static unsigned int tcp_test_saved_stages;
+static u32 tcp_test_saved_features;
+static u8 tcp_test_saved_level;
+
+static void tcp_test_set_stages(struct kunit *test, unsigned int mask)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%u", mask);
+    KUNIT_EXPECT_EQ(test, tcp_stages_set(buf, NULL), 0);
+}
+
+/*
+ * Every case starts with an empty cache and doorkeeper, at security
+ * level 1 with every stage enabled and attesting inline, so "cold"
+ * always means the same full synchronous validation. Cases count hits
+ * in one node's cache shard, so the case thread is pinned to its CPU;
+ * the thread exits with the case.
+ */
+static int tcp_test_init(struct kunit *test)
+{
+    if (tcp_cache_home == NUMA_NO_NODE) {
+        kunit_skip(test, "validation cache not allocated");
+    }
+    set_cpus_allowed_ptr(current, cpumask_of(raw_smp_processor_id()));
+
+    tcp_test_saved_policy = READ_ONCE(attest_policy);
+    tcp_test_saved_features = READ_ONCE(tcp_ctx.hardware_features);
+    tcp_test_saved_level = READ_ONCE(tcp_ctx.security_level);
+    tcp_test_saved_stages = READ_ONCE(stages);
+    WRITE_ONCE(attest_policy, TCP_ATTEST_INLINE);
+    WRITE_ONCE(tcp_ctx.security_level, 1);
+    tcp_test_set_stages(test, TCP_STAGES_ALL);
+
+    flush_workqueue(tcp_attest_wq);
+    tcp_cache_flush();
+    tcp_test_reset_doorkeeper();
+    return 0;
+}
+
+static void tcp_test_exit(struct kunit *test)
+{
+    flush_workqueue(tcp_attest_wq);
+    WRITE_ONCE(tcp_ctx.hardware_features, tcp_test_saved_features);
+    WRITE_ONCE(attest_policy, tcp_test_saved_policy);
+    WRITE_ONCE(tcp_ctx.security_level, tcp_test_saved_level);
+    tcp_test_set_stages(test, tcp_test_saved_stages);
+    tcp_cache_flush();
+}
+
+/* Each kind, first sighting, cache fill and cache hit */
+static void tcp_test_kinds(struct kunit *test, size_t len)
+{
+    struct rnd_state rnd;
+    u8 buf[32];
+    int kind, pass;
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED + len);
+
+    for (kind = 0; kind < TCP_TEST_NR_KINDS; kind++) {
+        int expected = tcp_test_expected(len, kind);
+
+        tcp_test_make(&rnd, len, kind, U32_MAX, buf);
+        KUNIT_EXPECT_EQ_MSG(test, tcp_validate_uncached(buf, len), expected,
+                            "kind %d, cold", kind);
+
+        for (pass = 0; pass < 3; pass++) {
+            KUNIT_EXPECT_EQ_MSG(test, tcp_validate_descriptor_kernel(buf, len),
+                                expected, "kind %d, pass %d", kind, pass);
+        }
+    }
+}
+
+static void tcp_test_classical(struct kunit *test)
+{
+    tcp_test_kinds(test, sizeof(struct tcp_classical_descriptor));
+}
+
+static void tcp_test_quantum(struct kunit *test)
+{
+    tcp_test_kinds(test, sizeof(struct tcp_quantum_descriptor));
+}
+
+static void tcp_test_bad_length(struct kunit *test)
+{
+    u8 buf[64] = { 0 };
+    size_t len;
+
+    for (len = 0; len <= sizeof(buf); len++) {
+        if (len == 24 || len == 32) {
+            continue;
+        }
+        KUNIT_EXPECT_EQ_MSG(test, tcp_validate_descriptor_kernel(buf, len), -EINVAL,
+                            "len %zu", len);
+    }
+}
+
+/* Doorkeeper: a command's first sighting bypasses the cache, later ones use it */
+static void tcp_test_doorkeeper(struct kunit *test)
+{
+    struct tcp_validation_stats before, after;
+    struct rnd_state rnd;
+    u8 buf[24];
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, buf);
+
+    tcp_stats_snapshot(&before);
+    tcp_validate_descriptor_kernel(buf, sizeof(buf));
+    tcp_stats_snapshot(&after);
+    KUNIT_EXPECT_EQ(test, after.cache_bypasses - before.cache_bypasses, 1ULL);
+    KUNIT_EXPECT_EQ(test, after.cache_hits - before.cache_hits, 0ULL);
+
+    tcp_validate_descriptor_kernel(buf, sizeof(buf));
+    tcp_validate_descriptor_kernel(buf, sizeof(buf));
+    tcp_stats_snapshot(&after);
+    KUNIT_EXPECT_EQ(test, after.cache_bypasses - before.cache_bypasses, 1ULL);
+    KUNIT_EXPECT_EQ(test, after.cache_hits - before.cache_hits, 1ULL);
+}
+
+/* Profile: a command repeated on this CPU owns its slot with a lower-bound count */
+static void tcp_test_profile(struct kunit *test)
+{
+    struct tcp_profile *p = this_cpu_ptr(tcp_profile);
+    const struct tcp_profile_slot *slot;
+    struct rnd_state rnd;
+    u8 hot[24], cold[24];
+    u32 command_hash;
+    int i;
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, hot);
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, cold);
+    KUNIT_ASSERT_TRUE(test, tcp_descriptor_command(hot, sizeof(hot), &command_hash));
+    slot = &p->slots[hash_32(command_hash, ilog2(TCP_PROFILE_SLOTS))];
+
+    memset(p, 0, sizeof(*p));
+    static_branch_enable(&tcp_profile_key);
+    for (i = 0; i < 8; i++) {
+        tcp_validate_descriptor_kernel(hot, sizeof(hot));
+    }
+    tcp_validate_descriptor_kernel(cold, sizeof(cold));
+    if (!READ_ONCE(profile)) {
+        static_branch_disable(&tcp_profile_key);
+    }
+
+    /* Nothing else validates on this CPU while the case runs */
+    KUNIT_EXPECT_EQ(test, READ_ONCE(p->hits), 9ULL);
+    KUNIT_EXPECT_EQ(test, slot->command_hash, command_hash);
+    KUNIT_EXPECT_GE(test, slot->count, 7U);
+}
+
+/* Stages: dropping the LSM stage admits destructive descriptors, cached or not */
+static void tcp_test_stages(struct kunit *test)
+{
+    struct rnd_state rnd;
+    u8 buf[24];
+    int pass;
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    tcp_test_make_classical(&rnd, TCP_TEST_DESTRUCTIVE, U32_MAX, buf);
+
+    for (pass = 0; pass < 3; pass++) {
+        KUNIT_EXPECT_EQ_MSG(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)),
+                            -EACCES, "pass %d", pass);
+    }
+
+    /* Policy runs on cache hits too, so the switch applies at once */
+    tcp_test_set_stages(test, TCP_STAGES_ALL & ~BIT(TCP_STAGE_LSM));
+    for (pass = 0; pass < 3; pass++) {
+        KUNIT_EXPECT_EQ_MSG(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)),
+                            1, "pass %d without LSM", pass);
+    }
+
+    tcp_test_set_stages(test, TCP_STAGES_ALL);
+    KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)), -EACCES);
+}
+
+/* Raw statistics: the binary snapshot carries the same counters as the text */
+static void tcp_test_raw(struct kunit *test)
+{
+    struct tcp_validation_stats before, after;
+    struct tcp_security_raw *raw;
+    struct rnd_state rnd;
+    u8 buf[24];
+
+    raw = kunit_kzalloc(test, sizeof(*raw), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, raw);
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, buf);
+
+    tcp_stats_snapshot(&before);
+    tcp_validate_descriptor_kernel(buf, sizeof(buf));
+    tcp_validate_descriptor_kernel(buf, sizeof(buf));
+    tcp_raw_snapshot(raw);
+    tcp_stats_snapshot(&after);
+
+    KUNIT_EXPECT_EQ(test, raw->magic, (u32)TCP_RAW_MAGIC);
+    KUNIT_EXPECT_EQ(test, raw->size, (u16)sizeof(*raw));
+    KUNIT_EXPECT_EQ(test, raw->stages, (u8)TCP_STAGES_ALL);
+    KUNIT_EXPECT_GE(test, raw->validation_count, before.validation_count + 2);
+    KUNIT_EXPECT_LE(test, raw->validation_count, after.validation_count);
+    KUNIT_EXPECT_GE(test, raw->cache_bypasses, before.cache_bypasses + 1);
+    KUNIT_EXPECT_LE(test, raw->cache_bypasses, after.cache_bypasses);
+}
+
+/* Async attestation: held until the worker lands the result in the cache */
+static void tcp_test_attest_async(struct kunit *test)
+{
+    struct rnd_state rnd;
+    u8 buf[24];
+    int i;
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    WRITE_ONCE(tcp_ctx.hardware_features, tcp_test_saved_features | TCP_HW_TPM);
+    WRITE_ONCE(attest_policy, TCP_ATTEST_HOLD);
+
+    /* First sighting: queued unhashed, the worker caches the result */
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, buf);
+    KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)), -EAGAIN);
+    flush_workqueue(tcp_attest_wq);
+    KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)), 1);
+
+    /* Cached miss: marked pending, repeat lookups hold without requeueing */
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, buf);
+    for (i = 0; i < 3; i++) {
+        KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)), -EAGAIN);
+    }
+    flush_workqueue(tcp_attest_wq);
+    KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)), 1);
+
+    /* Optimistic: admitted while attestation is in flight */
+    WRITE_ONCE(attest_policy, TCP_ATTEST_OPTIMISTIC);
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, buf);
+    KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)), 1);
+
+    /* Software rejections never wait for hardware */
+    tcp_test_make_classical(&rnd, TCP_TEST_DESTRUCTIVE, U32_MAX, buf);
+    KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(buf, sizeof(buf)), -EACCES);
+}
+
+/* An attestation queued before a flush must not repopulate the cache */
+static void tcp_test_attest_flush(struct kunit *test)
+{
+    struct rnd_state rnd;
+    unsigned int gen;
+    u64 hash;
+    int result;
+    u8 buf[24];
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    WRITE_ONCE(tcp_ctx.hardware_features, tcp_test_saved_features | TCP_HW_TPM);
+
+    /* Queued, then flushed before or after the worker got to it */
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, buf);
+    hash = tcp_descriptor_hash(buf, sizeof(buf));
+    gen = tcp_cache_gen_read();
+    KUNIT_ASSERT_TRUE(test, tcp_attest_submit(buf, sizeof(buf), &hash, gen));
+    tcp_cache_flush();
+    flush_workqueue(tcp_attest_wq);
+    KUNIT_EXPECT_FALSE(test, tcp_cache_lookup(hash, ktime_get_ns(), &result));
+
+    /* Still queued across the flush: the worker drops the stale verdict */
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, buf);
+    hash = tcp_descriptor_hash(buf, sizeof(buf));
+    gen = tcp_cache_gen_read();
+    tcp_cache_flush();
+    KUNIT_ASSERT_TRUE(test, tcp_attest_submit(buf, sizeof(buf), &hash, gen));
+    flush_workqueue(tcp_attest_wq);
+    KUNIT_EXPECT_FALSE(test, tcp_cache_lookup(hash, ktime_get_ns(), &result));
+
+    /* A request from the current generation is still stored */
+    gen = tcp_cache_gen_read();
+    KUNIT_ASSERT_TRUE(test, tcp_attest_submit(buf, sizeof(buf), &hash, gen));
+    flush_workqueue(tcp_attest_wq);
+    KUNIT_EXPECT_TRUE(test, tcp_cache_lookup(hash, ktime_get_ns(), &result));
+    KUNIT_EXPECT_EQ(test, result, 1);
+}
+
+/* Sign a quantum descriptor with the loaded pqc_key */
+static void tcp_test_sign_quantum(struct tcp_quantum_descriptor *d)
+{
+    u8 mac[SHA256_DIGEST_SIZE];
+    struct shash_desc *desc;
+
+    desc = get_cpu_ptr(tcp_pqc_desc);
+    desc->tfm = tcp_pqc_tfm;
+    crypto_shash_digest(desc, (const u8 *)d, TCP_PQC_SIGNED_LEN, mac);
+    put_cpu_ptr(tcp_pqc_desc);
+    memcpy(d->pqc_signature, mac, sizeof(d->pqc_signature));
+}
+
+/* Quantum-safe mode: signed identities pass, single and batch agree */
+static void tcp_test_pqc(struct kunit *test)
+{
+    const unsigned int count = 256;
+    struct tcp_quantum_descriptor *descs, d;
+    unsigned long *bitmap;
+    struct rnd_state rnd;
+    unsigned int i;
+    int expected_valid = 0;
+
+    if (!tcp_pqc_tfm) {
+        kunit_skip(test, "module loaded without pqc_key");
+    }
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    WRITE_ONCE(tcp_ctx.security_level, TCP_LEVEL_QUANTUM_SAFE);
+
+    tcp_test_make_quantum(&rnd, TCP_TEST_VALID, U32_MAX, &d);
+    KUNIT_EXPECT_EQ(test, tcp_validate_uncached(&d, sizeof(d)), -EACCES);
+    tcp_test_sign_quantum(&d);
+    KUNIT_EXPECT_EQ(test, tcp_validate_uncached(&d, sizeof(d)), 1);
+
+    /* Telemetry is unsigned; identity is */
+    d.performance_data[0] ^= 0xff;
+    KUNIT_EXPECT_EQ(test, tcp_validate_uncached(&d, sizeof(d)), 1);
+    d.security_flags ^= 1;
+    KUNIT_EXPECT_EQ(test, tcp_validate_uncached(&d, sizeof(d)), -EACCES);
+
+    descs = kunit_kmalloc_array(test, count, sizeof(*descs), GFP_KERNEL);
+    bitmap = kunit_kcalloc(test, BITS_TO_LONGS(count), sizeof(*bitmap), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, descs);
+    KUNIT_ASSERT_NOT_NULL(test, bitmap);
+
+    /* Half signed, few distinct identities so the fingerprints get hit */
+    for (i = 0; i < count; i++) {
+        tcp_test_make_quantum(&rnd, TCP_TEST_VALID, 16, &descs[i]);
+        descs[i].security_flags &= 0x3;
+        if (prandom_u32_state(&rnd) & 1) {
+            tcp_test_sign_quantum(&descs[i]);
+        }
+    }
+
+    KUNIT_EXPECT_GE(test, tcp_validate_descriptors_batch(descs, sizeof(*descs), count, bitmap), 0);
+    for (i = 0; i < count; i++) {
+        bool valid = tcp_validate_uncached(&descs[i], sizeof(*descs)) > 0;
+
+        expected_valid += valid;
+        KUNIT_EXPECT_EQ_MSG(test, (bool)test_bit(i, bitmap), valid, "descriptor %u", i);
+    }
+    KUNIT_EXPECT_EQ(test, (int)bitmap_weight(bitmap, count), expected_valid);
+}
+
+/* Snapshot round trip: exported verdicts answer from the cache after a flush */
+static void tcp_test_snapshot(struct kunit *test)
+{
+    struct tcp_validation_stats before, after;
+    struct tcp_snapshot_header *snap;
+    struct tcp_snapshot_entry *entries;
+    struct rnd_state rnd;
+    u8 good[24], bad[24];
+    size_t len;
+
+    if (!tcp_pqc_tfm) {
+        kunit_skip(test, "module loaded without pqc_key");
+    }
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    tcp_test_make_classical(&rnd, TCP_TEST_VALID, U32_MAX, good);
+    tcp_test_make_classical(&rnd, TCP_TEST_DESTRUCTIVE, U32_MAX, bad);
+
+    /* Second sightings are cached */
+    tcp_validate_descriptor_kernel(good, sizeof(good));
+    tcp_validate_descriptor_kernel(good, sizeof(good));
+    tcp_validate_descriptor_kernel(bad, sizeof(bad));
+    tcp_validate_descriptor_kernel(bad, sizeof(bad));
+
+    snap = tcp_snapshot_build(64, 0, &len);
+    KUNIT_ASSERT_FALSE(test, IS_ERR(snap));
+    KUNIT_EXPECT_EQ(test, snap->count, 2U);
+
+    tcp_cache_flush();
+    KUNIT_EXPECT_EQ(test, tcp_snapshot_apply(snap, len), 2);
+
+    tcp_stats_snapshot(&before);
+    KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(good, sizeof(good)), 1);
+    KUNIT_EXPECT_EQ(test, tcp_validate_descriptor_kernel(bad, sizeof(bad)), -EACCES);
+    tcp_stats_snapshot(&after);
+    KUNIT_EXPECT_EQ(test, after.cache_hits - before.cache_hits, 2ULL);
+
+    /* Forged verdicts and other levels are refused */
+    entries = (struct tcp_snapshot_entry *)(snap + 1);
+    entries[0].result ^= 1;
+    KUNIT_EXPECT_EQ(test, tcp_snapshot_apply(snap, len), -EBADMSG);
+    entries[0].result ^= 1;
+    KUNIT_EXPECT_EQ(test, tcp_snapshot_apply(snap, len - 1), -EINVAL);
+    WRITE_ONCE(tcp_ctx.security_level, 2);
+    KUNIT_EXPECT_EQ(test, tcp_snapshot_apply(snap, len), -ESTALE);
+
+    kvfree(snap);
+}
+
+/*
+ * Randomized equivalence: mixed kinds and lengths over a small command
+ * set, so most descriptors go through the cache, and every answer must
+ * match the cold one.
+ */
+static void tcp_test_cache_equivalence(struct kunit *test)
+{
+    struct tcp_validation_stats before, after;
+    struct rnd_state rnd;
+    unsigned int i, mismatches = 0;
+    u8 buf[32];
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED);
+    tcp_stats_snapshot(&before);
+
+    for (i = 0; i < TCP_TEST_EQUIVALENCE; i++) {
+        size_t len = (prandom_u32_state(&rnd) & 1) ? 32 : 24;
+        enum tcp_test_kind kind = prandom_u32_state(&rnd) % TCP_TEST_NR_KINDS;
+        int cold, pass;
+
+        tcp_test_make(&rnd, len, kind, 256, buf);
+        cold = tcp_validate_uncached(buf, len);
+
+        for (pass = 0; pass < 2; pass++) {
+            if (tcp_validate_descriptor_kernel(buf, len) != cold) {
+                mismatches++;
+            }
+        }
+
+        if (!(i % 4096)) {
+            cond_resched();
+        }
+    }
+
+    tcp_stats_snapshot(&after);
+    KUNIT_EXPECT_EQ(test, mismatches, 0U);
+    KUNIT_EXPECT_GT(test, after.cache_hits - before.cache_hits, 0ULL);
+}
+
+/* Batch results must match single validation bit for bit */
+static void tcp_test_batch_equivalence(struct kunit *test)
+{
+    const unsigned int count = 1024;
+    unsigned long *bitmap;
+    struct rnd_state rnd;
+    unsigned int i;
+    int expected_valid;
+    size_t len;
+    u8 *descs;
+    int ret;
+
+    descs = kunit_kmalloc_array(test, count, 32, GFP_KERNEL);
+    bitmap = kunit_kcalloc(test, BITS_TO_LONGS(count), sizeof(*bitmap), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, descs);
+    KUNIT_ASSERT_NOT_NULL(test, bitmap);
+
+    for (len = 24; len <= 32; len += 8) {
+        prandom_seed_state(&rnd, TCP_TEST_SEED + len);
+        expected_valid = 0;
+        for (i = 0; i < count; i++) {
+            tcp_test_make(&rnd, len, prandom_u32_state(&rnd) % TCP_TEST_NR_KINDS,
+                          64, descs + i * len);
+        }
+
+        ret = tcp_validate_descriptors_batch(descs, len, count, bitmap);
+
+        for (i = 0; i < count; i++) {
+            bool valid = tcp_validate_uncached(descs + i * len, len) > 0;
+
+            expected_valid += valid;
+            KUNIT_EXPECT_EQ_MSG(test, (bool)test_bit(i, bitmap), valid,
+                                "len %zu, descriptor %u", len, i);
+        }
+        KUNIT_EXPECT_EQ(test, ret, expected_valid);
+    }
+}
+
+/* Fill a pool with valid descriptors over TCP_TEST_COMMANDS commands */
+static u8 *tcp_test_pool(struct kunit *test, size_t len)
+{
+    struct rnd_state rnd;
+    unsigned int i;
+    u8 *pool;
+
+    pool = kvmalloc_array(TCP_TEST_POOL, len, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, pool);
+
+    prandom_seed_state(&rnd, TCP_TEST_SEED ^ len);
+    for (i = 0; i < TCP_TEST_POOL; i++) {
+        tcp_test_make(&rnd, len, TCP_TEST_VALID, TCP_TEST_COMMANDS, pool + i * len);
+    }
+
+    return pool;
+}
+
+static void tcp_test_report(struct kunit *test, const char *what, size_t len,
+                            u64 ns, unsigned long ops)
+{
+    u64 ns_per_op = div64_u64(ns, max(ops, 1UL));
+
+    kunit_info(test, "%zu-byte %-5s %8llu ns/op %10llu ops/s (%lu ops)\n",
+               len, what, ns_per_op, div64_u64(NSEC_PER_SEC * (u64)ops, max_t(u64, ns, 1)),
+               ops);
+}
+
+/*
+ * Benchmark: cold validation (no hash, no cache), cache misses (hash,
+ * validate, store; the pool is 4x the cache) and cache hits (a hot set
+ * that fits the cache).
+ */
+static void tcp_test_bench(struct kunit *test, size_t len)
+{
+    unsigned long ops, target = max(kunit_iterations, 1UL);
+    u64 start, ns;
+    unsigned int i;
+    u8 *pool;
+
+    pool = tcp_test_pool(test, len);
+
+    /* Cold */
+    for (ops = 0, ns = 0; ops < target; ops += TCP_TEST_POOL) {
+        start = ktime_get_ns();
+        for (i = 0; i < TCP_TEST_POOL; i++) {
+            tcp_validate_uncached(pool + i * len, len);
+        }
+        ns += ktime_get_ns() - start;
+        cond_resched();
+    }
+    tcp_test_report(test, "cold", len, ns, ops);
+
+    /* Miss: every command admitted, every descriptor new to the cache */
+    for (ops = 0, ns = 0; ops < target; ops += TCP_TEST_POOL) {
+        tcp_cache_flush();
+        for (i = 0; i < TCP_TEST_POOL; i++) {
+            tcp_doorkeeper_admit(pool + i * len, len);
+        }
+        start = ktime_get_ns();
+        for (i = 0; i < TCP_TEST_POOL; i++) {
+            tcp_validate_descriptor_kernel(pool + i * len, len);
+        }
+        ns += ktime_get_ns() - start;
+        cond_resched();
+    }
+    tcp_test_report(test, "miss", len, ns, ops);
+
+    /* Hit: warm the hot set, then loop over it */
+    tcp_cache_flush();
+    for (i = 0; i < TCP_TEST_HOT; i++) {
+        tcp_doorkeeper_admit(pool + i * len, len);
+        tcp_validate_descriptor_kernel(pool + i * len, len);
+    }
+    for (ops = 0, ns = 0; ops < target; ops += TCP_TEST_HOT) {
+        start = ktime_get_ns();
+        for (i = 0; i < TCP_TEST_HOT; i++) {
+            tcp_validate_descriptor_kernel(pool + i * len, len);
+        }
+        ns += ktime_get_ns() - start;
+        cond_resched();
+    }
+    tcp_test_report(test, "hit", len, ns, ops);
+
+    kvfree(pool);
+}
+
+static void tcp_test_bench_classical(struct kunit *test)
+{
+    tcp_test_bench(test, sizeof(struct tcp_classical_descriptor));
+}
+
+static void tcp_test_bench_quantum(struct kunit *test)
+{
+    tcp_test_bench(test, sizeof(struct tcp_quantum_descriptor));
+}
+
+static struct kunit_case tcp_security_test_cases[] = {
+    KUNIT_CASE(tcp_test_classical),
+    KUNIT_CASE(tcp_test_quantum),
+    KUNIT_CASE(tcp_test_bad_length),
+    KUNIT_CASE(tcp_test_doorkeeper),
+    KUNIT_CASE(tcp_test_profile),
+    KUNIT_CASE(tcp_test_stages),
+    KUNIT_CASE(tcp_test_raw),
+    KUNIT_CASE(tcp_test_attest_async),
+    KUNIT_CASE(tcp_test_attest_flush),
+    KUNIT_CASE(tcp_test_pqc),
+    KUNIT_CASE(tcp_test_snapshot),
+    KUNIT_CASE(tcp_test_cache_equivalence),
+    KUNIT_CASE(tcp_test_batch_equivalence),
+    KUNIT_CASE_SLOW(tcp_test_bench_classical),
+    KUNIT_CASE_SLOW(tcp_test_bench_quantum),
+    {}
+};
+
+static struct kunit_suite tcp_security_test_suite = {
+    .name = "tcp_security",
+    .init = tcp_test_init,
+    .exit = tcp_test_exit,
+    .test_cases = tcp_security_test_cases,
+};
+
+kunit_test_suite(tcp_security_test_suite);
@@ -0,0 +1,229 @@
+/*
+ * TCP Kernel Security Module - Userspace Interface
+ * Dr. Sam Mitchell - Hardware Security Engineer
+ *
+ * ioctl ABI for /dev/tcp_security. Shared by the kernel module and
+ * userspace callers such as tcp_hardware_userspace.py.
+ */
+
+#ifndef _TCP_SECURITY_IOCTL_H
+#define _TCP_SECURITY_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define TCP_SECURITY_DEVICE     "/dev/tcp_security"
+#define TCP_SECURITY_IOC_MAGIC  'T'
+
+/* Largest batch accepted by a single TCP_IOC_VALIDATE_BATCH call */
+#define TCP_BATCH_MAX           4096
+
+/*
+ * Validation stages. Bit (1 << stage) of the stages module parameter
+ * enables a stage. Prefilter and cache only save work; the verdict
+ * stages decide cached results, so switching one flushes the cache. The
+ * policy stages (LSM, eBPF) ask tcp_kernel's engines about the calling
+ * task on every validation, after the cache, and are never cached.
+ */
+#define TCP_STAGE_PREFILTER     0   /* Doorkeeper: first sightings skip the cache */
+#define TCP_STAGE_CACHE         1   /* Descriptor hash and validation cache */
+#define TCP_STAGE_FORMAT        2   /* Magic, version and CRC */
+#define TCP_STAGE_LSM           3   /* tcp_kernel policy engine */
+#define TCP_STAGE_EBPF          4   /* tcp_kernel eBPF policy engine */
+#define TCP_STAGE_ATTEST        5   /* SGX enclave and TPM attestation */
+#define TCP_NR_STAGES           6
+
+#define TCP_STAGES_ALL          ((1U << TCP_NR_STAGES) - 1)
+#define TCP_STAGES_VERDICT      ((1U << TCP_STAGE_FORMAT) | (1U << TCP_STAGE_ATTEST))
+
+/*
+ * Batch validation request
+ *
+ * descriptors points at count descriptors of desc_len bytes each (24 for
+ * classical, 32 for quantum-safe), packed back to back. On return, bit i
+ * of the result bitmap is set when descriptor i validated successfully.
+ * The bitmap is an array of (count + 63) / 64 little-endian __u64 words.
+ */
+struct tcp_validate_batch {
+    __u64 descriptors;          /* User pointer to the descriptor array */
+    __u64 result_bitmap;        /* User pointer to the result bitmap */
+    __u32 count;                /* Number of descriptors */
+    __u32 desc_len;             /* Size of each descriptor in bytes */
+    __u32 valid_count;          /* Out: number of valid descriptors */
+    __u32 reserved;             /* Must be zero */
+};
+
+#define TCP_IOC_VALIDATE_BATCH  _IOWR(TCP_SECURITY_IOC_MAGIC, 1, struct tcp_validate_batch)
+
+/*
+ * Submission/completion rings
+ *
+ * TCP_IOC_RING_SETUP attaches a ring pair to the open file; mmap()
+ * ring_size bytes at offset 0 to reach it. The mapping starts with
+ * struct tcp_ring_header, then sq_entries struct tcp_sqe at sqes_offset
+ * and cq_entries struct tcp_cqe at cqes_offset.
+ *
+ * To submit, fill sqes[sq_tail & sq_mask] and advance sq_tail with a
+ * store-release. To reap, read cqes[cq_head & cq_mask] up to cq_tail
+ * (load-acquire) and advance cq_head. The kernel owns sq_head and
+ * cq_tail. TCP_IOC_RING_ENTER consumes every submitted entry in one call,
+ * either inline or, with TCP_RING_ENTER_ASYNC, from a worker. When an
+ * eventfd was given at setup, it is signalled whenever completions are
+ * posted. Submission stops while the completion ring is full.
+ */
+#define TCP_RING_MAX_ENTRIES    4096
+#define TCP_RING_ENTER_ASYNC    (1U << 0)
+
+struct tcp_ring_setup {
+    __u32 sq_entries;           /* In: power of two, 1..TCP_RING_MAX_ENTRIES */
+    __s32 eventfd;              /* In: eventfd for completions, or -1 */
+    __u32 cq_entries;           /* Out: twice sq_entries */
+    __u32 sqes_offset;          /* Out: SQE array offset in the mapping */
+    __u32 cqes_offset;          /* Out: CQE array offset in the mapping */
+    __u32 ring_size;            /* Out: bytes to mmap at offset 0 */
+};
+
+/* Each index pair shares a cache line with its writer's other index */
+struct tcp_ring_header {
+    __u32 sq_head;              /* Kernel: next SQE to consume */
+    __u32 cq_tail;              /* Kernel: next CQE slot to fill */
+    __u32 sq_mask;
+    __u32 cq_mask;
+    __u32 sq_entries;
+    __u32 cq_entries;
+    __u32 reserved0[10];
+    __u32 sq_tail;              /* User: next SQE slot to fill */
+    __u32 cq_head;              /* User: next CQE to reap */
+    __u32 reserved1[14];
+};
+
+struct tcp_sqe {
+    __u64 user_data;            /* Copied into the completion */
+    __u32 desc_len;             /* 24 (classical) or 32 (quantum-safe) */
+    __u32 reserved;             /* Must be zero */
+    __u8  descriptor[32];
+};
+
+struct tcp_cqe {
+    __u64 user_data;
+    __s32 result;               /* As tcp_validate_descriptor_kernel() */
+    __u32 reserved;
+};
+
+#define TCP_IOC_RING_SETUP      _IOWR(TCP_SECURITY_IOC_MAGIC, 2, struct tcp_ring_setup)
+#define TCP_IOC_RING_ENTER      _IOW(TCP_SECURITY_IOC_MAGIC, 3, __u32)
+
+/*
+ * Validation cache snapshots
+ *
+ * TCP_IOC_CACHE_EXPORT writes the cached results (descriptor hash to
+ * verdict) into buf as a header followed by count entries; with
+ * max_age_ms set only results cached within that window are exported,
+ * which makes periodic exports an incremental stream. mac is
+ * HMAC-SHA256 over the header up to mac and the entries, under a
+ * snapshot key the module derives from its pqc_key, so any host loaded
+ * with the same pqc_key can check it.
+ * TCP_IOC_CACHE_IMPORT verifies a snapshot and stores its entries in
+ * every cache shard; it is refused when the snapshot was taken at a
+ * different security level, with other verdict stages disabled, or
+ * without the attestation features this host applies. Both need
+ * CAP_SYS_ADMIN and a pqc_key.
+ */
+#define TCP_SNAPSHOT_MAGIC      0x53504354  /* "TCPS" */
+#define TCP_SNAPSHOT_VERSION    3   /* 3: verdicts exclude policy stages */
+#define TCP_SNAPSHOT_MAX_ENTRIES 65536
+
+struct tcp_snapshot_header {
+    __u32 magic;
+    __u16 version;
+    __u8  security_level;       /* Level the results were computed at */
+    __u8  disabled_stages;      /* TCP_STAGES_VERDICT bits off at export */
+    __u32 hardware_features;    /* Features of the exporting host */
+    __u32 count;                /* Entries following the header */
+    __u64 created_ns;           /* Export time, CLOCK_REALTIME */
+    __u8  mac[32];
+};
+
+struct tcp_snapshot_entry {
+    __u64 descriptor_hash;      /* Truncated SHA256 of the descriptor */
+    __s32 result;               /* As tcp_validate_descriptor_kernel() */
+    __u32 age_ms;               /* Time in the cache when exported */
+};
+
+struct tcp_snapshot_xfer {
+    __u64 buf;                  /* User pointer to the snapshot */
+    __u32 len;                  /* In: buffer or snapshot size; out: snapshot size */
+    __u32 count;                /* Out: entries exported or imported */
+    __u32 max_age_ms;           /* Export: newest results only (0 = all) */
+    __u32 reserved;             /* Must be zero */
+};
+
+#define TCP_IOC_CACHE_EXPORT    _IOWR(TCP_SECURITY_IOC_MAGIC, 4, struct tcp_snapshot_xfer)
+#define TCP_IOC_CACHE_IMPORT    _IOWR(TCP_SECURITY_IOC_MAGIC, 5, struct tcp_snapshot_xfer)
+
+/*
+ * Fleet pack key
+ *
+ * TCP_IOC_FLEET_KEY returns the key fleet daemons MAC descriptor packs
+ * under. Like the snapshot key it is derived from pqc_key under its own
+ * label, so it reveals neither pqc_key nor the snapshot key. Needs
+ * CAP_SYS_ADMIN and a pqc_key.
+ */
+struct tcp_fleet_key {
+    __u8  key[32];
+};
+
+#define TCP_IOC_FLEET_KEY       _IOR(TCP_SECURITY_IOC_MAGIC, 6, struct tcp_fleet_key)
+
+/*
+ * Raw statistics
+ *
+ * Reading TCP_RAW_STATS_PROC returns one struct tcp_security_raw: the
+ * counters of /proc/tcp_security and /proc/tcp_security_stages summed
+ * over all CPUs without stopping validators. A read at offset 0 takes a
+ * new snapshot and reads further into the file continue it, so
+ * pread(fd, buf, size, 0) on a file held open is the cheapest scrape.
+ * Every counter is exact as of its own read; a validation in flight may
+ * show in some counters and not yet in others. New fields are only ever
+ * appended; check size before reading past the fields you know.
+ */
+#define TCP_RAW_STATS_PROC      "/proc/tcp_security_raw"
+#define TCP_RAW_MAGIC           0x52504354  /* "TCPR" */
+#define TCP_RAW_VERSION         1
+
+struct tcp_security_raw {
+    __u32 magic;                /* TCP_RAW_MAGIC */
+    __u16 version;              /* TCP_RAW_VERSION */
+    __u16 size;                 /* sizeof(struct tcp_security_raw) */
+    __u32 hardware_features;
+    __u8  security_level;
+    __u8  stages;               /* Enabled stages, (1 << TCP_STAGE_*) */
+    __u16 reserved;
+    __u64 snapshot_ns;          /* ktime_get_ns() when taken */
+    __u64 validation_count;     /* Counters as in /proc/tcp_security */
+    __u64 cache_hits;
+    __u64 cache_bypasses;
+    __u64 security_violations;
+    __u64 total_time_ns;
+    __u64 attest_queued;
+    __u64 attest_inline;
+    __u64 attest_batches;
+    __u64 attest_completed;
+    __u64 pqc_verified;
+    __u64 pqc_cached;
+    __u64 pqc_rejected;
+    __u32 attest_pending;       /* Attestations waiting for the worker */
+    __u32 reserved2;
+    __u64 stage_runs[TCP_NR_STAGES];    /* As in /proc/tcp_security_stages */
+    __u64 stage_cycles[TCP_NR_STAGES];
+};
+
+#ifdef __KERNEL__
+/* Exported to other kernel modules */
+int tcp_validate_descriptor_kernel(const void *descriptor, size_t len);
+int tcp_validate_descriptors_batch(const void *descriptors, size_t len,
+                                   unsigned int count,
+                                   unsigned long *result_bitmap);
+#endif
+
+#endif /* _TCP_SECURITY_IOCTL_H */
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+"""
+TCP Kernel Syscall Overhead Benchmark Driver
+
+Runs tcp_syscall_bench with the tcp_kernel module unloaded, loaded but
+disabled (enabled=0, no probe attached) and enabled at every security
+level, on 1..N pinned threads. Writes one JSON document with ns/op,
+overhead against the unloaded run and scaling efficiency for every
+(state, workload, threads) point. The same document serves as a
+regression baseline: --baseline compares a fresh run against a saved
+one, and run_benchmark.py --kernel-results uses compare_results().
+
+Scaling efficiency is ns/op on one thread divided by ns/op per thread
+on N threads: 1.0 means the hook adds no cross-CPU contention.
+"""
+
+import argparse
+import datetime
+import json
+import os
+import platform
+import subprocess
+import sys
+import time
+from pathlib import Path
+from typing import Any, Dict, List, Optional
+
+SCHEMA = "tcp-kernel-bench/1"
+
+HERE = Path(__file__).resolve().parent
+DEFAULT_BENCH = HERE / "tcp_syscall_bench"
+DEFAULT_MODULE = HERE.parent / "tcp_kernel.ko"
+
+MODULE_NAME = "tcp_kernel"
+PARAM_DIR = Path("/sys/module") / MODULE_NAME / "parameters"
+PROC_STATUS = Path("/proc/tcp_kernel")
+
+WORKLOADS = ("getpid", "unlink", "execve")
+LEVELS = (0, 1, 2, 3)
+DEFAULT_ITERATIONS = 1000000
+DEFAULT_MAX_REGRESSION_PCT = 10.0
+
+
+def thread_counts(max_threads: int) -> List[int]:
+    """Powers of two up to max_threads, plus max_threads itself"""
+    counts = []
+    n = 1
+    while n < max_threads:
+        counts.append(n)
+        n *= 2
+    counts.append(max_threads)
+    return counts
+
+
+def module_loaded() -> bool:
+    return (Path("/sys/module") / MODULE_NAME).exists()
+
+
+def set_param(name: str, value: Any) -> None:
+    (PARAM_DIR / name).write_text(f"{value}\n")
+
+
+def attach_backend() -> Optional[str]:
+    """Backend named in /proc/tcp_kernel, None when nothing is attached"""
+    for line in PROC_STATUS.read_text().splitlines():
+        if line.startswith("Attach Backend:"):
+            backend = line.split(":", 1)[1].split()[0]
+            return None if backend == "none" else backend
+    return None
+
+
+def run_bench(bench: Path, threads: int, iterations: int, workloads: List[str]) -> Dict[str, Any]:
+    out = subprocess.run(
+        [str(bench), "-i", str(iterations), "-t", str(threads), "-w", ",".join(workloads)],
+        check=True, capture_output=True, text=True,
+    ).stdout
+    return json.loads(out)["workloads"]
+
+
+def measure_state(state: str, bench: Path, threads: List[int], iterations: int,
+                  workloads: List[str]) -> List[Dict[str, Any]]:
+    runs = []
+    single: Dict[str, float] = {}
+    for n in threads:
+        results = run_bench(bench, n, iterations, workloads)
+        for workload, result in results.items():
+            ns = result["ns_per_op"]
+            if n == threads[0]:
+                single[workload] = ns
+            runs.append({
+                "state": state,
+                "workload": workload,
+                "threads": n,
+                "ns_per_op": ns,
+                "per_thread": result["per_thread"],
+                "scaling_efficiency": round(single[workload] / ns, 3) if ns else None,
+            })
+        print(f"  {state:<10} {n:>3} threads  " +
+              "  ".join(f"{w} {r['ns_per_op']:8.1f} ns" for w, r in results.items()),
+              file=sys.stderr)
+    return runs
+
+
+def add_overhead(runs: List[Dict[str, Any]]) -> None:
+    """Overhead of every point against the unloaded run at the same width"""
+    base = {(r["workload"], r["threads"]): r["ns_per_op"]
+            for r in runs if r["state"] == "unloaded"}
+    for r in runs:
+        ref = base.get((r["workload"], r["threads"]))
+        r["overhead_ns"] = round(r["ns_per_op"] - ref, 2) if ref is not None else None
+
+
+def run_suite(args: argparse.Namespace) -> Dict[str, Any]:
+    workloads = [w for w in args.workloads.split(",") if w]
+    threads = thread_counts(args.max_threads)
+    runs: List[Dict[str, Any]] = []
+    backend = None
+
+    print(f"Benchmarking {','.join(workloads)} on {threads} threads, "
+          f"{args.iterations} iterations", file=sys.stderr)
+
+    runs += measure_state("unloaded", args.bench, threads, args.iterations, workloads)
+
+    insmod = ["insmod", str(args.module), "enabled=0"]
+    if args.attach:
+        insmod.append(f"attach={args.attach}")
+    subprocess.run(insmod, check=True)
+    try:
+        runs += measure_state("disabled", args.bench, threads, args.iterations, workloads)
+
+        set_param("enabled", 1)
+        backend = attach_backend()
+        for level in args.levels:
+            set_param("security_level", level)
+            time.sleep(0.1)
+            runs += measure_state(f"level{level}", args.bench, threads,
+                                  args.iterations, workloads)
+    finally:
+        subprocess.run(["rmmod", MODULE_NAME], check=False)
+
+    add_overhead(runs)
+    return {
+        "schema": SCHEMA,
+        "timestamp": datetime.datetime.now(datetime.timezone.utc).isoformat(),
+        "kernel": platform.release(),
+        "machine": platform.machine(),
+        "cpus": os.cpu_count(),
+        "iterations": args.iterations,
+        "attach": backend,
+        "runs": runs,
+    }
+
+
+def load_results(path: str) -> Dict[str, Any]:
+    data = json.loads(Path(path).read_text())
+    if data.get("schema") != SCHEMA:
+        raise ValueError(f"{path} is not a {SCHEMA} result file")
+    return data
+
+
+def compare_results(current: Dict[str, Any], baseline: Dict[str, Any],
+                    max_regression_pct: float = DEFAULT_MAX_REGRESSION_PCT) -> List[str]:
+    """Points whose ns/op grew by more than max_regression_pct over the baseline"""
+    base = {(r["state"], r["workload"], r["threads"]): r for r in baseline["runs"]}
+    regressions = []
+    for r in current["runs"]:
+        ref = base.get((r["state"], r["workload"], r["threads"]))
+        if not ref or not ref["ns_per_op"]:
+            continue
+        change = (r["ns_per_op"] - ref["ns_per_op"]) / ref["ns_per_op"] * 100
+        if change > max_regression_pct:
+            regressions.append(
+                f"{r['state']} {r['workload']} x{r['threads']}: "
+                f"{ref['ns_per_op']:.1f} -> {r['ns_per_op']:.1f} ns/op ({change:+.1f}%)")
+    return regressions
+
+
+def report_comparison(current: Dict[str, Any], baseline_path: str,
+                      max_regression_pct: float) -> int:
+    regressions = compare_results(current, load_results(baseline_path), max_regression_pct)
+    if regressions:
+        print(f"Regressions over {max_regression_pct:.0f}% against {baseline_path}:",
+              file=sys.stderr)
+        for line in regressions:
+            print(f"  {line}", file=sys.stderr)
+        return 2
+    print(f"No regressions over {max_regression_pct:.0f}% against {baseline_path}",
+          file=sys.stderr)
+    return 0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Measure tcp_kernel per-syscall overhead")
+    parser.add_argument("--bench", type=Path, default=DEFAULT_BENCH, help="tcp_syscall_bench binary")
+    parser.add_argument("--module", type=Path, default=DEFAULT_MODULE, help="tcp_kernel.ko")
+    parser.add_argument("--attach", help="attach backend to load the module with")
+    parser.add_argument("--iterations", "-i", type=int, default=DEFAULT_ITERATIONS)
+    parser.add_argument("--max-threads", "-t", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("--workloads", "-w", default=",".join(WORKLOADS))
+    parser.add_argument("--levels", type=lambda s: [int(x) for x in s.split(",")],
+                        default=list(LEVELS), help="security levels to measure")
+    parser.add_argument("--output", "-o", help="write results JSON here (default stdout)")
+    parser.add_argument("--baseline", "-b", help="results JSON to compare against")
+    parser.add_argument("--compare", metavar="RESULTS",
+                        help="compare an existing results file instead of running")
+    parser.add_argument("--max-regression", type=float, default=DEFAULT_MAX_REGRESSION_PCT,
+                        help="allowed ns/op growth in percent")
+    args = parser.parse_args()
+
+    try:
+        if args.compare:
+            if not args.baseline:
+                parser.error("--compare needs --baseline")
+            return report_comparison(load_results(args.compare), args.baseline,
+                                     args.max_regression)
+
+        if os.geteuid() != 0:
+            print("ERROR: Benchmarking requires root privileges", file=sys.stderr)
+            return 1
+        for f in (args.bench, args.module):
+            if not f.exists():
+                print(f"ERROR: {f} not found (run 'make bench' in kernel/)", file=sys.stderr)
+                return 1
+        if module_loaded():
+            print(f"ERROR: {MODULE_NAME} is already loaded, unload it first", file=sys.stderr)
+            return 1
+
+        results = run_suite(args)
+    except (OSError, ValueError, subprocess.CalledProcessError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+    text = json.dumps(results, indent=2)
+    if args.output:
+        Path(args.output).write_text(text + "\n")
+        print(f"Wrote {args.output}", file=sys.stderr)
+    else:
+        print(text)
+
+    if args.baseline:
+        return report_comparison(results, args.baseline, args.max_regression)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,230 @@
+/*
+ * TCP Kernel Integration - per-syscall hook overhead benchmark
+ *
+ * Runs tight loops of one syscall on 1..N threads, each pinned to its own
+ * CPU and released together, and prints one JSON object with the mean
+ * ns/op per thread. Workloads:
+ *
+ *   getpid  safe syscall, the monitor's fast path
+ *   unlink  monitored syscall (missing file), full analysis
+ *   execve  monitored syscall (missing file), full analysis at syscall
+ *           entry; fails before bprm_check_security, so the lsm backend
+ *           does not see it
+ *
+ * run_kernel_bench.py drives it across module states.
+ *
+ * Author: TCP Research Team
+ * License: GPL v2
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define DEFAULT_ITERATIONS 1000000
+#define MISSING_PATH "/nonexistent/tcp_syscall_bench"
+
+struct bench_thread {
+    pthread_t thread;
+    int cpu;
+    long iterations;
+    void (*op)(void);
+    double ns_per_op;
+};
+
+static pthread_barrier_t start_barrier;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void op_getpid(void)
+{
+    syscall(SYS_getpid);
+}
+
+static void op_unlink(void)
+{
+    syscall(SYS_unlink, MISSING_PATH);
+}
+
+static void op_execve(void)
+{
+    static char *const argv[] = { MISSING_PATH, NULL };
+
+    syscall(SYS_execve, MISSING_PATH, argv, NULL);
+}
+
+static const struct {
+    const char *name;
+    void (*op)(void);
+} workloads[] = {
+    { "getpid", op_getpid },
+    { "unlink", op_unlink },
+    { "execve", op_execve },
+};
+
+#define NR_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static void *bench_thread_fn(void *arg)
+{
+    struct bench_thread *t = arg;
+    cpu_set_t set;
+    double start;
+    long i;
+
+    CPU_ZERO(&set);
+    CPU_SET(t->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+        fprintf(stderr, "warning: could not pin to CPU %d\n", t->cpu);
+    }
+
+    /* Warm caches and the branch predictors before measuring */
+    for (i = 0; i < t->iterations / 10 + 1; i++) {
+        t->op();
+    }
+
+    pthread_barrier_wait(&start_barrier);
+
+    start = now_ns();
+    for (i = 0; i < t->iterations; i++) {
+        t->op();
+    }
+    t->ns_per_op = (now_ns() - start) / t->iterations;
+
+    return NULL;
+}
+
+/* CPUs this process may run on, in order */
+static int usable_cpus(int *cpus, int max)
+{
+    cpu_set_t set;
+    int cpu, n = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set)) {
+        return 0;
+    }
+
+    for (cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus[n++] = cpu;
+        }
+    }
+    return n;
+}
+
+static int run_workload(unsigned int w, int first, int nthreads, long iterations,
+                        const int *cpus, int ncpus)
+{
+    struct bench_thread *threads;
+    double sum = 0;
+    int i, ret;
+
+    threads = calloc(nthreads, sizeof(*threads));
+    if (!threads) {
+        return -ENOMEM;
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, nthreads);
+
+    for (i = 0; i < nthreads; i++) {
+        threads[i].cpu = cpus[i % ncpus];
+        threads[i].iterations = iterations;
+        threads[i].op = workloads[w].op;
+        ret = pthread_create(&threads[i].thread, NULL, bench_thread_fn, &threads[i]);
+        if (ret) {
+            fprintf(stderr, "error: pthread_create: %s\n", strerror(ret));
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        sum += threads[i].ns_per_op;
+    }
+
+    pthread_barrier_destroy(&start_barrier);
+
+    printf("%s\"%s\": {\"ns_per_op\": %.2f, \"per_thread\": [",
+           first ? "" : ", ", workloads[w].name, sum / nthreads);
+    for (i = 0; i < nthreads; i++) {
+        printf("%s%.2f", i ? ", " : "", threads[i].ns_per_op);
+    }
+    printf("]}");
+
+    free(threads);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-i iterations] [-t threads] [-w getpid,unlink,execve]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = DEFAULT_ITERATIONS;
+    const char *selected = "getpid,unlink,execve";
+    int cpus[CPU_SETSIZE];
+    int nthreads = 1;
+    int ncpus, opt;
+    unsigned int w;
+    int first = 1;
+
+    while ((opt = getopt(argc, argv, "i:t:w:")) != -1) {
+        switch (opt) {
+        case 'i':
+            iterations = atol(optarg);
+            break;
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        case 'w':
+            selected = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (iterations <= 0 || nthreads <= 0) {
+        usage(argv[0]);
+    }
+
+    ncpus = usable_cpus(cpus, CPU_SETSIZE);
+    if (ncpus <= 0) {
+        fprintf(stderr, "error: no usable CPUs\n");
+        return 1;
+    }
+
+    printf("{\"threads\": %d, \"iterations\": %ld, \"cpus\": %d, \"workloads\": {",
+           nthreads, iterations, ncpus);
+    for (w = 0; w < NR_WORKLOADS; w++) {
+        const char *hit = strstr(selected, workloads[w].name);
+        size_t len = strlen(workloads[w].name);
+
+        if (!hit || (hit != selected && hit[-1] != ',') ||
+            (hit[len] != '\0' && hit[len] != ',')) {
+            continue;
+        }
+        if (run_workload(w, first, nthreads, iterations, cpus, ncpus) < 0) {
+            return 1;
+        }
+        first = 0;
+    }
+    printf("}}\n");
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# Side-by-side syscall overhead: no monitoring, the tcp_kernel module on
+# its kprobe backend, and the BPF policy engine on the sys_enter
+# tracepoint. Both monitored runs use the same descriptor pack.
+#
+# Usage: sudo ./bench.sh [iterations]
+
+set -e
+
+cd "$(dirname "$0")"
+
+ITERATIONS=${1:-1000000}
+MODULE=../tcp_kernel.ko
+PACK=../tcp_descriptors.pack
+
+if [ "$(id -u)" != "0" ]; then
+    echo "ERROR: Benchmarking requires root privileges"
+    exit 1
+fi
+
+for f in "$MODULE" "$PACK" ./tcp_policy_loader ./tcp_policy_bench; do
+    if [ ! -f "$f" ]; then
+        echo "ERROR: $f not found (run 'make' here and 'make module pack' in ..)"
+        exit 1
+    fi
+done
+
+if lsmod | grep -q "^tcp_kernel"; then
+    echo "ERROR: tcp_kernel is already loaded, unload it first"
+    exit 1
+fi
+
+echo "TCP policy benchmark ($ITERATIONS iterations per syscall)"
+echo "=========================================================="
+
+./tcp_policy_bench "$ITERATIONS" baseline
+
+insmod "$MODULE" attach=kprobe descriptor_pack=
+python3 ../tcp_descriptor_tool.py load "$PACK" > /dev/null
+./tcp_policy_bench "$ITERATIONS" kprobe
+rmmod tcp_kernel
+
+./tcp_policy_loader run "$PACK" > /dev/null &
+LOADER=$!
+trap 'kill $LOADER 2>/dev/null || true' EXIT
+sleep 1
+./tcp_policy_bench "$ITERATIONS" bpf
+kill -INT $LOADER
+wait $LOADER || true
@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * TCP Kernel Integration - eBPF policy engine
+ *
+ * The tcp_analyze_syscall() decision tree as a JIT-compiled BPF program.
+ * The descriptor table lives in an array map indexed by syscall number,
+ * reached through a one-slot map-in-map so the loader can publish a
+ * complete new table with a single update, the same way the module
+ * swaps its RCU-protected database. Security level and enable state are
+ * in a config map; policy changes never reload anything.
+ *
+ * Two attach modes share the decision code: the raw sys_enter
+ * tracepoint observes every syscall like the module's tracepoint
+ * backend, and BPF-LSM programs on the exec/unlink/module hooks enforce
+ * denials like its lsm backend. Either can add an fmod_ret program on
+ * the module's tcp_engine_bpf_check(), which answers the eBPF stage of
+ * layered modules such as tcp_security with the same decision.
+ *
+ * Author: TCP Research Team
+ * License: GPL v2
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+
+#include "tcp_policy.h"
+
+#define EPERM 1
+
+char LICENSE[] SEC("license") = "GPL";
+
+struct tcp_desc_array {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, TCP_BPF_MAX_SYSCALLS);
+    __type(key, __u32);
+    __type(value, struct tcp_pack_entry);
+} tcp_db_initial SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY_OF_MAPS);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __array(values, struct tcp_desc_array);
+} tcp_db SEC(".maps") = {
+    .values = { [0] = &tcp_db_initial },
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct tcp_bpf_config);
+} tcp_config SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct tcp_bpf_stats);
+} tcp_stats SEC(".maps");
+
+/* Records are struct tcp_event_record, as in the module's relay ring */
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} tcp_events SEC(".maps");
+
+/* Syscall each LSM hook stands for, filled in by the loader */
+const volatile __s32 tcp_hook_syscalls[TCP_BPF_NR_HOOKS];
+
+extern const struct nsproxy init_nsproxy __ksym;
+
+static __always_inline void tcp_emit_event(struct tcp_bpf_stats *stats,
+                                           __u8 type, __u8 verdict,
+                                           __s32 syscall_nr,
+                                           const struct tcp_pack_entry *desc)
+{
+    struct tcp_event_record *rec;
+
+    rec = bpf_ringbuf_reserve(&tcp_events, sizeof(*rec), 0);
+    if (!rec) {
+        stats->events_dropped++;
+        return;
+    }
+
+    rec->timestamp_ns = bpf_ktime_get_ns();
+    rec->pid = (__u32)bpf_get_current_pid_tgid();
+    rec->uid = (__u32)bpf_get_current_uid_gid();
+    rec->syscall_nr = syscall_nr;
+    rec->security_flags = desc->security_flags;
+    rec->type = type;
+    rec->verdict = verdict;
+    bpf_get_current_comm(rec->comm, sizeof(rec->comm));
+    bpf_ringbuf_submit(rec, 0);
+}
+
+/* Same decisions, counters and events as tcp_analyze_descriptor() */
+static __always_inline int tcp_decide(const struct tcp_bpf_config *config,
+                                      struct tcp_bpf_stats *stats,
+                                      __s32 syscall_nr,
+                                      const struct tcp_pack_entry *desc)
+{
+    struct task_struct *task;
+    __u8 context;
+    __u32 uid;
+
+    stats->total_checks++;
+    if (!desc || (desc->security_flags & TCP_FLAG_SAFE)) {
+        stats->fast_path_hits++;
+        return 0;
+    }
+
+    uid = (__u32)bpf_get_current_uid_gid();
+    context = uid == 0 ? TCP_CTX_ADMIN : TCP_CTX_USER;
+    task = bpf_get_current_task_btf();
+    if ((const void *)task->nsproxy != (const void *)&init_nsproxy) {
+        context |= TCP_CTX_CONTAINER;
+    }
+
+    if (!(desc->context_mask & context)) {
+        tcp_emit_event(stats, TCP_EVENT_CONTEXT_DENIED, TCP_VERDICT_BLOCKED,
+                       syscall_nr, desc);
+        stats->blocked_operations++;
+        return -EPERM;
+    }
+
+    if (desc->security_flags & TCP_FLAG_CRITICAL) {
+        stats->security_events++;
+
+        if (config->security_level >= 2 && uid != 0) {
+            tcp_emit_event(stats, TCP_EVENT_CRITICAL, TCP_VERDICT_BLOCKED,
+                           syscall_nr, desc);
+            stats->blocked_operations++;
+            return -EPERM;
+        }
+
+        tcp_emit_event(stats, TCP_EVENT_CRITICAL, TCP_VERDICT_ALLOWED,
+                       syscall_nr, desc);
+    }
+
+    if (desc->security_flags & TCP_FLAG_DESTRUCTIVE) {
+        tcp_emit_event(stats, TCP_EVENT_DESTRUCTIVE, TCP_VERDICT_ALLOWED,
+                       syscall_nr, desc);
+        stats->security_events++;
+    }
+
+    return 0;
+}
+
+/* Decision for a syscall, its descriptor looked up in the live table */
+static __always_inline int tcp_analyze(__s32 syscall_nr)
+{
+    const struct tcp_pack_entry *desc;
+    struct tcp_bpf_config *config;
+    struct tcp_bpf_stats *stats;
+    __u32 key = 0;
+    void *descriptors;
+
+    config = bpf_map_lookup_elem(&tcp_config, &key);
+    stats = bpf_map_lookup_elem(&tcp_stats, &key);
+    if (!config || !stats || !config->enabled) {
+        return 0;
+    }
+
+    descriptors = bpf_map_lookup_elem(&tcp_db, &key);
+    if (!descriptors) {
+        return 0;
+    }
+
+    /* Out-of-range syscalls miss the array and count as safe */
+    key = syscall_nr;
+    desc = bpf_map_lookup_elem(descriptors, &key);
+    return tcp_decide(config, stats, syscall_nr, desc);
+}
+
+/* Observe mode: every syscall, verdicts are only counted */
+SEC("tp_btf/sys_enter")
+int BPF_PROG(tcp_sys_enter, struct pt_regs *regs, long id)
+{
+    tcp_analyze(id);
+    return 0;
+}
+
+/* Enforce mode: a denial fails the hooked operation */
+SEC("lsm/bprm_check_security")
+int BPF_PROG(tcp_lsm_bprm_check, struct linux_binprm *bprm, int ret)
+{
+    if (ret) {
+        return ret;
+    }
+    return tcp_analyze(tcp_hook_syscalls[TCP_BPF_HOOK_EXEC]);
+}
+
+SEC("lsm/inode_unlink")
+int BPF_PROG(tcp_lsm_inode_unlink, struct inode *dir, struct dentry *dentry, int ret)
+{
+    if (ret) {
+        return ret;
+    }
+    return tcp_analyze(tcp_hook_syscalls[TCP_BPF_HOOK_UNLINK]);
+}
+
+SEC("lsm/kernel_module_request")
+int BPF_PROG(tcp_lsm_module_request, char *kmod_name, int ret)
+{
+    if (ret) {
+        return ret;
+    }
+    return tcp_analyze(tcp_hook_syscalls[TCP_BPF_HOOK_MODULE_REQUEST]);
+}
+
+SEC("lsm/kernel_load_data")
+int BPF_PROG(tcp_lsm_load_data, enum kernel_load_data_id id, bool contents, int ret)
+{
+    if (ret || id != LOADING_MODULE) {
+        return ret;
+    }
+    return tcp_analyze(tcp_hook_syscalls[TCP_BPF_HOOK_MODULE_LOAD]);
+}
+
+SEC("lsm/kernel_read_file")
+int BPF_PROG(tcp_lsm_read_file, struct file *file, enum kernel_read_file_id id,
+             bool contents, int ret)
+{
+    if (ret || id != READING_MODULE) {
+        return ret;
+    }
+    return tcp_analyze(tcp_hook_syscalls[TCP_BPF_HOOK_MODULE_LOAD]);
+}
+
+/*
+ * Engine entry: the module's tcp_engine_bpf_check() returns this
+ * program's decision for the layered module's descriptor, which stands
+ * for no syscall and is judged as given rather than looked up.
+ */
+SEC("fmod_ret/tcp_engine_bpf_check")
+int BPF_PROG(tcp_engine_check, const struct tcp_pack_entry *desc, int ret)
+{
+    struct tcp_bpf_config *config;
+    struct tcp_bpf_stats *stats;
+    struct tcp_pack_entry entry;
+    __u32 key = 0;
+
+    if (ret) {
+        return ret;
+    }
+
+    config = bpf_map_lookup_elem(&tcp_config, &key);
+    stats = bpf_map_lookup_elem(&tcp_stats, &key);
+    if (!config || !stats || !config->enabled) {
+        return 0;
+    }
+
+    if (bpf_probe_read_kernel(&entry, sizeof(entry), desc)) {
+        return 0;
+    }
+    return tcp_decide(config, stats, entry.syscall_nr, &entry);
+}
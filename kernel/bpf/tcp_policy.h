@@ -0,0 +1,47 @@
+/*
+ * TCP Kernel Integration - eBPF policy engine ABI
+ *
+ * Map layouts shared by tcp_policy.bpf.c and tcp_policy_loader.c.
+ * Descriptor entries are struct tcp_pack_entry, exactly as stored in a
+ * descriptor pack, so packs load into the maps without translation.
+ *
+ * Author: TCP Research Team
+ * License: GPL v2
+ */
+
+#ifndef _TCP_POLICY_H
+#define _TCP_POLICY_H
+
+#include "../tcp_kernel_uapi.h"
+
+/* Slots in each descriptor array, indexed by syscall number */
+#define TCP_BPF_MAX_SYSCALLS    512
+
+/* Maps are pinned here while tcp_policy_loader runs */
+#define TCP_BPF_PIN_DIR         "/sys/fs/bpf/tcp_policy"
+
+/* LSM hooks, each standing for one syscall descriptor */
+enum tcp_bpf_hook {
+    TCP_BPF_HOOK_EXEC,           /* bprm_check_security */
+    TCP_BPF_HOOK_UNLINK,         /* inode_unlink */
+    TCP_BPF_HOOK_MODULE_REQUEST, /* kernel_module_request */
+    TCP_BPF_HOOK_MODULE_LOAD,    /* kernel_load_data, kernel_read_file */
+    TCP_BPF_NR_HOOKS
+};
+
+/* tcp_config[0] */
+struct tcp_bpf_config {
+    __u32 enabled;
+    __u32 security_level;
+};
+
+/* tcp_stats[0], per CPU */
+struct tcp_bpf_stats {
+    __u64 total_checks;
+    __u64 fast_path_hits;
+    __u64 blocked_operations;
+    __u64 security_events;
+    __u64 events_dropped;
+};
+
+#endif /* _TCP_POLICY_H */
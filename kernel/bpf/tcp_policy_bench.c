@@ -0,0 +1,68 @@
+/*
+ * TCP Kernel Integration - syscall overhead microbenchmark
+ *
+ * Times tight loops of a safe syscall (getpid, fast path) and a
+ * monitored one (unlink of a missing file, full analysis) and prints
+ * nanoseconds per call. bench.sh runs it with no monitoring, with the
+ * module's kprobe backend and with the BPF policy engine.
+ *
+ * Author: TCP Research Team
+ * License: GPL v2
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define DEFAULT_ITERATIONS 1000000
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double bench_getpid(long iterations)
+{
+    double start = now_ns();
+    long i;
+
+    for (i = 0; i < iterations; i++) {
+        syscall(SYS_getpid);
+    }
+    return (now_ns() - start) / iterations;
+}
+
+static double bench_unlink(long iterations)
+{
+    double start = now_ns();
+    long i;
+
+    for (i = 0; i < iterations; i++) {
+        syscall(SYS_unlink, "/nonexistent/tcp_policy_bench");
+    }
+    return (now_ns() - start) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    const char *label = argc > 2 ? argv[2] : "run";
+
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations] [label]\n", argv[0]);
+        return 1;
+    }
+
+    /* Warm caches and the branch predictors before measuring */
+    bench_getpid(iterations / 10 + 1);
+    bench_unlink(iterations / 10 + 1);
+
+    printf("%-12s getpid %8.1f ns/op   unlink %8.1f ns/op\n",
+           label, bench_getpid(iterations), bench_unlink(iterations));
+    return 0;
+}
@@ -0,0 +1,425 @@
+/*
+ * TCP Kernel Integration - eBPF policy engine loader
+ *
+ * Loads tcp_policy.bpf.c, fills its descriptor map from a descriptor
+ * pack and attaches it, then stays resident (optionally printing
+ * security events) until interrupted. While it runs the maps are pinned
+ * under TCP_BPF_PIN_DIR, and the update/level/enable/stats commands
+ * change or read the live policy through them without reloading
+ * anything. --engine also answers tcp_kernel's tcp_engine_bpf_check()
+ * for layered modules, so the module must be loaded.
+ *
+ *   tcp_policy_loader run [--lsm] [--engine] [--level N] [--events] PACK
+ *   tcp_policy_loader update PACK
+ *   tcp_policy_loader level N
+ *   tcp_policy_loader enable|disable
+ *   tcp_policy_loader stats
+ *
+ * Author: TCP Research Team
+ * License: GPL v2
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "tcp_policy.h"
+#include "tcp_policy.skel.h"
+
+#define TCP_PACK_MAX_SIZE (64 * 1024)
+
+#define PIN_DB      TCP_BPF_PIN_DIR "/tcp_db"
+#define PIN_CONFIG  TCP_BPF_PIN_DIR "/tcp_config"
+#define PIN_STATS   TCP_BPF_PIN_DIR "/tcp_stats"
+
+/* Unmonitored slots get the same safe sentinel as the module */
+static const struct tcp_pack_entry tcp_safe_entry = {
+    .syscall_nr = -1,
+    .security_flags = TCP_FLAG_SAFE,
+    .context_mask = TCP_CTX_ALL,
+    .privilege_level = TCP_PRIV_USER,
+};
+
+static volatile sig_atomic_t exiting;
+
+static void handle_signal(int sig)
+{
+    exiting = 1;
+}
+
+/* crc32_le(0, data, len) as computed by the kernel (no inversion) */
+static __u32 tcp_crc32_le(const unsigned char *data, size_t len)
+{
+    __u32 crc = 0;
+    int bit;
+
+    while (len--) {
+        crc ^= *data++;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return crc;
+}
+
+static int section_ok(__u32 offset, size_t size, size_t len)
+{
+    return offset <= len && size <= len - offset;
+}
+
+/* Read and verify a descriptor pack; returns its hot entry array */
+static struct tcp_pack_entry *read_pack(const char *path, __u32 *count)
+{
+    static unsigned char buf[TCP_PACK_MAX_SIZE + 1];
+    const struct tcp_pack_header *hdr = (const void *)buf;
+    struct tcp_pack_entry *entries;
+    size_t len;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    if (len < sizeof(*hdr) || len > TCP_PACK_MAX_SIZE ||
+        hdr->magic != TCP_PACK_MAGIC || hdr->version != TCP_PACK_VERSION ||
+        hdr->header_size != sizeof(*hdr) || hdr->total_size != len ||
+        !section_ok(hdr->entries_offset,
+                    (size_t)hdr->count * sizeof(*entries), len)) {
+        fprintf(stderr, "%s is not a valid descriptor pack\n", path);
+        return NULL;
+    }
+
+    if (tcp_crc32_le(buf + sizeof(*hdr), len - sizeof(*hdr)) != hdr->checksum) {
+        fprintf(stderr, "%s: checksum mismatch\n", path);
+        return NULL;
+    }
+
+    entries = calloc(hdr->count ? hdr->count : 1, sizeof(*entries));
+    if (!entries) {
+        return NULL;
+    }
+    memcpy(entries, buf + hdr->entries_offset, hdr->count * sizeof(*entries));
+    *count = hdr->count;
+    return entries;
+}
+
+/*
+ * Build a complete descriptor array off to the side and publish it with
+ * one update of the map-in-map slot, so programs see either the old or
+ * the new table and never a mix.
+ */
+static int publish_pack(int db_fd, const char *path)
+{
+    LIBBPF_OPTS(bpf_map_create_opts, opts);
+    struct tcp_pack_entry *entries;
+    __u32 count = 0, i, key = 0;
+    int inner_fd, ret = 0;
+
+    entries = read_pack(path, &count);
+    if (!entries) {
+        return -EINVAL;
+    }
+
+    inner_fd = bpf_map_create(BPF_MAP_TYPE_ARRAY, "tcp_db", sizeof(__u32),
+                              sizeof(struct tcp_pack_entry),
+                              TCP_BPF_MAX_SYSCALLS, &opts);
+    if (inner_fd < 0) {
+        ret = -errno;
+        goto out;
+    }
+
+    for (i = 0; i < TCP_BPF_MAX_SYSCALLS && !ret; i++) {
+        ret = bpf_map_update_elem(inner_fd, &i, &tcp_safe_entry, BPF_ANY);
+    }
+
+    for (i = 0; i < count && !ret; i++) {
+        __u32 nr = entries[i].syscall_nr;
+
+        if (nr >= TCP_BPF_MAX_SYSCALLS) {
+            fprintf(stderr, "Skipping descriptor for syscall %d\n",
+                    entries[i].syscall_nr);
+            continue;
+        }
+        ret = bpf_map_update_elem(inner_fd, &nr, &entries[i], BPF_ANY);
+    }
+
+    if (!ret) {
+        ret = bpf_map_update_elem(db_fd, &key, &inner_fd, BPF_ANY);
+    }
+    if (ret) {
+        ret = -errno;
+    } else {
+        printf("Published %u descriptors from %s\n", count, path);
+    }
+
+    close(inner_fd);
+out:
+    free(entries);
+    return ret;
+}
+
+static int set_config(int config_fd, int enabled, int level)
+{
+    struct tcp_bpf_config config;
+    __u32 key = 0;
+
+    if (bpf_map_lookup_elem(config_fd, &key, &config)) {
+        return -errno;
+    }
+    if (enabled >= 0) {
+        config.enabled = enabled;
+    }
+    if (level >= 0) {
+        config.security_level = level;
+    }
+    return bpf_map_update_elem(config_fd, &key, &config, BPF_ANY) ? -errno : 0;
+}
+
+static int print_event(void *ctx, void *data, size_t len)
+{
+    const struct tcp_event_record *rec = data;
+
+    if (len < sizeof(*rec)) {
+        return 0;
+    }
+    printf("[%llu] type=%u %s syscall=%d flags=0x%04x pid=%u uid=%u comm=%.16s\n",
+           (unsigned long long)rec->timestamp_ns, rec->type,
+           rec->verdict == TCP_VERDICT_BLOCKED ? "blocked" : "allowed",
+           rec->syscall_nr, rec->security_flags, rec->pid, rec->uid, rec->comm);
+    return 0;
+}
+
+static void disable_all_programs(struct tcp_policy_bpf *skel)
+{
+    struct bpf_program *prog;
+
+    bpf_object__for_each_program(prog, skel->obj) {
+        bpf_program__set_autoload(prog, false);
+    }
+}
+
+static int cmd_run(int argc, char **argv)
+{
+    struct tcp_bpf_config config = { .enabled = 1, .security_level = 1 };
+    struct ring_buffer *events = NULL;
+    struct tcp_policy_bpf *skel;
+    const char *pack = NULL;
+    int lsm = 0, engine = 0, show_events = 0, i, ret;
+    __u32 key = 0;
+
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--lsm") == 0) {
+            lsm = 1;
+        } else if (strcmp(argv[i], "--engine") == 0) {
+            engine = 1;
+        } else if (strcmp(argv[i], "--events") == 0) {
+            show_events = 1;
+        } else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+            config.security_level = atoi(argv[++i]);
+        } else {
+            pack = argv[i];
+        }
+    }
+    if (!pack) {
+        fprintf(stderr, "run: descriptor pack required\n");
+        return 1;
+    }
+
+    skel = tcp_policy_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+
+    skel->rodata->tcp_hook_syscalls[TCP_BPF_HOOK_EXEC] = SYS_execve;
+    skel->rodata->tcp_hook_syscalls[TCP_BPF_HOOK_UNLINK] = SYS_unlink;
+    skel->rodata->tcp_hook_syscalls[TCP_BPF_HOOK_MODULE_REQUEST] = SYS_init_module;
+    skel->rodata->tcp_hook_syscalls[TCP_BPF_HOOK_MODULE_LOAD] = SYS_init_module;
+
+    /* Load only the programs for the selected mode */
+    disable_all_programs(skel);
+    if (lsm) {
+        bpf_program__set_autoload(skel->progs.tcp_lsm_bprm_check, true);
+        bpf_program__set_autoload(skel->progs.tcp_lsm_inode_unlink, true);
+        bpf_program__set_autoload(skel->progs.tcp_lsm_module_request, true);
+        bpf_program__set_autoload(skel->progs.tcp_lsm_load_data, true);
+        bpf_program__set_autoload(skel->progs.tcp_lsm_read_file, true);
+    } else {
+        bpf_program__set_autoload(skel->progs.tcp_sys_enter, true);
+    }
+    bpf_program__set_autoload(skel->progs.tcp_engine_check, engine);
+
+    mkdir(TCP_BPF_PIN_DIR, 0700);
+    bpf_map__set_pin_path(skel->maps.tcp_db, PIN_DB);
+    bpf_map__set_pin_path(skel->maps.tcp_config, PIN_CONFIG);
+    bpf_map__set_pin_path(skel->maps.tcp_stats, PIN_STATS);
+
+    ret = tcp_policy_bpf__load(skel);
+    if (ret) {
+        fprintf(stderr, "Failed to load BPF programs: %d\n", ret);
+        goto out;
+    }
+
+    /* Policy must be in place before anything is attached */
+    ret = publish_pack(bpf_map__fd(skel->maps.tcp_db), pack);
+    if (!ret) {
+        ret = bpf_map_update_elem(bpf_map__fd(skel->maps.tcp_config), &key,
+                                  &config, BPF_ANY);
+    }
+    if (ret) {
+        fprintf(stderr, "Failed to initialize policy maps: %d\n", ret);
+        goto out;
+    }
+
+    ret = tcp_policy_bpf__attach(skel);
+    if (ret) {
+        fprintf(stderr, "Failed to attach (%s mode): %d\n",
+                lsm ? "lsm" : "tracepoint", ret);
+        goto out;
+    }
+
+    if (show_events) {
+        events = ring_buffer__new(bpf_map__fd(skel->maps.tcp_events),
+                                  print_event, NULL, NULL);
+        if (!events) {
+            ret = -errno;
+            goto out;
+        }
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    printf("TCP policy engine attached (%s mode%s, security level %u), maps in %s\n",
+           lsm ? "lsm" : "tracepoint", engine ? " and engine entry" : "",
+           config.security_level, TCP_BPF_PIN_DIR);
+    fflush(stdout);
+
+    while (!exiting) {
+        if (events) {
+            ring_buffer__poll(events, 1000);
+            fflush(stdout);
+        } else {
+            sleep(1);
+        }
+    }
+    ret = 0;
+
+out:
+    ring_buffer__free(events);
+    bpf_map__unpin(skel->maps.tcp_db, NULL);
+    bpf_map__unpin(skel->maps.tcp_config, NULL);
+    bpf_map__unpin(skel->maps.tcp_stats, NULL);
+    rmdir(TCP_BPF_PIN_DIR);
+    tcp_policy_bpf__destroy(skel);
+    return ret ? 1 : 0;
+}
+
+static int open_pinned(const char *path)
+{
+    int fd = bpf_obj_get(path);
+
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s (is tcp_policy_loader running?)\n", path);
+    }
+    return fd;
+}
+
+static int cmd_stats(void)
+{
+    struct tcp_bpf_stats *percpu, sum = { 0 };
+    int ncpus = libbpf_num_possible_cpus();
+    __u32 key = 0;
+    int fd, cpu;
+
+    fd = open_pinned(PIN_STATS);
+    if (fd < 0 || ncpus <= 0) {
+        return 1;
+    }
+
+    percpu = calloc(ncpus, sizeof(*percpu));
+    if (!percpu || bpf_map_lookup_elem(fd, &key, percpu)) {
+        free(percpu);
+        close(fd);
+        return 1;
+    }
+
+    for (cpu = 0; cpu < ncpus; cpu++) {
+        sum.total_checks += percpu[cpu].total_checks;
+        sum.fast_path_hits += percpu[cpu].fast_path_hits;
+        sum.blocked_operations += percpu[cpu].blocked_operations;
+        sum.security_events += percpu[cpu].security_events;
+        sum.events_dropped += percpu[cpu].events_dropped;
+    }
+
+    printf("Total Checks: %llu\n", (unsigned long long)sum.total_checks);
+    printf("Fast Path Hits: %llu\n", (unsigned long long)sum.fast_path_hits);
+    printf("Blocked Operations: %llu\n", (unsigned long long)sum.blocked_operations);
+    printf("Security Events: %llu\n", (unsigned long long)sum.security_events);
+    printf("Events Dropped: %llu\n", (unsigned long long)sum.events_dropped);
+
+    free(percpu);
+    close(fd);
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: tcp_policy_loader run [--lsm] [--engine] [--level N] [--events] PACK\n"
+            "       tcp_policy_loader update PACK\n"
+            "       tcp_policy_loader level N\n"
+            "       tcp_policy_loader enable|disable\n"
+            "       tcp_policy_loader stats\n");
+}
+
+int main(int argc, char **argv)
+{
+    int fd, ret;
+
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "run") == 0) {
+        return cmd_run(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "stats") == 0) {
+        return cmd_stats();
+    }
+
+    if (strcmp(argv[1], "update") == 0 && argc == 3) {
+        fd = open_pinned(PIN_DB);
+        ret = fd < 0 ? -ENOENT : publish_pack(fd, argv[2]);
+    } else if (strcmp(argv[1], "level") == 0 && argc == 3) {
+        fd = open_pinned(PIN_CONFIG);
+        ret = fd < 0 ? -ENOENT : set_config(fd, -1, atoi(argv[2]));
+    } else if (strcmp(argv[1], "enable") == 0 || strcmp(argv[1], "disable") == 0) {
+        fd = open_pinned(PIN_CONFIG);
+        ret = fd < 0 ? -ENOENT : set_config(fd, argv[1][0] == 'e', -1);
+    } else {
+        usage();
+        return 1;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (ret) {
+        fprintf(stderr, "%s failed: %s\n", argv[1], strerror(-ret));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,258 @@
+#!/usr/bin/env python3
+"""
+TCP Kernel Descriptor Tool
+
+Builds descriptor packs for the tcp_kernel module and hot-loads them
+through /proc/tcp_kernel_descriptors, replacing the live descriptor
+database without rmmod/insmod. A pack installed under /lib/firmware is
+picked up at module load through request_firmware(). A pack written to
+/proc/tcp_kernel_cgroups becomes the policy of a single cgroup. The binary layout
+is struct tcp_pack_header, the hot struct tcp_pack_entry array, the cold
+struct tcp_pack_meta array and a string table (tcp_kernel_uapi.h).
+
+Input is a JSON list of descriptors:
+
+    [{"syscall": "unlink", "flags": ["DESTRUCTIVE", "FILESYSTEM"],
+      "context": ["USER", "ADMIN"], "privilege": "USER",
+      "pattern": "file_deletion"}]
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import zlib
+from pathlib import Path
+from typing import Any, Dict, List, Union
+
+RELOAD_PATH = "/proc/tcp_kernel_descriptors"
+CGROUP_PATH = "/proc/tcp_kernel_cgroups"
+CGROUP_ROOT = "/sys/fs/cgroup"
+
+PACK_MAGIC = 0x50435402  # TCP_MAGIC_CLASSICAL
+PACK_VERSION = 1
+DB_MAX_DESCRIPTORS = 512
+PACK_MAX_SIZE = 64 * 1024
+
+HEADER = struct.Struct("<IHHIIIIIIII")  # struct tcp_pack_header
+ENTRY = struct.Struct("<iHBB")          # struct tcp_pack_entry
+META = struct.Struct("<II")             # struct tcp_pack_meta
+CGROUP_POLICY = struct.Struct("<QII")   # struct tcp_cgroup_policy
+
+FLAGS = {
+    "SAFE": 0x0001,
+    "DESTRUCTIVE": 0x0002,
+    "FILESYSTEM": 0x0004,
+    "NETWORK": 0x0008,
+    "EXECUTION": 0x0010,
+    "CRITICAL": 0x0020,
+    "KERNEL": 0x0040,
+    "PRIVESC": 0x0080,
+}
+
+CONTEXTS = {
+    "USER": 0x01,
+    "ADMIN": 0x02,
+    "KERNEL": 0x04,
+    "CONTAINER": 0x08,
+    "ALL": 0xFF,
+}
+
+PRIVILEGES = {"USER": 0, "ROOT": 1, "KERNEL": 2}
+
+# x86_64 numbers for the syscalls the default policy cares about
+X86_64_SYSCALLS = {
+    "getpid": 39,
+    "execve": 59,
+    "unlink": 87,
+    "init_module": 175,
+    "delete_module": 176,
+    "unlinkat": 263,
+    "finit_module": 313,
+    "execveat": 322,
+}
+
+
+def kernel_crc32(data: bytes) -> int:
+    """crc32_le(0, data, len) as computed by the kernel (no inversion)"""
+    return zlib.crc32(data, 0xFFFFFFFF) ^ 0xFFFFFFFF
+
+
+def _mask(value: Union[int, str, List[str]], names: Dict[str, int]) -> int:
+    if isinstance(value, int):
+        return value
+    if isinstance(value, str):
+        value = [value]
+    mask = 0
+    for name in value:
+        mask |= names[name.upper()]
+    return mask
+
+
+def _syscall_nr(value: Union[int, str]) -> int:
+    if isinstance(value, int):
+        return value
+    if value.isdigit():
+        return int(value)
+    try:
+        return X86_64_SYSCALLS[value]
+    except KeyError:
+        raise ValueError(f"Unknown syscall name '{value}', use its number") from None
+
+
+def _align(offset: int, alignment: int) -> int:
+    return (offset + alignment - 1) & ~(alignment - 1)
+
+
+def build_pack(descriptors: List[Dict[str, Any]]) -> bytes:
+    """Build a complete descriptor pack"""
+    if len(descriptors) > DB_MAX_DESCRIPTORS:
+        raise ValueError(f"At most {DB_MAX_DESCRIPTORS} descriptors are supported")
+
+    entries = bytearray()
+    meta = bytearray()
+    strtab = bytearray()
+    offsets: Dict[bytes, int] = {}
+
+    for desc in descriptors:
+        pattern = desc.get("pattern", "").encode()
+        if len(pattern) > 31 or b"\0" in pattern:
+            raise ValueError(f"Invalid pattern '{desc.get('pattern')}'")
+        if pattern not in offsets:
+            offsets[pattern] = len(strtab)
+            strtab += pattern + b"\0"
+
+        entries += ENTRY.pack(
+            _syscall_nr(desc["syscall"]),
+            _mask(desc.get("flags", []), FLAGS),
+            _mask(desc.get("context", "ALL"), CONTEXTS),
+            PRIVILEGES[desc.get("privilege", "USER").upper()],
+        )
+        meta += META.pack(offsets[pattern], desc.get("checksum", 0))
+
+    entries_offset = _align(HEADER.size, 8)
+    meta_offset = _align(entries_offset + len(entries), 4)
+    strtab_offset = meta_offset + len(meta)
+    total_size = strtab_offset + len(strtab)
+    if total_size > PACK_MAX_SIZE:
+        raise ValueError(f"Pack exceeds {PACK_MAX_SIZE} bytes")
+
+    body = bytearray(total_size - HEADER.size)
+    for offset, section in ((entries_offset, entries), (meta_offset, meta),
+                            (strtab_offset, strtab)):
+        start = offset - HEADER.size
+        body[start:start + len(section)] = section
+
+    header = HEADER.pack(PACK_MAGIC, PACK_VERSION, HEADER.size, total_size,
+                         kernel_crc32(bytes(body)), len(descriptors),
+                         entries_offset, meta_offset, strtab_offset,
+                         len(strtab), 0)
+    return header + bytes(body)
+
+
+def parse_pack(pack: bytes) -> List[Dict[str, Any]]:
+    """Decode and verify a descriptor pack"""
+    if len(pack) < HEADER.size:
+        raise ValueError("Truncated pack header")
+    (magic, version, header_size, total_size, checksum, count, entries_offset,
+     meta_offset, strtab_offset, strtab_size, _) = HEADER.unpack_from(pack)
+    if magic != PACK_MAGIC or version != PACK_VERSION or header_size != HEADER.size:
+        raise ValueError("Not a version 1 descriptor pack")
+    if total_size != len(pack):
+        raise ValueError(f"Pack size {len(pack)} does not match header ({total_size})")
+    if kernel_crc32(pack[HEADER.size:]) != checksum:
+        raise ValueError("Pack checksum mismatch")
+
+    strtab = pack[strtab_offset:strtab_offset + strtab_size]
+    descriptors = []
+    for i in range(count):
+        nr, flags, context, privilege = ENTRY.unpack_from(pack, entries_offset + i * ENTRY.size)
+        pattern_offset, desc_checksum = META.unpack_from(pack, meta_offset + i * META.size)
+        descriptors.append({
+            "syscall": nr,
+            "flags": flags,
+            "context": context,
+            "privilege": privilege,
+            "pattern": strtab[pattern_offset:].split(b"\0", 1)[0].decode(),
+            "checksum": desc_checksum,
+        })
+    return descriptors
+
+
+def load_pack(pack: bytes, path: str = RELOAD_PATH) -> None:
+    """Swap the pack into the running module in one write()"""
+    with open(path, "wb", buffering=0) as f:
+        f.write(pack)
+
+
+def cgroup_id(value: str) -> int:
+    """cgroup v2 ID from a number or a cgroup path (inode of its directory)"""
+    if value.isdigit():
+        return int(value)
+    path = value if os.path.isabs(value) else os.path.join(CGROUP_ROOT, value)
+    return os.stat(path).st_ino
+
+
+def load_cgroup_pack(cgroup: int, pack: bytes, path: str = CGROUP_PATH) -> None:
+    """Install pack as the policy of one cgroup; an empty pack clears it"""
+    with open(path, "wb", buffering=0) as f:
+        f.write(CGROUP_POLICY.pack(cgroup, len(pack), 0) + pack)
+
+
+def _read_input(path: str) -> bytes:
+    data = Path(path).read_bytes()
+    if path.endswith(".json"):
+        return build_pack(json.loads(data))
+    return data
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Build and load tcp_kernel descriptor packs")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    pack = sub.add_parser("pack", help="build a descriptor pack from JSON")
+    pack.add_argument("input", help="JSON descriptor list")
+    pack.add_argument("output", help="descriptor pack to write")
+
+    dump = sub.add_parser("dump", help="verify and print a descriptor pack")
+    dump.add_argument("input", help="descriptor pack")
+
+    load = sub.add_parser("load", help="hot-load a pack into the running module")
+    load.add_argument("input", help="descriptor pack or JSON descriptor list")
+    load.add_argument("--path", default=RELOAD_PATH, help="reload interface")
+
+    cgroup = sub.add_parser("cgroup", help="set or clear the policy of one cgroup")
+    cgroup.add_argument("cgroup", help="cgroup ID or path under /sys/fs/cgroup")
+    cgroup.add_argument("input", nargs="?",
+                        help="descriptor pack or JSON descriptor list (omit to clear)")
+    cgroup.add_argument("--path", default=CGROUP_PATH, help="cgroup policy interface")
+
+    args = parser.parse_args()
+
+    try:
+        if args.command == "pack":
+            pack_data = build_pack(json.loads(Path(args.input).read_text()))
+            Path(args.output).write_bytes(pack_data)
+            print(f"Wrote {args.output} ({len(pack_data)} bytes)")
+        elif args.command == "dump":
+            print(json.dumps(parse_pack(Path(args.input).read_bytes()), indent=4))
+        elif args.command == "cgroup":
+            cgid = cgroup_id(args.cgroup)
+            load_cgroup_pack(cgid, _read_input(args.input) if args.input else b"", args.path)
+            if args.input:
+                print(f"Loaded {args.input} as the policy of cgroup {cgid}")
+            else:
+                print(f"Cleared the policy of cgroup {cgid}")
+        else:
+            load_pack(_read_input(args.input), args.path)
+            print(f"Loaded {args.input} into {args.path}")
+    except (OSError, ValueError, KeyError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
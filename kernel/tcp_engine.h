@@ -0,0 +1,103 @@
+/*
+ * TCP Kernel Integration - Engine interface
+ *
+ * What tcp_kernel exports to modules layered on top of it, such as the
+ * tcp_security descriptor validator: the per-CPU counter, latency and
+ * /proc plumbing both use, and the policy engine behind the syscall
+ * attach backends. Layered modules build against tcp_kernel's
+ * Module.symvers and load after it.
+ *
+ * Author: TCP Research Team
+ * License: GPL v2
+ */
+
+#ifndef _TCP_ENGINE_H
+#define _TCP_ENGINE_H
+
+#include <linux/build_bug.h>
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+
+#include "tcp_kernel_uapi.h"
+
+/*
+ * Per-CPU counters
+ *
+ * A statistics block made only of u64 counters is summed over a CPU
+ * mask at read time: tcp_percpu_sum(&sum, &per_cpu_block, cpus).
+ */
+void __tcp_percpu_sum(void *sum, const void __percpu *counters, size_t size,
+                      const struct cpumask *cpus);
+
+#define tcp_percpu_sum(sum, counters, cpus) do {                        \
+        BUILD_BUG_ON(sizeof(*(sum)) % sizeof(u64));                     \
+        __tcp_percpu_sum(sum, counters, sizeof(*(sum)), cpus);          \
+    } while (0)
+
+/*
+ * Latency histograms
+ *
+ * Per-CPU log2 histograms in the layout of tcp_kernel_uapi.h, one row
+ * per enum tcp_lat_path. tcp_latency_proc_ops serves a histogram as a
+ * /proc file created with it as the entry's data: reading gives one line
+ * per path with the sample count, p50/p99/p999 in ns (bucket upper
+ * bounds) and the raw bucket counts, and any write clears it.
+ */
+struct tcp_latency_hist {
+    u64 buckets[TCP_LAT_NR_PATHS][TCP_LAT_BUCKETS];
+};
+
+static inline void tcp_latency_add(struct tcp_latency_hist __percpu *hist,
+                                   enum tcp_lat_path path, u64 delta_ns)
+{
+    unsigned int bucket = 0;
+
+    if (delta_ns > 1) {
+        bucket = min_t(unsigned int, ilog2(delta_ns), TCP_LAT_BUCKETS - 1);
+    }
+    this_cpu_inc(hist->buckets[path][bucket]);
+}
+
+extern const struct proc_ops tcp_latency_proc_ops;
+
+/*
+ * /proc files
+ *
+ * tcp_proc_files_create() creates a table of top-level /proc entries,
+ * all of them or none, and tcp_proc_files_remove() removes them again,
+ * waiting for readers and writers in flight.
+ */
+struct tcp_proc_file {
+    const char *name;
+    umode_t mode;
+    const struct proc_ops *ops;
+    void *data;                  /* pde_data() of the entry */
+};
+
+int tcp_proc_files_create(const struct tcp_proc_file *files, unsigned int count);
+void tcp_proc_files_remove(const struct tcp_proc_file *files, unsigned int count);
+
+/*
+ * Policy engine
+ *
+ * tcp_engine_check() makes the decision the attach backends make for a
+ * monitored syscall, for desc and the current task, whether or not
+ * syscall monitoring is armed: the context mask, paranoid-mode blocking
+ * of critical operations, counters and events. The per-task decision
+ * cache is not used, so desc only has to live for the call. Descriptors
+ * that stand for no syscall have syscall_nr -1, which is what their
+ * events carry. Returns -EPERM to deny.
+ */
+int tcp_engine_check(const struct tcp_pack_entry *desc);
+
+/*
+ * tcp_engine_bpf_check() is the eBPF engine's entry for the same
+ * question: a BPF program attached to it with fmod_ret decides, and with
+ * none attached it allows. Returns a negative errno to deny.
+ */
+int tcp_engine_bpf_check(const struct tcp_pack_entry *desc);
+
+#endif /* _TCP_ENGINE_H */
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""
+TCP Kernel Event Reader
+
+Drains the tcp_kernel security event ring from debugfs in batches and
+prints one line (or one JSON object) per event. Records are the fixed-size
+struct tcp_event_record defined in tcp_kernel_uapi.h.
+"""
+
+import argparse
+import glob
+import json
+import os
+import select
+import struct
+import sys
+from dataclasses import asdict, dataclass
+from typing import Iterator, List
+
+EVENT_DIR = "/sys/kernel/debug/tcp_kernel"
+
+# struct tcp_event_record (tcp_kernel_uapi.h)
+RECORD_FORMAT = "<QIIiHBB16s"
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+EVENT_TYPES = {
+    1: "context_denied",
+    2: "critical",
+    3: "destructive",
+}
+
+VERDICTS = {0: "allowed", 1: "blocked"}
+
+# Records drained per read() call and per CPU
+DEFAULT_BATCH = 256
+
+
+@dataclass
+class TCPEvent:
+    """Decoded security event record"""
+
+    cpu: int
+    timestamp_ns: int
+    pid: int
+    uid: int
+    syscall_nr: int
+    security_flags: int
+    type: str
+    verdict: str
+    comm: str
+
+
+def decode_records(cpu: int, data: bytes) -> Iterator[TCPEvent]:
+    """Decode a buffer holding whole event records"""
+    usable = len(data) - (len(data) % RECORD_SIZE)
+    for fields in struct.iter_unpack(RECORD_FORMAT, data[:usable]):
+        ts, pid, uid, nr, flags, etype, verdict, comm = fields
+        yield TCPEvent(
+            cpu=cpu,
+            timestamp_ns=ts,
+            pid=pid,
+            uid=uid,
+            syscall_nr=nr,
+            security_flags=flags,
+            type=EVENT_TYPES.get(etype, f"unknown({etype})"),
+            verdict=VERDICTS.get(verdict, str(verdict)),
+            comm=comm.split(b"\0", 1)[0].decode(errors="replace"),
+        )
+
+
+def open_cpu_buffers(event_dir: str) -> List[tuple]:
+    """Open every per-CPU relay buffer non-blocking"""
+    buffers = []
+    for path in sorted(glob.glob(os.path.join(event_dir, "events*"))):
+        cpu = int(path[len(os.path.join(event_dir, "events")):])
+        fd = os.open(path, os.O_RDONLY | os.O_NONBLOCK)
+        buffers.append((cpu, fd))
+    return buffers
+
+
+def drain(buffers: List[tuple], batch: int) -> Iterator[TCPEvent]:
+    """Read up to one batch of records from every CPU buffer"""
+    for cpu, fd in buffers:
+        try:
+            data = os.read(fd, batch * RECORD_SIZE)
+        except BlockingIOError:
+            continue
+        yield from decode_records(cpu, data)
+
+
+def format_event(event: TCPEvent) -> str:
+    return (
+        f"[{event.timestamp_ns}] cpu={event.cpu} {event.type} {event.verdict} "
+        f"syscall={event.syscall_nr} flags=0x{event.security_flags:04x} "
+        f"pid={event.pid} uid={event.uid} comm={event.comm}"
+    )
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Drain tcp_kernel security events")
+    parser.add_argument("--dir", default=EVENT_DIR, help="debugfs event directory")
+    parser.add_argument("--batch", type=int, default=DEFAULT_BATCH,
+                        help="records per read() per CPU")
+    parser.add_argument("--json", action="store_true", help="emit JSON lines")
+    parser.add_argument("--follow", "-f", action="store_true",
+                        help="keep draining until interrupted")
+    args = parser.parse_args()
+
+    buffers = open_cpu_buffers(args.dir)
+    if not buffers:
+        print(f"No event buffers found in {args.dir} (is tcp_kernel loaded "
+              f"and debugfs mounted?)", file=sys.stderr)
+        return 1
+
+    poller = select.poll()
+    for _, fd in buffers:
+        poller.register(fd, select.POLLIN)
+
+    try:
+        while True:
+            for event in drain(buffers, args.batch):
+                if args.json:
+                    print(json.dumps(asdict(event)))
+                else:
+                    print(format_event(event))
+            sys.stdout.flush()
+
+            if not args.follow:
+                break
+            poller.poll(1000)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for _, fd in buffers:
+            os.close(fd)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
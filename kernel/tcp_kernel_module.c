@@ -23,13 +23,55 @@
 #include <linux/spinlock.h>
 #include <linux/atomic.h>
 #include <linux/time.h>
+#include <linux/rcupdate.h>
+#include <linux/mutex.h>
+#include <linux/nospec.h>
+#include <linux/percpu.h>
+#include <linux/tracepoint.h>
+#include <linux/ftrace.h>
+#include <linux/version.h>
+#include <linux/relay.h>
+#include <linux/debugfs.h>
+#include <linux/cred.h>
+#include <linux/crc32.h>
+#include <linux/capability.h>
+#include <linux/overflow.h>
+#include <linux/firmware.h>
+#include <linux/log2.h>
+#include <linux/sched/clock.h>
+#include <linux/bitmap.h>
+#include <linux/jump_label.h>
+#include <linux/miscdevice.h>
+#include <linux/workqueue.h>
+#include <linux/mm.h>
+#include <linux/cgroup.h>
+#include <linux/hashtable.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+#include <linux/sort.h>
+#include <linux/error-injection.h>
+
+#include "tcp_kernel_uapi.h"
+#include "tcp_engine.h"
+
+/*
+ * LSM hooks can only be registered by code linked into the kernel image,
+ * so the enforcing backend exists only when this file is built in.
+ */
+#if !defined(MODULE) && IS_ENABLED(CONFIG_SECURITY) && \
+    LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+#define TCP_HAVE_LSM 1
+#include <linux/lsm_hooks.h>
+#include <linux/binfmts.h>
+#include <linux/kernel_read_file.h>
+#endif
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("TCP Research Team");
 MODULE_DESCRIPTION("TCP Kernel Integration - Deep System Security");
 MODULE_VERSION("1.0");
 
-/* TCP Descriptor Structure for Kernel */
+/* Built-in descriptor definition, serialized into a descriptor pack at init */
 struct tcp_kernel_descriptor {
     int syscall_nr;              /* System call number */
     u16 security_flags;          /* TCP security flags */
@@ -39,48 +81,81 @@ struct tcp_kernel_descriptor {
     u32 checksum;                /* Integrity check */
 };
 
-/* TCP Security Flags */
-#define TCP_FLAG_SAFE           0x0001
-#define TCP_FLAG_DESTRUCTIVE    0x0002
-#define TCP_FLAG_FILESYSTEM     0x0004
-#define TCP_FLAG_NETWORK        0x0008
-#define TCP_FLAG_EXECUTION      0x0010
-#define TCP_FLAG_CRITICAL       0x0020
-#define TCP_FLAG_KERNEL         0x0040
-#define TCP_FLAG_PRIVESC        0x0080
-
-/* TCP Context Masks */
-#define TCP_CTX_USER            0x01
-#define TCP_CTX_ADMIN           0x02
-#define TCP_CTX_KERNEL          0x04
-#define TCP_CTX_CONTAINER       0x08
-#define TCP_CTX_ALL             0xFF
-
-/* TCP Privilege Levels */
-#define TCP_PRIV_USER           0
-#define TCP_PRIV_ROOT           1
-#define TCP_PRIV_KERNEL         2
-
-/* Performance Statistics */
+/*
+ * Performance Statistics
+ *
+ * Counters are per-CPU so the syscall path never writes a shared cache
+ * line; readers sum all CPUs with tcp_stats_snapshot().
+ */
 struct tcp_stats {
-    atomic64_t total_checks;
-    atomic64_t fast_path_hits;
-    atomic64_t blocked_operations;
-    atomic64_t security_events;
-    atomic64_t false_positives;
+    u64 total_checks;
+    u64 fast_path_hits;
+    u64 blocked_operations;
+    u64 security_events;
+    u64 false_positives;
+    u64 events_dropped;
+    u64 cgroup_untracked;        /* Monitored calls over the cgroup_max cap */
+    u64 decision_hits;           /* Monitored calls answered by the decision cache */
+    u64 decision_misses;         /* Monitored calls evaluated from the flags */
+};
+
+static DEFINE_PER_CPU(struct tcp_stats, tcp_cpu_stats);
+
+#define tcp_stat_inc(field) this_cpu_inc(tcp_cpu_stats.field)
+#define tcp_stat_add(field, n) this_cpu_add(tcp_cpu_stats.field, n)
+
+/*
+ * Safe-path sampling
+ *
+ * Safe and unknown syscalls are accounted 1-in-N: a per-CPU countdown
+ * skips N - 1 calls without touching any counter or clock, and the Nth
+ * is accounted with weight N. Non-safe descriptors are always accounted
+ * exactly. N is sample_ratio, raised automatically on a CPU whose safe
+ * call rate over the last window exceeds sample_auto_rate so that about
+ * sample_auto_rate calls per second are still accounted there.
+ *
+ * At N = 1 a safe call only increments its counters. The countdown is
+ * armed only while sample_ratio > 1 or adaptation is on, and a CPU at
+ * N = 1 then reads the clock to measure its rate once every
+ * TCP_SAMPLE_PROBE_CALLS calls rather than on every call.
+ */
+#define TCP_SAMPLE_WINDOW_NS    (100 * NSEC_PER_MSEC)
+#define TCP_SAMPLE_MAX_RATIO    1024
+#define TCP_SAMPLE_PROBE_CALLS  64
+
+static unsigned int sample_ratio = 1;
+static unsigned int sample_auto_rate = 1000000;
+
+struct tcp_sample_state {
+    int countdown;               /* Calls left before the next sample */
+    u32 ratio;                   /* Ratio of the current interval */
+    u32 interval;                /* Calls in the current interval */
+    u64 window_start;            /* Rate measurement window */
+    u64 window_calls;            /* Estimated calls in the window */
 };
 
+static DEFINE_PER_CPU(struct tcp_sample_state, tcp_cpu_sample);
+static DEFINE_STATIC_KEY_FALSE(tcp_sample_key);    /* Countdown armed */
+
 /* Global TCP State */
 static struct tcp_kernel_state {
     bool enabled;
     int security_level;
-    struct tcp_stats stats;
-    spinlock_t lock;
-    struct proc_dir_entry *proc_entry;
-} tcp_state;
+} tcp_state = {
+    .enabled = true,
+    .security_level = 1,         /* Normal level */
+};
 
-/* TCP Descriptor Database (simplified for demo) */
-static struct tcp_kernel_descriptor tcp_descriptors[] = {
+/*
+ * The hot path tests these instead of tcp_state, so a disabled module or
+ * an unused paranoid tier costs a patched-out jump. Both are flipped only
+ * by the enabled and security_level parameter handlers.
+ */
+static DEFINE_STATIC_KEY_FALSE(tcp_enabled_key);
+static DEFINE_STATIC_KEY_FALSE(tcp_paranoid_key);
+
+/* Default TCP Descriptor Database, loaded at init (simplified for demo) */
+static const struct tcp_kernel_descriptor tcp_default_descriptors[] = {
     /* unlink() - file deletion */
     {
         .syscall_nr = __NR_unlink,
@@ -122,225 +197,2823 @@ static struct tcp_kernel_descriptor tcp_descriptors[] = {
     }
 };
 
-#define TCP_DESCRIPTOR_COUNT ARRAY_SIZE(tcp_descriptors)
+#define TCP_DEFAULT_DESCRIPTOR_COUNT ARRAY_SIZE(tcp_default_descriptors)
 
-/* Fast descriptor lookup */
-static struct tcp_kernel_descriptor* tcp_find_descriptor(int syscall_nr)
+/*
+ * Sum a block of per-CPU u64 counters over cpus (tcp_engine.h). Counters
+ * are read without synchronization, so a sum taken while they move is
+ * only as exact as the individual loads.
+ */
+void __tcp_percpu_sum(void *sum, const void __percpu *counters, size_t size,
+                      const struct cpumask *cpus)
 {
-    int i;
-    
-    for (i = 0; i < TCP_DESCRIPTOR_COUNT; i++) {
-        if (tcp_descriptors[i].syscall_nr == syscall_nr) {
-            return &tcp_descriptors[i];
+    u64 *out = sum;
+    size_t i;
+    int cpu;
+
+    memset(sum, 0, size);
+
+    for_each_cpu(cpu, cpus) {
+        const u64 *c = per_cpu_ptr(counters, cpu);
+
+        for (i = 0; i < size / sizeof(u64); i++) {
+            out[i] += READ_ONCE(c[i]);
         }
     }
-    
-    return NULL;
 }
+EXPORT_SYMBOL_GPL(__tcp_percpu_sum);
 
-/* Check if current context is valid for operation */
-static bool tcp_check_context(struct tcp_kernel_descriptor *desc)
+static void tcp_stats_snapshot(struct tcp_stats *sum)
 {
-    u8 current_context = 0;
-    
-    /* Determine current execution context */
-    if (current->cred->uid.val == 0) {
-        current_context |= TCP_CTX_ADMIN;
-    } else {
-        current_context |= TCP_CTX_USER;
-    }
-    
-    /* Check if in container (simplified check) */
-    if (current->nsproxy != &init_nsproxy) {
-        current_context |= TCP_CTX_CONTAINER;
+    tcp_percpu_sum(sum, &tcp_cpu_stats, cpu_possible_mask);
+}
+
+/* Counters of the CPUs currently on one node */
+static void tcp_stats_snapshot_node(struct tcp_stats *sum, int node)
+{
+    tcp_percpu_sum(sum, &tcp_cpu_stats, cpumask_of_node(node));
+}
+
+/*
+ * Latency histograms
+ *
+ * Per-CPU log2 histograms of syscall analysis time, from before the
+ * descriptor lookup to the verdict, split by outcome: "hit" is the safe
+ * fast path, "miss" a full analysis that allowed the call and "blocked" a
+ * denial. Bucket b counts samples in [2^b, 2^(b+1)) ns (bucket 0 also
+ * takes 0 and 1 ns, the last bucket takes everything above). Only sampled
+ * safe calls are timed, the callers reading the clock only when
+ * tcp_sample_due() says the next one is, so the hit histogram stays empty
+ * while the sampling countdown is unarmed. /proc/tcp_kernel_latency
+ * reports them with percentiles and is reset by writing to it. The bucket
+ * layout is part of the statistics page ABI (tcp_kernel_uapi.h), and the
+ * histogram type and its /proc file are shared with layered modules
+ * through tcp_engine.h.
+ */
+
+static const char * const tcp_lat_path_names[TCP_LAT_NR_PATHS] = {
+    [TCP_LAT_HIT] = "hit",
+    [TCP_LAT_MISS] = "miss",
+    [TCP_LAT_BLOCKED] = "blocked",
+};
+
+static DEFINE_PER_CPU(struct tcp_latency_hist, tcp_cpu_latency);
+
+/* Upper bound in ns of the bucket holding the per-mille quantile q */
+static u64 tcp_latency_quantile(const u64 *buckets, u64 count, unsigned int q)
+{
+    u64 rank = div_u64(count * q + 999, 1000);
+    u64 seen = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < TCP_LAT_BUCKETS - 1; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            break;
+        }
     }
-    
-    /* Validate context against descriptor */
-    return (desc->context_mask & current_context) != 0;
+
+    return (2ULL << bucket) - 1;
+}
+
+/* Shared sentinel for syscalls without a descriptor - treated as safe */
+static const struct tcp_pack_entry tcp_safe_entry = {
+    .syscall_nr = -1,
+    .security_flags = TCP_FLAG_SAFE,
+    .context_mask = TCP_CTX_ALL,
+    .privilege_level = TCP_PRIV_USER,
+};
+
+/*
+ * Descriptor database.
+ *
+ * The live database is reached through a single RCU pointer. It owns a
+ * verbatim copy of a descriptor pack (see tcp_kernel_uapi.h) plus a
+ * dense syscall-indexed table pointing into the pack's hot entry array;
+ * every slot is populated (unknown syscalls point at tcp_safe_entry).
+ * A bitmap of the syscalls with non-safe descriptors, one cache line on
+ * x86-64, is checked first, so the common unmonitored syscall never
+ * loads the table at all. The hot path never takes a lock or touches
+ * pattern strings.
+ * Writers build a complete new database off the hot path, publish it
+ * with rcu_assign_pointer() and free the old one after a grace period.
+ *
+ * On NUMA machines the global database is replicated onto every node
+ * with memory before it is published, so lookups from any CPU stay on
+ * local memory; see "NUMA replicas".
+ */
+#define TCP_DB_MAX_DESCRIPTORS 512
+#define TCP_PACK_MAX_SIZE      (64 * 1024)
+
+static char *descriptor_pack = "tcp_descriptors.pack";
+module_param(descriptor_pack, charp, 0444);
+MODULE_PARM_DESC(descriptor_pack,
+                 "Descriptor pack loaded via request_firmware at init (empty: built-in defaults)");
+
+/*
+ * Security hooks checked by the LSM backend. Each hook evaluates the
+ * descriptor of the syscall it stands for; the lookup is resolved once
+ * per database build into by_hook[] instead of on every call.
+ */
+enum tcp_hook {
+    TCP_HOOK_EXEC,               /* bprm_check_security */
+    TCP_HOOK_UNLINK,             /* inode_unlink */
+    TCP_HOOK_MODULE_REQUEST,     /* kernel_module_request */
+    TCP_HOOK_MODULE_LOAD,        /* kernel_load_data, kernel_read_file */
+    TCP_NR_HOOKS
+};
+
+static const int tcp_hook_syscalls[TCP_NR_HOOKS] = {
+    [TCP_HOOK_EXEC] = __NR_execve,
+    [TCP_HOOK_UNLINK] = __NR_unlink,
+    [TCP_HOOK_MODULE_REQUEST] = __NR_init_module,
+    [TCP_HOOK_MODULE_LOAD] = __NR_init_module,
+};
+
+struct tcp_descriptor_db {
+    struct rcu_head rcu;
+    u32 version;                 /* Reload generation, starts at 1 */
+    u32 count;                   /* Number of descriptors */
+    const struct tcp_pack_entry *entries;   /* Hot array, inside pack */
+    const struct tcp_pack_meta *meta;       /* Cold array, inside pack */
+    const char *strtab;                     /* Pattern names, inside pack */
+    u32 pack_len;                           /* Bytes in pack[] */
+    struct tcp_descriptor_db **replicas;    /* Per-node copies, or NULL */
+    DECLARE_BITMAP(monitored, NR_syscalls);  /* Non-safe descriptors */
+    const struct tcp_pack_entry *by_syscall[NR_syscalls];
+    const struct tcp_pack_entry *by_hook[TCP_NR_HOOKS];
+    u8 pack[] __aligned(8);
+};
+
+static struct tcp_descriptor_db __rcu *tcp_db;
+static DEFINE_MUTEX(tcp_db_mutex);     /* Serializes database writers */
+static u32 tcp_db_generation;          /* Protected by tcp_db_mutex */
+
+/* Tags every cached decision; see "Decision cache" */
+static atomic_t tcp_decision_gen = ATOMIC_INIT(1);
+
+/*
+ * Drop every cached decision. Call before publishing a database so the
+ * release in rcu_assign_pointer() orders the bump first, or after
+ * changing anything else an outcome depends on.
+ */
+static inline void tcp_decision_invalidate(void)
+{
+    atomic_inc(&tcp_decision_gen);
 }
 
-/* TCP security analysis */
-static int tcp_analyze_syscall(struct pt_regs *regs)
+/* The section [offset, offset + size) lies inside a pack of len bytes */
+static bool tcp_pack_section_ok(u32 offset, size_t size, size_t len)
 {
-    struct tcp_kernel_descriptor *desc;
-    int syscall_nr;
-    
-    if (!tcp_state.enabled) {
-        return 0;
+    return offset <= len && size <= len - offset;
+}
+
+/* Check a pack's header, layout and checksum before anything uses it */
+static int tcp_pack_validate(const void *data, size_t len)
+{
+    const struct tcp_pack_header *hdr = data;
+    const struct tcp_pack_meta *meta;
+    const char *strtab;
+    u32 i;
+
+    if (len < sizeof(*hdr) || len > TCP_PACK_MAX_SIZE ||
+        hdr->magic != TCP_PACK_MAGIC || hdr->version != TCP_PACK_VERSION ||
+        hdr->header_size != sizeof(*hdr) || hdr->total_size != len ||
+        hdr->reserved) {
+        return -EINVAL;
     }
-    
-    syscall_nr = regs->orig_ax;
-    atomic64_inc(&tcp_state.stats.total_checks);
-    
-    /* Fast path for safe operations */
-    desc = tcp_find_descriptor(syscall_nr);
-    if (!desc) {
-        /* Unknown syscall - treat as safe for now */
-        atomic64_inc(&tcp_state.stats.fast_path_hits);
-        return 0;
+
+    if (hdr->count > TCP_DB_MAX_DESCRIPTORS) {
+        return -E2BIG;
     }
-    
-    /* Check if operation is safe */
-    if (desc->security_flags & TCP_FLAG_SAFE) {
-        atomic64_inc(&tcp_state.stats.fast_path_hits);
-        return 0;
+
+    if (!IS_ALIGNED(hdr->entries_offset, 8) ||
+        !IS_ALIGNED(hdr->meta_offset, 4) ||
+        hdr->entries_offset < sizeof(*hdr) ||
+        hdr->meta_offset < sizeof(*hdr) ||
+        hdr->strtab_offset < sizeof(*hdr) ||
+        !tcp_pack_section_ok(hdr->entries_offset,
+                             hdr->count * sizeof(struct tcp_pack_entry), len) ||
+        !tcp_pack_section_ok(hdr->meta_offset,
+                             hdr->count * sizeof(struct tcp_pack_meta), len) ||
+        !tcp_pack_section_ok(hdr->strtab_offset, hdr->strtab_size, len)) {
+        return -EINVAL;
     }
-    
-    /* Validate execution context */
-    if (!tcp_check_context(desc)) {
-        pr_warn("TCP: Invalid context for syscall %d (PID %d, UID %d)\n",
-                syscall_nr, current->pid, current->cred->uid.val);
-        atomic64_inc(&tcp_state.stats.blocked_operations);
-        return -EPERM;
+
+    if (crc32_le(0, (const u8 *)data + sizeof(*hdr), len - sizeof(*hdr)) !=
+        hdr->checksum) {
+        pr_warn("TCP: Descriptor pack checksum mismatch\n");
+        return -EBADMSG;
     }
-    
-    /* Check for critical operations */
-    if (desc->security_flags & TCP_FLAG_CRITICAL) {
-        pr_info("TCP: Critical operation detected - syscall %d (PID %d, CMD %s)\n",
-                syscall_nr, current->pid, current->comm);
-        atomic64_inc(&tcp_state.stats.security_events);
-        
-        /* In paranoid mode, block all critical operations from non-root */
-        if (tcp_state.security_level >= 2 && current->cred->uid.val != 0) {
-            pr_warn("TCP: Blocking critical operation from non-root user\n");
-            atomic64_inc(&tcp_state.stats.blocked_operations);
-            return -EPERM;
-        }
+
+    /* Every pattern offset must land inside a NUL-terminated string table */
+    strtab = (const char *)data + hdr->strtab_offset;
+    if (hdr->count && (!hdr->strtab_size || strtab[hdr->strtab_size - 1])) {
+        return -EINVAL;
     }
-    
-    /* Log destructive operations */
-    if (desc->security_flags & TCP_FLAG_DESTRUCTIVE) {
-        pr_info("TCP: Destructive operation - syscall %d (PID %d, CMD %s)\n",
-                syscall_nr, current->pid, current->comm);
-        atomic64_inc(&tcp_state.stats.security_events);
+
+    meta = (const void *)((const u8 *)data + hdr->meta_offset);
+    for (i = 0; i < hdr->count; i++) {
+        if (meta[i].pattern_offset >= hdr->strtab_size) {
+            return -EINVAL;
+        }
     }
-    
+
     return 0;
 }
 
-/* Kprobe for system call entry */
-static struct kprobe tcp_syscall_kprobe = {
-    .symbol_name = "do_syscall_64",
-};
+/* Build a database around a private copy of a descriptor pack */
+static struct tcp_descriptor_db *tcp_build_db(const void *pack, size_t len)
+{
+    const struct tcp_pack_header *hdr;
+    struct tcp_descriptor_db *db;
+    u32 i;
+    int ret;
 
-/* Kprobe pre-handler */
-static int tcp_syscall_pre_handler(struct kprobe *p, struct pt_regs *regs)
+    ret = tcp_pack_validate(pack, len);
+    if (ret < 0) {
+        return ERR_PTR(ret);
+    }
+
+    db = kvzalloc(struct_size(db, pack, len), GFP_KERNEL);
+    if (!db) {
+        return ERR_PTR(-ENOMEM);
+    }
+
+    memcpy(db->pack, pack, len);
+    hdr = (const struct tcp_pack_header *)db->pack;
+    db->pack_len = len;
+    db->count = hdr->count;
+    db->entries = (const void *)(db->pack + hdr->entries_offset);
+    db->meta = (const void *)(db->pack + hdr->meta_offset);
+    db->strtab = (const char *)(db->pack + hdr->strtab_offset);
+
+    for (i = 0; i < NR_syscalls; i++) {
+        db->by_syscall[i] = &tcp_safe_entry;
+    }
+
+    for (i = 0; i < db->count; i++) {
+        const struct tcp_pack_entry *entry = &db->entries[i];
+        int nr = entry->syscall_nr;
+
+        if (nr < 0 || nr >= NR_syscalls) {
+            pr_warn("TCP: Rejecting descriptor for out-of-range syscall %d\n", nr);
+            goto invalid;
+        }
+        if (db->by_syscall[nr] != &tcp_safe_entry) {
+            pr_warn("TCP: Rejecting duplicate descriptor for syscall %d\n", nr);
+            goto invalid;
+        }
+
+        db->by_syscall[nr] = entry;
+        if (!(entry->security_flags & TCP_FLAG_SAFE)) {
+            __set_bit(nr, db->monitored);
+        }
+    }
+
+    for (i = 0; i < TCP_NR_HOOKS; i++) {
+        db->by_hook[i] = db->by_syscall[tcp_hook_syscalls[i]];
+    }
+
+    return db;
+
+invalid:
+    kvfree(db);
+    return ERR_PTR(-EINVAL);
+}
+
+/*
+ * NUMA replicas
+ *
+ * The database is read on every monitored syscall and written only on
+ * reload, so the global one is copied onto each node with memory and
+ * CPUs read the copy on their nearest node (numa_mem_id()). A replica
+ * is the same object relocated: pointers into the pack are rebased,
+ * pointers to tcp_safe_entry are kept. All replicas are built before
+ * the primary is published and freed with it, so a reader always sees
+ * a complete, consistent set. Nodes whose copy could not be allocated,
+ * and per-cgroup override databases, use the primary.
+ */
+static const void *tcp_db_rebase(const struct tcp_descriptor_db *src,
+                                 struct tcp_descriptor_db *dst, const void *ptr)
 {
-    int result = tcp_analyze_syscall(regs);
-    
-    /* If we want to block the syscall, we'd need more complex handling */
-    /* For this demo, we just log and continue */
-    return 0;
+    if (ptr == &tcp_safe_entry) {
+        return ptr;
+    }
+    return dst->pack + ((const u8 *)ptr - src->pack);
 }
 
-/* Proc filesystem interface */
-static int tcp_proc_show(struct seq_file *m, void *v)
+static struct tcp_descriptor_db *tcp_db_clone_node(const struct tcp_descriptor_db *src,
+                                                   int node)
 {
-    seq_printf(m, "TCP Kernel Integration Status\n");
-    seq_printf(m, "============================\n\n");
-    seq_printf(m, "Enabled: %s\n", tcp_state.enabled ? "Yes" : "No");
-    seq_printf(m, "Security Level: %d\n", tcp_state.security_level);
-    seq_printf(m, "\nStatistics:\n");
-    seq_printf(m, "  Total Checks: %lld\n", 
-               atomic64_read(&tcp_state.stats.total_checks));
-    seq_printf(m, "  Fast Path Hits: %lld\n", 
-               atomic64_read(&tcp_state.stats.fast_path_hits));
-    seq_printf(m, "  Blocked Operations: %lld\n", 
-               atomic64_read(&tcp_state.stats.blocked_operations));
-    seq_printf(m, "  Security Events: %lld\n", 
-               atomic64_read(&tcp_state.stats.security_events));
-    seq_printf(m, "  False Positives: %lld\n", 
-               atomic64_read(&tcp_state.stats.false_positives));
-    
-    seq_printf(m, "\nDescriptor Database:\n");
-    int i;
-    for (i = 0; i < TCP_DESCRIPTOR_COUNT; i++) {
-        seq_printf(m, "  Syscall %d: flags=0x%04x pattern=%s\n",
-                   tcp_descriptors[i].syscall_nr,
-                   tcp_descriptors[i].security_flags,
-                   tcp_descriptors[i].pattern);
+    struct tcp_descriptor_db *dst;
+    size_t size = struct_size(src, pack, src->pack_len);
+    u32 i;
+
+    dst = kvmalloc_node(size, GFP_KERNEL, node);
+    if (!dst) {
+        return NULL;
     }
-    
-    return 0;
+
+    memcpy(dst, src, size);
+    dst->replicas = NULL;
+    dst->entries = tcp_db_rebase(src, dst, src->entries);
+    dst->meta = tcp_db_rebase(src, dst, src->meta);
+    dst->strtab = tcp_db_rebase(src, dst, src->strtab);
+    for (i = 0; i < NR_syscalls; i++) {
+        dst->by_syscall[i] = tcp_db_rebase(src, dst, src->by_syscall[i]);
+    }
+    for (i = 0; i < TCP_NR_HOOKS; i++) {
+        dst->by_hook[i] = tcp_db_rebase(src, dst, src->by_hook[i]);
+    }
+
+    return dst;
 }
 
-static int tcp_proc_open(struct inode *inode, struct file *file)
+/* Node holding the memory at addr */
+static int tcp_addr_node(const void *addr)
 {
-    return single_open(file, tcp_proc_show, NULL);
+    if (is_vmalloc_addr(addr)) {
+        return page_to_nid(vmalloc_to_page(addr));
+    }
+    return page_to_nid(virt_to_page(addr));
 }
 
-static const struct proc_ops tcp_proc_ops = {
-    .proc_open = tcp_proc_open,
-    .proc_read = seq_read,
-    .proc_lseek = seq_lseek,
-    .proc_release = single_release,
-};
+/* Give a new global database a copy on every other node; best effort */
+static void tcp_db_replicate(struct tcp_descriptor_db *db)
+{
+    int home = tcp_addr_node(db);
+    int node;
 
-/* Initialize TCP kernel module */
-static int __init tcp_kernel_init(void)
+    if (num_node_state(N_MEMORY) < 2) {
+        return;
+    }
+
+    db->replicas = kcalloc(nr_node_ids, sizeof(*db->replicas), GFP_KERNEL);
+    if (!db->replicas) {
+        pr_warn("TCP: No memory for descriptor replicas, using one copy\n");
+        return;
+    }
+
+    for_each_node_state(node, N_MEMORY) {
+        if (node == home) {
+            db->replicas[node] = db;
+            continue;
+        }
+        db->replicas[node] = tcp_db_clone_node(db, node);
+        if (!db->replicas[node]) {
+            pr_warn("TCP: No memory for descriptor replica on node %d\n", node);
+        }
+    }
+}
+
+static void tcp_db_free(struct tcp_descriptor_db *db)
+{
+    int node;
+
+    if (!db) {
+        return;
+    }
+
+    if (db->replicas) {
+        for_each_node(node) {
+            if (db->replicas[node] != db) {
+                kvfree(db->replicas[node]);
+            }
+        }
+        kfree(db->replicas);
+    }
+    kvfree(db);
+}
+
+static void tcp_db_free_rcu(struct rcu_head *head)
+{
+    tcp_db_free(container_of(head, struct tcp_descriptor_db, rcu));
+}
+
+/* This CPU's copy of a database; under RCU */
+static __always_inline const struct tcp_descriptor_db *
+tcp_local_db(const struct tcp_descriptor_db *db)
+{
+    const struct tcp_descriptor_db *local;
+
+    if (!db || !db->replicas) {
+        return db;
+    }
+    local = db->replicas[numa_mem_id()];
+    return local ?: db;
+}
+
+/* Pattern name of the i-th descriptor */
+static const char *tcp_db_pattern(const struct tcp_descriptor_db *db, u32 i)
+{
+    return db->strtab + db->meta[i].pattern_offset;
+}
+
+/* Serialize the compiled-in defaults into a pack, caller kvfree()s it */
+static void *tcp_default_pack(size_t *lenp)
+{
+    const size_t count = TCP_DEFAULT_DESCRIPTOR_COUNT;
+    struct tcp_pack_header *hdr;
+    struct tcp_pack_entry *entries;
+    struct tcp_pack_meta *meta;
+    size_t strtab_size = 0, len, off = 0, i;
+    char *strtab;
+
+    for (i = 0; i < count; i++) {
+        strtab_size += strnlen(tcp_default_descriptors[i].pattern,
+                               sizeof(tcp_default_descriptors[i].pattern) - 1) + 1;
+    }
+
+    len = sizeof(*hdr) + count * (sizeof(*entries) + sizeof(*meta)) + strtab_size;
+    hdr = kvzalloc(len, GFP_KERNEL);
+    if (!hdr) {
+        return NULL;
+    }
+
+    entries = (struct tcp_pack_entry *)(hdr + 1);
+    meta = (struct tcp_pack_meta *)(entries + count);
+    strtab = (char *)(meta + count);
+
+    for (i = 0; i < count; i++) {
+        const struct tcp_kernel_descriptor *desc = &tcp_default_descriptors[i];
+        size_t n = strnlen(desc->pattern, sizeof(desc->pattern) - 1);
+
+        entries[i].syscall_nr = desc->syscall_nr;
+        entries[i].security_flags = desc->security_flags;
+        entries[i].context_mask = desc->context_mask;
+        entries[i].privilege_level = desc->privilege_level;
+        meta[i].pattern_offset = off;
+        meta[i].checksum = desc->checksum;
+        memcpy(strtab + off, desc->pattern, n);
+        off += n + 1;
+    }
+
+    hdr->magic = TCP_PACK_MAGIC;
+    hdr->version = TCP_PACK_VERSION;
+    hdr->header_size = sizeof(*hdr);
+    hdr->total_size = len;
+    hdr->count = count;
+    hdr->entries_offset = (u8 *)entries - (u8 *)hdr;
+    hdr->meta_offset = (u8 *)meta - (u8 *)hdr;
+    hdr->strtab_offset = (u8 *)strtab - (u8 *)hdr;
+    hdr->strtab_size = strtab_size;
+    hdr->checksum = crc32_le(0, (const u8 *)(hdr + 1), len - sizeof(*hdr));
+
+    *lenp = len;
+    return hdr;
+}
+
+/*
+ * Initial database: the firmware pack named by descriptor_pack when it
+ * is installed, the compiled-in defaults otherwise. A pack that is
+ * present but invalid fails module load rather than silently falling
+ * back to a different policy.
+ */
+static struct tcp_descriptor_db *tcp_load_initial_db(void)
 {
+    const struct firmware *fw;
+    struct tcp_descriptor_db *db;
+    void *pack;
+    size_t len;
     int ret;
-    
-    pr_info("TCP: Initializing kernel integration module\n");
-    
-    /* Initialize state */
-    memset(&tcp_state, 0, sizeof(tcp_state));
-    tcp_state.enabled = true;
-    tcp_state.security_level = 1;  /* Normal level */
-    spin_lock_init(&tcp_state.lock);
-    
-    /* Initialize statistics */
-    atomic64_set(&tcp_state.stats.total_checks, 0);
-    atomic64_set(&tcp_state.stats.fast_path_hits, 0);
-    atomic64_set(&tcp_state.stats.blocked_operations, 0);
-    atomic64_set(&tcp_state.stats.security_events, 0);
-    atomic64_set(&tcp_state.stats.false_positives, 0);
-    
-    /* Register kprobe for syscall monitoring */
-    tcp_syscall_kprobe.pre_handler = tcp_syscall_pre_handler;
-    ret = register_kprobe(&tcp_syscall_kprobe);
-    if (ret < 0) {
-        pr_err("TCP: Failed to register kprobe: %d\n", ret);
-        return ret;
+
+    if (descriptor_pack && *descriptor_pack) {
+        ret = request_firmware_direct(&fw, descriptor_pack, NULL);
+        if (!ret) {
+            db = tcp_build_db(fw->data, fw->size);
+            release_firmware(fw);
+            if (IS_ERR(db)) {
+                pr_err("TCP: Invalid descriptor pack %s: %ld\n",
+                       descriptor_pack, PTR_ERR(db));
+            } else {
+                pr_info("TCP: Loaded descriptor pack %s\n", descriptor_pack);
+            }
+            return db;
+        }
+        pr_info("TCP: Descriptor pack %s not available (%d), using built-in defaults\n",
+                descriptor_pack, ret);
     }
-    
-    /* Create proc filesystem entry */
-    tcp_state.proc_entry = proc_create("tcp_kernel", 0444, NULL, &tcp_proc_ops);
-    if (!tcp_state.proc_entry) {
-        pr_err("TCP: Failed to create proc entry\n");
-        unregister_kprobe(&tcp_syscall_kprobe);
-        return -ENOMEM;
+
+    pack = tcp_default_pack(&len);
+    if (!pack) {
+        return ERR_PTR(-ENOMEM);
     }
-    
-    pr_info("TCP: Kernel integration active (security level %d)\n", 
-            tcp_state.security_level);
-    pr_info("TCP: Monitoring %zu syscall descriptors\n", TCP_DESCRIPTOR_COUNT);
-    pr_info("TCP: Status available at /proc/tcp_kernel\n");
-    
-    return 0;
+
+    db = tcp_build_db(pack, len);
+    kvfree(pack);
+    return db;
 }
 
-/* Cleanup TCP kernel module */
-static void __exit tcp_kernel_exit(void)
+/*
+ * Publish a new database and its node replicas; the previous set is freed
+ * after a grace period. With expect_version set, the database is only
+ * published over that version and freed with -EBUSY otherwise.
+ */
+static int tcp_replace_db(struct tcp_descriptor_db *db, u32 expect_version)
 {
-    pr_info("TCP: Shutting down kernel integration\n");
-    
-    /* Disable TCP */
-    tcp_state.enabled = false;
-    
-    /* Remove proc entry */
-    if (tcp_state.proc_entry) {
-        proc_remove(tcp_state.proc_entry);
+    struct tcp_descriptor_db *old;
+    int node;
+
+    tcp_db_replicate(db);
+
+    mutex_lock(&tcp_db_mutex);
+    old = rcu_dereference_protected(tcp_db, lockdep_is_held(&tcp_db_mutex));
+    if (expect_version && (!old || old->version != expect_version)) {
+        mutex_unlock(&tcp_db_mutex);
+        tcp_db_free(db);
+        return -EBUSY;
     }
-    
-    /* Unregister kprobe */
-    unregister_kprobe(&tcp_syscall_kprobe);
+    db->version = ++tcp_db_generation;
+    for_each_node(node) {
+        if (db->replicas && db->replicas[node]) {
+            db->replicas[node]->version = db->version;
+        }
+    }
+    tcp_decision_invalidate();
+    old = rcu_replace_pointer(tcp_db, db, lockdep_is_held(&tcp_db_mutex));
+    mutex_unlock(&tcp_db_mutex);
+
+    if (old) {
+        call_rcu(&old->rcu, tcp_db_free_rcu);
+    }
+    return 0;
+}
+
+static void tcp_install_db(struct tcp_descriptor_db *db)
+{
+    tcp_replace_db(db, 0);
+}
+
+/*
+ * Per-cgroup policy and accounting
+ *
+ * Monitored operations are attributed to the caller's cgroup v2 cgroup.
+ * Each cgroup seen gets an entry in an RCU hash table keyed on the cgroup
+ * ID, holding per-CPU counters and an optional descriptor database that
+ * replaces the global one for tasks in that cgroup. Entries are created
+ * from the syscall path on first sight (GFP_ATOMIC, at most cgroup_max)
+ * and, unless they carry a policy, dropped by the statistics worker after
+ * TCP_CGROUP_IDLE_SECS without a monitored call. Safe syscalls are never
+ * attributed, so the fast path does not look up the cgroup.
+ */
+#if IS_ENABLED(CONFIG_CGROUPS) && LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+#define TCP_HAVE_CGROUPS
+#endif
+
+#define TCP_CGROUP_HASH_BITS 10
+#define TCP_CGROUP_IDLE_SECS 300
+
+static unsigned int cgroup_max = 4096;
+module_param(cgroup_max, uint, 0644);
+MODULE_PARM_DESC(cgroup_max, "Most cgroups tracked at once");
+
+struct tcp_cgroup_stats {
+    u64 total_checks;
+    u64 blocked_operations;
+    u64 security_events;
+};
+
+struct tcp_cgroup {
+    struct hlist_node node;
+    struct rcu_head rcu;
+    u64 id;                                  /* cgroup v2 ID */
+    unsigned long last_seen;                 /* jiffies, refreshed once a second */
+    struct tcp_descriptor_db __rcu *db;      /* Policy override, NULL uses tcp_db */
+    struct tcp_cgroup_stats __percpu *stats;
+};
+
+static DEFINE_HASHTABLE(tcp_cgroups, TCP_CGROUP_HASH_BITS);
+static DEFINE_SPINLOCK(tcp_cgroup_lock);     /* Serializes table writers */
+static atomic_t tcp_cgroup_count = ATOMIC_INIT(0);
+static unsigned int tcp_cgroup_policies;    /* Protected by tcp_db_mutex */
+
+/* Union of the overrides' monitored bitmaps, tested only while any exist */
+static DECLARE_BITMAP(tcp_cgroup_monitored, NR_syscalls);
+static DEFINE_STATIC_KEY_FALSE(tcp_cgroup_policy_key);
+
+#define tcp_cgroup_stat_inc(cg, field) do {         \
+    if (cg) {                                       \
+        this_cpu_inc((cg)->stats->field);           \
+    }                                               \
+} while (0)
+
+#ifdef TCP_HAVE_CGROUPS
+static inline bool tcp_cgroups_supported(void)
+{
+    return true;
+}
+
+/* Under RCU, which keeps the css_set alive */
+static inline u64 tcp_current_cgroup_id(void)
+{
+    return cgroup_id(task_dfl_cgroup(current));
+}
+#else
+static inline bool tcp_cgroups_supported(void)
+{
+    return false;
+}
+
+static inline u64 tcp_current_cgroup_id(void)
+{
+    return 0;
+}
+#endif
+
+/* Caller holds rcu_read_lock() or tcp_cgroup_lock */
+static struct tcp_cgroup *tcp_cgroup_find(u64 id)
+{
+    struct tcp_cgroup *cg;
+
+    hash_for_each_possible_rcu(tcp_cgroups, cg, node, id) {
+        if (cg->id == id) {
+            return cg;
+        }
+    }
+
+    return NULL;
+}
+
+static struct tcp_cgroup *tcp_cgroup_alloc(u64 id, gfp_t gfp)
+{
+    struct tcp_cgroup *cg;
+
+    cg = kzalloc(sizeof(*cg), gfp);
+    if (!cg) {
+        return NULL;
+    }
+
+    cg->stats = alloc_percpu_gfp(struct tcp_cgroup_stats, gfp);
+    if (!cg->stats) {
+        kfree(cg);
+        return NULL;
+    }
+
+    cg->id = id;
+    cg->last_seen = jiffies;
+    return cg;
+}
+
+static void tcp_cgroup_free(struct tcp_cgroup *cg)
+{
+    kvfree(rcu_dereference_protected(cg->db, true));
+    free_percpu(cg->stats);
+    kfree(cg);
+}
+
+static void tcp_cgroup_free_rcu(struct rcu_head *head)
+{
+    tcp_cgroup_free(container_of(head, struct tcp_cgroup, rcu));
+}
+
+/* Insert a new entry unless another CPU got there first */
+static struct tcp_cgroup *tcp_cgroup_insert(struct tcp_cgroup *new)
+{
+    struct tcp_cgroup *cg;
+
+    spin_lock(&tcp_cgroup_lock);
+    cg = tcp_cgroup_find(new->id);
+    if (!cg) {
+        hash_add_rcu(tcp_cgroups, &new->node, new->id);
+        atomic_inc(&tcp_cgroup_count);
+        cg = new;
+    }
+    spin_unlock(&tcp_cgroup_lock);
+
+    if (cg != new) {
+        tcp_cgroup_free(new);
+    }
+
+    return cg;
+}
+
+/* Entry for the current task's cgroup, NULL if untracked. Under RCU */
+static struct tcp_cgroup *tcp_cgroup_current(void)
+{
+    unsigned long now = jiffies;
+    struct tcp_cgroup *cg;
+    u64 id;
+
+    id = tcp_current_cgroup_id();
+    if (!id) {
+        return NULL;
+    }
+
+    cg = tcp_cgroup_find(id);
+    if (likely(cg)) {
+        if (time_after(now, READ_ONCE(cg->last_seen) + HZ)) {
+            WRITE_ONCE(cg->last_seen, now);
+        }
+        return cg;
+    }
+
+    if (atomic_read(&tcp_cgroup_count) < READ_ONCE(cgroup_max)) {
+        cg = tcp_cgroup_alloc(id, GFP_ATOMIC | __GFP_NOWARN);
+        if (cg) {
+            return tcp_cgroup_insert(cg);
+        }
+    }
+
+    tcp_stat_inc(cgroup_untracked);
+    return NULL;
+}
+
+/* Drop idle entries without a policy; called from the statistics worker */
+static void tcp_cgroup_prune(void)
+{
+    unsigned long idle = TCP_CGROUP_IDLE_SECS * HZ;
+    struct hlist_node *tmp;
+    struct tcp_cgroup *cg;
+    int bkt;
+
+    spin_lock(&tcp_cgroup_lock);
+    hash_for_each_safe(tcp_cgroups, bkt, tmp, cg, node) {
+        if (rcu_access_pointer(cg->db) ||
+            time_before(jiffies, READ_ONCE(cg->last_seen) + idle)) {
+            continue;
+        }
+        hash_del_rcu(&cg->node);
+        atomic_dec(&tcp_cgroup_count);
+        call_rcu(&cg->rcu, tcp_cgroup_free_rcu);
+    }
+    spin_unlock(&tcp_cgroup_lock);
+}
+
+/* Rebuild the override prefilter after a policy change */
+static void tcp_cgroup_update_monitored(void)
+{
+    DECLARE_BITMAP(monitored, NR_syscalls);
+    const struct tcp_descriptor_db *db;
+    struct tcp_cgroup *cg;
+    int bkt;
+
+    lockdep_assert_held(&tcp_db_mutex);
+
+    if (!tcp_cgroup_policies) {
+        static_branch_disable(&tcp_cgroup_policy_key);
+        bitmap_zero(tcp_cgroup_monitored, NR_syscalls);
+        return;
+    }
+
+    bitmap_zero(monitored, NR_syscalls);
+    rcu_read_lock();
+    hash_for_each_rcu(tcp_cgroups, bkt, cg, node) {
+        db = rcu_dereference(cg->db);
+        if (db) {
+            bitmap_or(monitored, monitored, db->monitored, NR_syscalls);
+        }
+    }
+    rcu_read_unlock();
+
+    /* Bits monitored before and after stay set throughout the copy */
+    bitmap_copy(tcp_cgroup_monitored, monitored, NR_syscalls);
+    static_branch_enable(&tcp_cgroup_policy_key);
+}
+
+/* Called once no probe can run; entries still hold their policies */
+static void tcp_cgroup_exit(void)
+{
+    struct hlist_node *tmp;
+    struct tcp_cgroup *cg;
+    int bkt;
+
+    rcu_barrier();
+    hash_for_each_safe(tcp_cgroups, bkt, tmp, cg, node) {
+        hash_del(&cg->node);
+        tcp_cgroup_free(cg);
+    }
+    atomic_set(&tcp_cgroup_count, 0);
+}
+
+/*
+ * Prefilter: does the syscall have a non-safe descriptor, globally or in
+ * any cgroup policy? Under RCU
+ */
+static __always_inline bool tcp_syscall_monitored(int syscall_nr)
+{
+    const struct tcp_descriptor_db *db = tcp_local_db(rcu_dereference(tcp_db));
+    unsigned int nr;
+
+    if (unlikely(!db || (unsigned int)syscall_nr >= NR_syscalls)) {
+        return false;
+    }
+
+    nr = array_index_nospec(syscall_nr, NR_syscalls);
+    if (test_bit(nr, db->monitored)) {
+        return true;
+    }
+
+    return static_branch_unlikely(&tcp_cgroup_policy_key) &&
+           test_bit(nr, tcp_cgroup_monitored);
+}
+
+/* Database governing a cgroup: its override, else the global one */
+static const struct tcp_descriptor_db *tcp_policy_db(const struct tcp_cgroup *cg)
+{
+    const struct tcp_descriptor_db *db;
+
+    if (cg) {
+        db = rcu_dereference(cg->db);
+        if (db) {
+            return db;
+        }
+    }
+
+    return tcp_local_db(rcu_dereference(tcp_db));
+}
+
+/* Fast descriptor lookup - caller must be in an RCU read-side section */
+static const struct tcp_pack_entry *tcp_find_descriptor(const struct tcp_cgroup *cg,
+                                                        int syscall_nr)
+{
+    const struct tcp_descriptor_db *db;
+
+    db = tcp_policy_db(cg);
+    if (unlikely(!db || (unsigned int)syscall_nr >= NR_syscalls)) {
+        return &tcp_safe_entry;
+    }
+
+    return db->by_syscall[array_index_nospec(syscall_nr, NR_syscalls)];
+}
+
+/*
+ * Hot reload: /proc/tcp_kernel_descriptors accepts a complete descriptor
+ * pack in a single write() and swaps it in atomically.
+ */
+static ssize_t tcp_db_proc_write(struct file *file, const char __user *buf,
+                                 size_t len, loff_t *ppos)
+{
+    struct tcp_descriptor_db *db;
+    void *data;
+
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+
+    if (len > TCP_PACK_MAX_SIZE) {
+        return -E2BIG;
+    }
+
+    data = vmemdup_user(buf, len);
+    if (IS_ERR(data)) {
+        return PTR_ERR(data);
+    }
+
+    db = tcp_build_db(data, len);
+    kvfree(data);
+    if (IS_ERR(db)) {
+        return PTR_ERR(db);
+    }
+
+    tcp_install_db(db);
+    pr_info("TCP: Descriptor database reloaded (version %u, %u descriptors)\n",
+            db->version, db->count);
+
+    return len;
+}
+
+static const struct proc_ops tcp_db_proc_ops = {
+    .proc_write = tcp_db_proc_write,
+    .proc_lseek = noop_llseek,
+};
+
+/*
+ * /proc/tcp_kernel_cgroups: one line per tracked cgroup. A write of
+ * struct tcp_cgroup_policy, optionally followed by a descriptor pack,
+ * sets or clears that cgroup's policy.
+ */
+static int tcp_cgroup_show(struct seq_file *m, void *v)
+{
+    const struct tcp_descriptor_db *db;
+    struct tcp_cgroup_stats sum;
+    struct tcp_cgroup *cg;
+    int bkt, cpu;
+
+    seq_printf(m, "# cgroup_id checks blocked events policy\n");
+
+    rcu_read_lock();
+    hash_for_each_rcu(tcp_cgroups, bkt, cg, node) {
+        memset(&sum, 0, sizeof(sum));
+        for_each_possible_cpu(cpu) {
+            const struct tcp_cgroup_stats *s = per_cpu_ptr(cg->stats, cpu);
+
+            sum.total_checks += READ_ONCE(s->total_checks);
+            sum.blocked_operations += READ_ONCE(s->blocked_operations);
+            sum.security_events += READ_ONCE(s->security_events);
+        }
+
+        db = rcu_dereference(cg->db);
+        seq_printf(m, "%llu %llu %llu %llu ", cg->id, sum.total_checks,
+                   sum.blocked_operations, sum.security_events);
+        if (db) {
+            seq_printf(m, "%u\n", db->count);
+        } else {
+            seq_printf(m, "-\n");
+        }
+    }
+    rcu_read_unlock();
+
+    return 0;
+}
+
+static int tcp_cgroup_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tcp_cgroup_show, NULL);
+}
+
+static ssize_t tcp_cgroup_write(struct file *file, const char __user *buf,
+                                size_t len, loff_t *ppos)
+{
+    struct tcp_descriptor_db *db = NULL, *old = NULL;
+    struct tcp_cgroup_policy hdr;
+    struct tcp_cgroup *cg, *new;
+    void *data;
+
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+
+    if (!tcp_cgroups_supported()) {
+        return -EOPNOTSUPP;
+    }
+
+    if (len < sizeof(hdr)) {
+        return -EINVAL;
+    }
+
+    if (copy_from_user(&hdr, buf, sizeof(hdr))) {
+        return -EFAULT;
+    }
+
+    if (!hdr.cgroup_id || hdr.reserved || hdr.pack_size != len - sizeof(hdr)) {
+        return -EINVAL;
+    }
+
+    if (hdr.pack_size > TCP_PACK_MAX_SIZE) {
+        return -E2BIG;
+    }
+
+    if (hdr.pack_size) {
+        data = vmemdup_user(buf + sizeof(hdr), hdr.pack_size);
+        if (IS_ERR(data)) {
+            return PTR_ERR(data);
+        }
+
+        db = tcp_build_db(data, hdr.pack_size);
+        kvfree(data);
+        if (IS_ERR(db)) {
+            return PTR_ERR(db);
+        }
+    }
+
+    new = tcp_cgroup_alloc(hdr.cgroup_id, GFP_KERNEL);
+    if (!new) {
+        kvfree(db);
+        return -ENOMEM;
+    }
+
+    mutex_lock(&tcp_db_mutex);
+    spin_lock(&tcp_cgroup_lock);
+    cg = tcp_cgroup_find(hdr.cgroup_id);
+    if (!cg && db) {
+        hash_add_rcu(tcp_cgroups, &new->node, new->id);
+        atomic_inc(&tcp_cgroup_count);
+        cg = new;
+        new = NULL;
+    }
+    if (cg) {
+        tcp_decision_invalidate();
+        old = rcu_replace_pointer(cg->db, db, lockdep_is_held(&tcp_cgroup_lock));
+    }
+    spin_unlock(&tcp_cgroup_lock);
+
+    tcp_cgroup_policies += (db != NULL) - (old != NULL);
+    tcp_cgroup_update_monitored();
+    mutex_unlock(&tcp_db_mutex);
+
+    if (new) {
+        tcp_cgroup_free(new);
+    }
+    if (old) {
+        kvfree_rcu(old, rcu);
+    }
+
+    if (db) {
+        pr_info("TCP: Cgroup %llu policy set (%u descriptors)\n",
+                hdr.cgroup_id, db->count);
+    } else {
+        pr_info("TCP: Cgroup %llu policy cleared\n", hdr.cgroup_id);
+    }
+
+    return len;
+}
+
+static const struct proc_ops tcp_cgroup_proc_ops = {
+    .proc_open = tcp_cgroup_open,
+    .proc_read = seq_read,
+    .proc_write = tcp_cgroup_write,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
+/*
+ * Execution context
+ *
+ * The credential half of the context mask (TCP_CTX_USER or TCP_CTX_ADMIN)
+ * only changes when the task's credentials do. In LSM builds it is cached
+ * in the task security blob and cleared from the cred_prepare and
+ * bprm_committed_creds hooks, so the check is a byte load; creds
+ * temporarily swapped in with override_creds() are never cached. The
+ * container bit is a single pointer compare against init_nsproxy and is
+ * evaluated live, which keeps it correct across setns() and unshare()
+ * without any invalidation.
+ */
+static inline u8 tcp_cred_context(const struct cred *cred)
+{
+    return cred->uid.val == 0 ? TCP_CTX_ADMIN : TCP_CTX_USER;
+}
+
+#ifdef TCP_HAVE_LSM
+static bool tcp_lsm_registered __ro_after_init;
+
+struct tcp_task_ctx {
+    u8 cred_context;             /* 0 until computed */
+};
+
+static struct lsm_blob_sizes tcp_blob_sizes __ro_after_init = {
+    .lbs_task = sizeof(struct tcp_task_ctx),
+};
+
+static inline struct tcp_task_ctx *tcp_task_ctx(const struct task_struct *task)
+{
+    return task->security + tcp_blob_sizes.lbs_task;
+}
+
+static u8 tcp_current_cred_context(void)
+{
+    struct tcp_task_ctx *tctx;
+
+    /* No blob without registration; overridden creds are transient */
+    if (unlikely(!tcp_lsm_registered || current_cred() != current_real_cred())) {
+        return tcp_cred_context(current_cred());
+    }
+
+    tctx = tcp_task_ctx(current);
+    if (unlikely(!tctx->cred_context)) {
+        tctx->cred_context = tcp_cred_context(current_cred());
+    }
+
+    return tctx->cred_context;
+}
+
+static void tcp_task_ctx_invalidate(void)
+{
+    tcp_task_ctx(current)->cred_context = 0;
+}
+#else
+static inline u8 tcp_current_cred_context(void)
+{
+    return tcp_cred_context(current_cred());
+}
+#endif
+
+/* Context mask of the current task */
+static u8 tcp_current_context(void)
+{
+    u8 current_context = tcp_current_cred_context();
+    
+    /* Check if in container (simplified check) */
+    if (current->nsproxy != &init_nsproxy) {
+        current_context |= TCP_CTX_CONTAINER;
+    }
+    
+    return current_context;
+}
+
+/*
+ * Decision cache
+ *
+ * Once the descriptor is known, the outcome of analysing a monitored
+ * call depends only on that descriptor, the caller's context mask and
+ * the security level. Each CPU keeps a small direct-mapped table of
+ * recent outcomes, indexed by (task, descriptor) and tagged with the
+ * context mask and tcp_decision_gen. A worker that repeats execve or
+ * unlink replays its last outcome instead of evaluating the flags
+ * again. A module cannot add state to task_struct, so entries are kept
+ * per CPU, where a task mostly stays. The outcome does not depend on
+ * the task, so an entry left by an exited task whose address is reused
+ * is still correct. Any database publication, cgroup policy change or
+ * level change bumps the generation, which drops every entry at once.
+ * Descriptor pointers are only compared, never dereferenced, so a
+ * stale entry never touches freed memory.
+ */
+#define TCP_DECISION_BITS       6
+
+#define TCP_DECIDE_VALID            (1 << 0)
+#define TCP_DECIDE_CONTEXT_DENIED   (1 << 1)
+#define TCP_DECIDE_CRITICAL         (1 << 2)
+#define TCP_DECIDE_PARANOID_DENIED  (1 << 3)
+#define TCP_DECIDE_DESTRUCTIVE      (1 << 4)
+
+static bool decision_cache = true;
+module_param(decision_cache, bool, 0644);
+MODULE_PARM_DESC(decision_cache, "Cache per-task analysis outcomes of monitored syscalls");
+
+struct tcp_decision {
+    const struct task_struct *task;
+    const struct tcp_pack_entry *desc;
+    u32 generation;
+    u8 context;
+    u8 outcome;                  /* TCP_DECIDE_*, 0 for an empty slot */
+};
+
+struct tcp_decision_table {
+    struct tcp_decision slots[1 << TCP_DECISION_BITS];
+};
+
+static DEFINE_PER_CPU(struct tcp_decision_table, tcp_cpu_decisions);
+
+/* Evaluate descriptor flags for a caller in the given context */
+static u8 tcp_decide(const struct tcp_pack_entry *desc, u8 context)
+{
+    u8 outcome = TCP_DECIDE_VALID;
+    
+    if (!(desc->context_mask & context)) {
+        return outcome | TCP_DECIDE_CONTEXT_DENIED;
+    }
+    
+    if (desc->security_flags & TCP_FLAG_CRITICAL) {
+        outcome |= TCP_DECIDE_CRITICAL;
+        
+        /* In paranoid mode, block all critical operations from non-root */
+        if (static_branch_unlikely(&tcp_paranoid_key) && !(context & TCP_CTX_ADMIN)) {
+            return outcome | TCP_DECIDE_PARANOID_DENIED;
+        }
+    }
+    
+    if (desc->security_flags & TCP_FLAG_DESTRUCTIVE) {
+        outcome |= TCP_DECIDE_DESTRUCTIVE;
+    }
+    
+    return outcome;
+}
+
+/* Outcome for the current task, from the cache when still valid */
+static u8 tcp_decision(const struct tcp_pack_entry *desc)
+{
+    struct tcp_decision_table *table;
+    struct tcp_decision *d;
+    u8 context = tcp_current_context();
+    u32 generation;
+    u8 outcome;
+    
+    if (!READ_ONCE(decision_cache)) {
+        return tcp_decide(desc, context);
+    }
+    
+    /*
+     * desc came from the database pointer; pairs with the bump before
+     * publication, so a new database implies the new generation.
+     */
+    smp_rmb();
+    generation = atomic_read(&tcp_decision_gen);
+    
+    table = get_cpu_ptr(&tcp_cpu_decisions);
+    d = &table->slots[hash_long((unsigned long)current ^ (unsigned long)desc,
+                                TCP_DECISION_BITS)];
+    if (d->outcome && d->task == current && d->desc == desc &&
+        d->generation == generation && d->context == context) {
+        outcome = d->outcome;
+        put_cpu_ptr(&tcp_cpu_decisions);
+        tcp_stat_inc(decision_hits);
+        return outcome;
+    }
+    
+    outcome = tcp_decide(desc, context);
+    d->task = current;
+    d->desc = desc;
+    d->generation = generation;
+    d->context = context;
+    d->outcome = outcome;
+    put_cpu_ptr(&tcp_cpu_decisions);
+    tcp_stat_inc(decision_misses);
+    
+    return outcome;
+}
+
+/*
+ * Security event ring
+ *
+ * Events are written as fixed-size binary records into per-CPU relay
+ * buffers, which userspace drains in batches from debugfs. Writers never
+ * take a lock; when a consumer falls behind, new records are dropped and
+ * counted rather than overwriting unread data. printk output is only
+ * produced in the optional, rate-limited debug mode.
+ */
+#define TCP_EVENT_SUBBUF_SIZE   (16 * 1024)
+#define TCP_EVENT_SUBBUFS       8
+
+static bool log_events;
+module_param(log_events, bool, 0644);
+MODULE_PARM_DESC(log_events, "Also log security events via rate-limited printk (debug)");
+
+static struct rchan *tcp_event_chan;
+static struct dentry *tcp_debugfs_dir;
+
+static struct dentry *tcp_relay_create_file(const char *filename,
+                                            struct dentry *parent,
+                                            umode_t mode,
+                                            struct rchan_buf *buf,
+                                            int *is_global)
+{
+    return debugfs_create_file(filename, mode, parent, buf,
+                               &relay_file_operations);
+}
+
+static int tcp_relay_remove_file(struct dentry *dentry)
+{
+    debugfs_remove(dentry);
+    return 0;
+}
+
+/* Called on the writing CPU when a sub-buffer fills up */
+static int tcp_relay_subbuf_start(struct rchan_buf *buf, void *subbuf,
+                                  void *prev_subbuf, size_t prev_padding)
+{
+    if (relay_buf_full(buf)) {
+        tcp_stat_inc(events_dropped);
+        return 0;  /* Drop instead of overwriting unread records */
+    }
+
+    return 1;
+}
+
+static const struct rchan_callbacks tcp_relay_callbacks = {
+    .subbuf_start = tcp_relay_subbuf_start,
+    .create_buf_file = tcp_relay_create_file,
+    .remove_buf_file = tcp_relay_remove_file,
+};
+
+static int tcp_events_init(void)
+{
+    tcp_debugfs_dir = debugfs_create_dir("tcp_kernel", NULL);
+    if (IS_ERR(tcp_debugfs_dir)) {
+        tcp_debugfs_dir = NULL;
+        return -ENODEV;
+    }
+
+    tcp_event_chan = relay_open("events", tcp_debugfs_dir,
+                                TCP_EVENT_SUBBUF_SIZE, TCP_EVENT_SUBBUFS,
+                                &tcp_relay_callbacks, NULL);
+    if (!tcp_event_chan) {
+        debugfs_remove_recursive(tcp_debugfs_dir);
+        tcp_debugfs_dir = NULL;
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+static void tcp_events_exit(void)
+{
+    if (tcp_event_chan) {
+        relay_close(tcp_event_chan);
+        tcp_event_chan = NULL;
+    }
+    debugfs_remove_recursive(tcp_debugfs_dir);
+    tcp_debugfs_dir = NULL;
+}
+
+/* Record a security event for the current task */
+static void tcp_emit_event(u8 type, u8 verdict, int syscall_nr,
+                           const struct tcp_pack_entry *desc)
+{
+    struct tcp_event_record rec;
+
+    if (log_events) {
+        pr_info_ratelimited("TCP: %s event - syscall %d (PID %d, CMD %s)%s\n",
+                            type == TCP_EVENT_CONTEXT_DENIED ? "Context" :
+                            type == TCP_EVENT_CRITICAL ? "Critical" :
+                            "Destructive",
+                            syscall_nr, current->pid, current->comm,
+                            verdict == TCP_VERDICT_BLOCKED ? " blocked" : "");
+    }
+
+    if (!tcp_event_chan) {
+        return;
+    }
+
+    rec.timestamp_ns = ktime_get_ns();
+    rec.pid = current->pid;
+    rec.uid = from_kuid(&init_user_ns, current_uid());
+    rec.syscall_nr = syscall_nr;
+    rec.security_flags = desc->security_flags;
+    rec.type = type;
+    rec.verdict = verdict;
+    memcpy(rec.comm, current->comm, sizeof(rec.comm));
+
+    /* Per-CPU buffer; only syscall context writes, so no irq masking */
+    preempt_disable();
+    __relay_write(tcp_event_chan, &rec, sizeof(rec));
+    preempt_enable();
+}
+
+/* Ratio for a CPU seeing rate safe calls per second */
+static u32 tcp_sample_ratio_for(u64 rate)
+{
+    u32 threshold = READ_ONCE(sample_auto_rate);
+    u64 ratio = max(READ_ONCE(sample_ratio), 1U);
+
+    if (threshold && rate > threshold) {
+        ratio = max(ratio, div64_u64(rate + threshold - 1, threshold));
+    }
+
+    return min_t(u64, ratio, TCP_SAMPLE_MAX_RATIO);
+}
+
+/* End of a sampling interval: re-evaluate the ratio and re-arm */
+static noinline u32 tcp_sample_refill(void)
+{
+    struct tcp_sample_state *ss;
+    u64 now, elapsed;
+    u32 weight;
+
+    preempt_disable();
+    ss = this_cpu_ptr(&tcp_cpu_sample);
+    weight = ss->ratio ?: 1;
+
+    ss->window_calls += ss->interval ?: 1;
+    now = local_clock();
+    elapsed = now - ss->window_start;
+    if (elapsed >= TCP_SAMPLE_WINDOW_NS) {
+        ss->ratio = tcp_sample_ratio_for(div64_u64(ss->window_calls * NSEC_PER_SEC,
+                                                   elapsed));
+        ss->window_start = now;
+        ss->window_calls = 0;
+    } else if (!ss->ratio) {
+        ss->ratio = tcp_sample_ratio_for(0);
+    }
+    /* At N = 1 the interval only paces the rate measurement */
+    ss->interval = ss->ratio > 1 ? ss->ratio : TCP_SAMPLE_PROBE_CALLS;
+    ss->countdown = ss->interval;
+    preempt_enable();
+
+    return weight;
+}
+
+/* Will this CPU's next safe call end an interval and be timed? */
+static __always_inline bool tcp_sample_due(void)
+{
+    return static_branch_unlikely(&tcp_sample_key) &&
+           this_cpu_read(tcp_cpu_sample.countdown) <= 1;
+}
+
+/*
+ * Weight of this safe call: 0 when it is skipped. *timed is set for the
+ * call that ends an interval, the only one whose latency is recorded.
+ */
+static __always_inline u32 tcp_sample_tick(bool *timed)
+{
+    *timed = false;
+    if (!static_branch_unlikely(&tcp_sample_key)) {
+        return 1;
+    }
+    if (likely(this_cpu_dec_return(tcp_cpu_sample.countdown) > 0)) {
+        return this_cpu_read(tcp_cpu_sample.ratio) == 1;
+    }
+    *timed = true;
+    return tcp_sample_refill();
+}
+
+/*
+ * Syscall profile
+ *
+ * With profile=1 every analysed operation counts one hit for its syscall
+ * in a per-CPU array, safe fast-path calls included, so
+ * /proc/tcp_kernel_profile can show which syscalls dominate on this host
+ * and "relayout" can reorder the descriptor table to match. Off, the
+ * hook is a patched-out branch.
+ */
+struct tcp_profile {
+    u64 hits[NR_syscalls];
+};
+
+static DEFINE_STATIC_KEY_FALSE(tcp_profile_key);
+static struct tcp_profile __percpu *tcp_profile;
+
+static __always_inline void tcp_profile_hit(int syscall_nr)
+{
+    if (static_branch_unlikely(&tcp_profile_key) &&
+        (unsigned int)syscall_nr < NR_syscalls) {
+        this_cpu_inc(tcp_profile->hits[array_index_nospec(syscall_nr, NR_syscalls)]);
+    }
+}
+
+/*
+ * Act on the outcome of a non-safe descriptor: count it, emit its events
+ * and return -EPERM when the operation should be denied.
+ */
+static int tcp_apply_outcome(int syscall_nr, const struct tcp_pack_entry *desc,
+                             struct tcp_cgroup *cg, u8 outcome)
+{
+    /* Validate execution context */
+    if (outcome & TCP_DECIDE_CONTEXT_DENIED) {
+        tcp_emit_event(TCP_EVENT_CONTEXT_DENIED, TCP_VERDICT_BLOCKED,
+                       syscall_nr, desc);
+        tcp_stat_inc(blocked_operations);
+        tcp_cgroup_stat_inc(cg, blocked_operations);
+        return -EPERM;
+    }
+    
+    /* Check for critical operations */
+    if (outcome & TCP_DECIDE_CRITICAL) {
+        tcp_stat_inc(security_events);
+        tcp_cgroup_stat_inc(cg, security_events);
+        
+        /* Paranoid mode blocks critical operations from non-root */
+        if (outcome & TCP_DECIDE_PARANOID_DENIED) {
+            tcp_emit_event(TCP_EVENT_CRITICAL, TCP_VERDICT_BLOCKED,
+                           syscall_nr, desc);
+            tcp_stat_inc(blocked_operations);
+            tcp_cgroup_stat_inc(cg, blocked_operations);
+            return -EPERM;
+        }
+        
+        tcp_emit_event(TCP_EVENT_CRITICAL, TCP_VERDICT_ALLOWED,
+                       syscall_nr, desc);
+    }
+    
+    /* Record destructive operations */
+    if (outcome & TCP_DECIDE_DESTRUCTIVE) {
+        tcp_emit_event(TCP_EVENT_DESTRUCTIVE, TCP_VERDICT_ALLOWED,
+                       syscall_nr, desc);
+        tcp_stat_inc(security_events);
+        tcp_cgroup_stat_inc(cg, security_events);
+    }
+    
+    return 0;
+}
+
+/*
+ * TCP security analysis of one operation against its descriptor. Returns
+ * -EPERM when the operation should be denied; only enforcing backends
+ * act on that. start is the local_clock() time before the descriptor
+ * lookup. Callers must pass one whenever the descriptor may be non-safe;
+ * for a safe one it is only needed when tcp_sample_due() and may be 0
+ * otherwise. Caller must be in an RCU read-side section.
+ */
+static int tcp_analyze_descriptor(int syscall_nr, const struct tcp_pack_entry *desc,
+                                  struct tcp_cgroup *cg, u64 start)
+{
+    enum tcp_lat_path path = TCP_LAT_MISS;
+    bool timed;
+    int ret = 0;
+    u32 weight;
+    
+    if (!static_branch_likely(&tcp_enabled_key)) {
+        return 0;
+    }
+    
+    tcp_profile_hit(syscall_nr);
+    
+    /* Fast path for safe operations (unknown syscalls hit the safe sentinel) */
+    if (desc->security_flags & TCP_FLAG_SAFE) {
+        weight = tcp_sample_tick(&timed);
+        if (likely(!timed)) {
+            if (weight) {
+                tcp_stat_inc(total_checks);
+                tcp_stat_inc(fast_path_hits);
+            }
+            return 0;
+        }
+        tcp_stat_add(total_checks, weight);
+        tcp_stat_add(fast_path_hits, weight);
+        if (unlikely(!start)) {
+            return 0;  /* Migrated since the caller checked */
+        }
+        path = TCP_LAT_HIT;
+        goto out;
+    }
+    
+    tcp_stat_inc(total_checks);
+    tcp_cgroup_stat_inc(cg, total_checks);
+    
+    ret = tcp_apply_outcome(syscall_nr, desc, cg, tcp_decision(desc));
+    if (ret) {
+        path = TCP_LAT_BLOCKED;
+    }
+    
+out:
+    /* local_clock() is per-CPU; clamp if the task migrated mid-analysis */
+    tcp_latency_add(&tcp_cpu_latency, path, max_t(s64, local_clock() - start, 0));
+    return ret;
+}
+
+/* Policy engine entry for layered modules (tcp_engine.h) */
+int tcp_engine_check(const struct tcp_pack_entry *desc)
+{
+    tcp_stat_inc(total_checks);
+    if (desc->security_flags & TCP_FLAG_SAFE) {
+        tcp_stat_inc(fast_path_hits);
+        return 0;
+    }
+    
+    return tcp_apply_outcome(desc->syscall_nr, desc, NULL,
+                             tcp_decide(desc, tcp_current_context()));
+}
+EXPORT_SYMBOL_GPL(tcp_engine_check);
+
+/*
+ * eBPF policy entry for layered modules (tcp_engine.h). Allows on its
+ * own; a BPF fmod_ret program attached here replaces the return value.
+ */
+noinline int tcp_engine_bpf_check(const struct tcp_pack_entry *desc)
+{
+    return 0;
+}
+ALLOW_ERROR_INJECTION(tcp_engine_bpf_check, ERRNO);
+EXPORT_SYMBOL_GPL(tcp_engine_bpf_check);
+
+/* Analysis at generic syscall entry */
+static int tcp_analyze_syscall(int syscall_nr)
+{
+    u64 start = tcp_sample_due() ? local_clock() : 0;
+    struct tcp_cgroup *cg;
+    int ret;
+    
+    rcu_read_lock();
+    if (likely(!tcp_syscall_monitored(syscall_nr))) {
+        ret = tcp_analyze_descriptor(syscall_nr, &tcp_safe_entry, NULL, start);
+    } else {
+        /* Monitored: the descriptor may not be safe, so always timed */
+        start = start ?: local_clock();
+        cg = tcp_cgroup_current();
+        ret = tcp_analyze_descriptor(syscall_nr, tcp_find_descriptor(cg, syscall_nr),
+                                     cg, start);
+    }
+    rcu_read_unlock();
+    
+    return ret;
+}
+
+/*
+ * Syscall attach backends
+ *
+ * The LSM backend, available when built into the kernel, is preferred:
+ * it runs only on the hooks that guard monitored operations and fails
+ * them with the analysis result. The remaining backends feed every
+ * syscall number into tcp_analyze_syscall() and can only observe: the
+ * raw_syscalls:sys_enter tracepoint, ftrace on the syscall dispatcher
+ * and, as the last-resort fallback, the int3-based kprobe on
+ * do_syscall_64.
+ */
+struct tcp_attach_backend {
+    const char *name;
+    int (*attach)(void);
+    void (*detach)(void);
+    bool enforcing;              /* Denials fail the operation */
+};
+
+static char *attach = "auto";
+module_param(attach, charp, 0444);
+MODULE_PARM_DESC(attach, "Syscall attach backend: auto, lsm, tracepoint, fentry or kprobe");
+
+/*
+ * LSM backend. The hooks are registered at boot and stay registered;
+ * attach and detach only switch whether they evaluate anything.
+ */
+#ifdef TCP_HAVE_LSM
+static bool tcp_lsm_active;
+
+static int tcp_lsm_check(enum tcp_hook hook)
+{
+    const struct tcp_descriptor_db *db;
+    struct tcp_cgroup *cg;
+    u64 start;
+    int ret;
+
+    if (!READ_ONCE(tcp_lsm_active)) {
+        return 0;
+    }
+
+    /* The hooks guard monitored operations only, so always timed */
+    start = local_clock();
+    rcu_read_lock();
+    cg = tcp_cgroup_current();
+    db = tcp_policy_db(cg);
+    ret = tcp_analyze_descriptor(tcp_hook_syscalls[hook],
+                                 db ? db->by_hook[hook] : &tcp_safe_entry, cg, start);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int tcp_lsm_bprm_check(struct linux_binprm *bprm)
+{
+    return tcp_lsm_check(TCP_HOOK_EXEC);
+}
+
+static int tcp_lsm_inode_unlink(struct inode *dir, struct dentry *dentry)
+{
+    return tcp_lsm_check(TCP_HOOK_UNLINK);
+}
+
+static int tcp_lsm_kernel_module_request(char *kmod_name)
+{
+    return tcp_lsm_check(TCP_HOOK_MODULE_REQUEST);
+}
+
+static int tcp_lsm_kernel_load_data(enum kernel_load_data_id id, bool contents)
+{
+    if (id != LOADING_MODULE) {
+        return 0;
+    }
+    return tcp_lsm_check(TCP_HOOK_MODULE_LOAD);
+}
+
+static int tcp_lsm_kernel_read_file(struct file *file,
+                                    enum kernel_read_file_id id, bool contents)
+{
+    if (id != READING_MODULE) {
+        return 0;
+    }
+    return tcp_lsm_check(TCP_HOOK_MODULE_LOAD);
+}
+
+/* Context cache maintenance runs whether or not the backend is attached */
+static int tcp_lsm_cred_prepare(struct cred *new, const struct cred *old, gfp_t gfp)
+{
+    tcp_task_ctx_invalidate();
+    return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+static void tcp_lsm_bprm_committed_creds(const struct linux_binprm *bprm)
+#else
+static void tcp_lsm_bprm_committed_creds(struct linux_binprm *bprm)
+#endif
+{
+    tcp_task_ctx_invalidate();
+}
+
+static struct security_hook_list tcp_lsm_hooks[] __ro_after_init = {
+    LSM_HOOK_INIT(cred_prepare, tcp_lsm_cred_prepare),
+    LSM_HOOK_INIT(bprm_committed_creds, tcp_lsm_bprm_committed_creds),
+    LSM_HOOK_INIT(bprm_check_security, tcp_lsm_bprm_check),
+    LSM_HOOK_INIT(inode_unlink, tcp_lsm_inode_unlink),
+    LSM_HOOK_INIT(kernel_module_request, tcp_lsm_kernel_module_request),
+    LSM_HOOK_INIT(kernel_load_data, tcp_lsm_kernel_load_data),
+    LSM_HOOK_INIT(kernel_read_file, tcp_lsm_kernel_read_file),
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+/* Not an upstream LSM, so there is no assigned LSM_ID_* value */
+static const struct lsm_id tcp_lsm_id = {
+    .name = "tcp_kernel",
+    .id = LSM_ID_UNDEF,
+};
+#define TCP_LSM_ID (&tcp_lsm_id)
+#else
+#define TCP_LSM_ID "tcp_kernel"
+#endif
+
+static int __init tcp_lsm_init(void)
+{
+    security_add_hooks(tcp_lsm_hooks, ARRAY_SIZE(tcp_lsm_hooks), TCP_LSM_ID);
+    tcp_lsm_registered = true;
+    pr_info("TCP: LSM hooks registered\n");
+    return 0;
+}
+
+DEFINE_LSM(tcp_kernel) = {
+    .name = "tcp_kernel",
+    .init = tcp_lsm_init,
+    .blobs = &tcp_blob_sizes,
+};
+
+static int tcp_lsm_attach(void)
+{
+    /* Hooks only exist when tcp_kernel is listed in lsm= / CONFIG_LSM */
+    if (!tcp_lsm_registered) {
+        return -ENODEV;
+    }
+
+    WRITE_ONCE(tcp_lsm_active, true);
+    return 0;
+}
+
+static void tcp_lsm_detach(void)
+{
+    WRITE_ONCE(tcp_lsm_active, false);
+    synchronize_rcu();
+}
+#endif
+
+/* Tracepoint backend: raw_syscalls:sys_enter */
+static struct tracepoint *tcp_sys_enter_tp;
+
+static void tcp_sys_enter_probe(void *data, struct pt_regs *regs, long id)
+{
+    tcp_analyze_syscall((int)id);
+}
+
+/* sys_enter is not exported to modules, so look it up by name */
+static void tcp_match_tracepoint(struct tracepoint *tp, void *priv)
+{
+    if (strcmp(tp->name, "sys_enter") == 0) {
+        *(struct tracepoint **)priv = tp;
+    }
+}
+
+static int tcp_tracepoint_attach(void)
+{
+    tcp_sys_enter_tp = NULL;
+    for_each_kernel_tracepoint(tcp_match_tracepoint, &tcp_sys_enter_tp);
+    if (!tcp_sys_enter_tp) {
+        return -ENOENT;
+    }
+
+    return tracepoint_probe_register(tcp_sys_enter_tp,
+                                     (void *)tcp_sys_enter_probe, NULL);
+}
+
+static void tcp_tracepoint_detach(void)
+{
+    tracepoint_probe_unregister(tcp_sys_enter_tp,
+                                (void *)tcp_sys_enter_probe, NULL);
+    tracepoint_synchronize_unregister();
+}
+
+/*
+ * Fentry backend: ftrace on x64_sys_call(regs, nr). do_syscall_64 is
+ * noinstr on current kernels, so the dispatcher it calls is the earliest
+ * traceable point that still receives the syscall number.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0) && \
+    defined(CONFIG_DYNAMIC_FTRACE_WITH_ARGS)
+#define TCP_HAVE_FENTRY 1
+#define TCP_FENTRY_SYMBOL "x64_sys_call"
+
+static void notrace tcp_ftrace_handler(unsigned long ip, unsigned long parent_ip,
+                                       struct ftrace_ops *op,
+                                       struct ftrace_regs *fregs)
+{
+    int bit;
+
+    bit = ftrace_test_recursion_trylock(ip, parent_ip);
+    if (bit < 0) {
+        return;
+    }
+
+    tcp_analyze_syscall((int)ftrace_regs_get_argument(fregs, 1));
+    ftrace_test_recursion_unlock(bit);
+}
+
+static struct ftrace_ops tcp_ftrace_ops = {
+    .func = tcp_ftrace_handler,
+};
+
+static int tcp_fentry_attach(void)
+{
+    int ret;
+
+    ret = ftrace_set_filter(&tcp_ftrace_ops, TCP_FENTRY_SYMBOL,
+                            strlen(TCP_FENTRY_SYMBOL), 1);
+    if (ret) {
+        return ret;
+    }
+
+    ret = register_ftrace_function(&tcp_ftrace_ops);
+    if (ret) {
+        ftrace_set_filter(&tcp_ftrace_ops, NULL, 0, 1);
+    }
+
+    return ret;
+}
+
+static void tcp_fentry_detach(void)
+{
+    unregister_ftrace_function(&tcp_ftrace_ops);
+    ftrace_set_filter(&tcp_ftrace_ops, NULL, 0, 1);
+}
+#else
+static int tcp_fentry_attach(void)
+{
+    return -EOPNOTSUPP;
+}
+
+static void tcp_fentry_detach(void)
+{
+}
+#endif
+
+/* Kprobe backend: int3 breakpoint on do_syscall_64 */
+static struct kprobe tcp_syscall_kprobe = {
+    .symbol_name = "do_syscall_64",
+};
+
+static int tcp_syscall_pre_handler(struct kprobe *p, struct pt_regs *regs)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+    /* do_syscall_64(struct pt_regs *regs, int nr) */
+    tcp_analyze_syscall((int)regs_get_kernel_argument(regs, 1));
+#else
+    /* do_syscall_64(unsigned long nr, struct pt_regs *regs) */
+    tcp_analyze_syscall((int)regs_get_kernel_argument(regs, 0));
+#endif
+    
+    /* A pre-handler cannot fail the syscall; use the lsm backend to enforce */
+    return 0;
+}
+
+static int tcp_kprobe_attach(void)
+{
+    /* A kprobe must be reset before it can be registered again */
+    tcp_syscall_kprobe.addr = NULL;
+    tcp_syscall_kprobe.flags = 0;
+    tcp_syscall_kprobe.pre_handler = tcp_syscall_pre_handler;
+    return register_kprobe(&tcp_syscall_kprobe);
+}
+
+static void tcp_kprobe_detach(void)
+{
+    unregister_kprobe(&tcp_syscall_kprobe);
+}
+
+/* Backends in order of preference for attach=auto */
+static const struct tcp_attach_backend tcp_backends[] = {
+#ifdef TCP_HAVE_LSM
+    { "lsm",        tcp_lsm_attach,        tcp_lsm_detach,        true },
+#endif
+    { "tracepoint", tcp_tracepoint_attach, tcp_tracepoint_detach, false },
+    { "fentry",     tcp_fentry_attach,     tcp_fentry_detach,     false },
+    { "kprobe",     tcp_kprobe_attach,     tcp_kprobe_detach,     false },
+};
+
+#define TCP_BACKEND_KPROBE (&tcp_backends[ARRAY_SIZE(tcp_backends) - 1])
+
+static const struct tcp_attach_backend *tcp_backend;
+
+static int tcp_try_backend(const struct tcp_attach_backend *backend)
+{
+    int ret = backend->attach();
+
+    if (ret) {
+        pr_info("TCP: %s attach unavailable: %d\n", backend->name, ret);
+        return ret;
+    }
+
+    tcp_backend = backend;
+    return 0;
+}
+
+/* Attach using the requested backend, falling back to the kprobe */
+static int tcp_attach_syscalls(void)
+{
+    size_t i;
+
+    if (strcmp(attach, "auto") == 0) {
+        for (i = 0; i < ARRAY_SIZE(tcp_backends); i++) {
+            if (tcp_try_backend(&tcp_backends[i]) == 0) {
+                return 0;
+            }
+        }
+        return -ENODEV;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(tcp_backends); i++) {
+        if (strcmp(attach, tcp_backends[i].name) == 0) {
+            break;
+        }
+    }
+
+    if (i == ARRAY_SIZE(tcp_backends)) {
+        pr_warn("TCP: Unknown attach backend '%s', using kprobe\n", attach);
+    } else if (tcp_try_backend(&tcp_backends[i]) == 0) {
+        return 0;
+    }
+
+    if (&tcp_backends[i] == TCP_BACKEND_KPROBE) {
+        return -ENODEV;
+    }
+
+    return tcp_try_backend(TCP_BACKEND_KPROBE);
+}
+
+static void tcp_detach_syscalls(void)
+{
+    if (tcp_backend) {
+        tcp_backend->detach();
+        tcp_backend = NULL;
+    }
+}
+
+/*
+ * Runtime control. The probe is only registered while the module is
+ * enabled, so writing 0 to /sys/module/tcp_kernel/parameters/enabled
+ * removes it from syscall entry entirely. Parameter writes before init
+ * (insmod arguments) only record the value; init applies it.
+ */
+static DEFINE_MUTEX(tcp_control_mutex);
+static bool tcp_control_live;
+
+static int tcp_arm(void)
+{
+    int ret;
+
+    lockdep_assert_held(&tcp_control_mutex);
+
+    ret = tcp_attach_syscalls();
+    if (ret < 0) {
+        return ret;
+    }
+
+    static_branch_enable(&tcp_enabled_key);
+    return 0;
+}
+
+static void tcp_disarm(void)
+{
+    lockdep_assert_held(&tcp_control_mutex);
+
+    /* Backend detach waits for handlers still running */
+    static_branch_disable(&tcp_enabled_key);
+    tcp_detach_syscalls();
+}
+
+static void tcp_apply_level(int level)
+{
+    if (level >= 2) {
+        static_branch_enable(&tcp_paranoid_key);
+    } else {
+        static_branch_disable(&tcp_paranoid_key);
+    }
+    tcp_decision_invalidate();
+}
+
+static int tcp_param_set_enabled(const char *val, const struct kernel_param *kp)
+{
+    bool enable;
+    int ret;
+
+    ret = kstrtobool(val, &enable);
+    if (ret) {
+        return ret;
+    }
+
+    mutex_lock(&tcp_control_mutex);
+    if (tcp_control_live && enable != tcp_state.enabled) {
+        if (enable) {
+            ret = tcp_arm();
+        } else {
+            tcp_disarm();
+        }
+    }
+    if (!ret) {
+        tcp_state.enabled = enable;
+        if (tcp_control_live) {
+            pr_info("TCP: Monitoring %s\n", enable ? "armed" : "disarmed");
+        }
+    }
+    mutex_unlock(&tcp_control_mutex);
+
+    return ret;
+}
+
+static const struct kernel_param_ops tcp_enabled_ops = {
+    .set = tcp_param_set_enabled,
+    .get = param_get_bool,
+};
+
+module_param_cb(enabled, &tcp_enabled_ops, &tcp_state.enabled, 0644);
+MODULE_PARM_DESC(enabled, "Attach syscall monitoring (0 detaches the probe)");
+
+static int tcp_param_set_level(const char *val, const struct kernel_param *kp)
+{
+    int level;
+    int ret;
+
+    ret = kstrtoint(val, 0, &level);
+    if (ret) {
+        return ret;
+    }
+    if (level < 0 || level > 3) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&tcp_control_mutex);
+    tcp_state.security_level = level;
+    if (tcp_control_live) {
+        tcp_apply_level(level);
+    }
+    mutex_unlock(&tcp_control_mutex);
+
+    return 0;
+}
+
+static const struct kernel_param_ops tcp_level_ops = {
+    .set = tcp_param_set_level,
+    .get = param_get_int,
+};
+
+module_param_cb(security_level, &tcp_level_ops, &tcp_state.security_level, 0644);
+MODULE_PARM_DESC(security_level, "0 minimal, 1 normal, 2 paranoid, 3 learning");
+
+/* Range of sampling ratios currently in effect across CPUs */
+static void tcp_sample_ratios(u32 *min_ratio, u32 *max_ratio)
+{
+    int cpu;
+
+    *min_ratio = U32_MAX;
+    *max_ratio = 1;
+
+    /* Disarmed CPUs keep the ratio they last sampled at */
+    if (!static_key_enabled(&tcp_sample_key)) {
+        *min_ratio = 1;
+        return;
+    }
+
+    for_each_possible_cpu(cpu) {
+        u32 ratio = READ_ONCE(per_cpu_ptr(&tcp_cpu_sample, cpu)->ratio) ?: 1;
+
+        *min_ratio = min(*min_ratio, ratio);
+        *max_ratio = max(*max_ratio, ratio);
+    }
+}
+
+/* Proc filesystem interface */
+static int tcp_proc_show(struct seq_file *m, void *v)
+{
+    const struct tcp_descriptor_db *db;
+    struct tcp_stats stats;
+    u32 ratio_min, ratio_max;
+    u32 i;
+    int node;
+    
+    tcp_stats_snapshot(&stats);
+    
+    seq_printf(m, "TCP Kernel Integration Status\n");
+    seq_printf(m, "============================\n\n");
+    seq_printf(m, "Enabled: %s\n", tcp_state.enabled ? "Yes" : "No");
+    seq_printf(m, "Security Level: %d\n", tcp_state.security_level);
+    seq_printf(m, "Attach Backend: %s%s\n",
+               tcp_backend ? tcp_backend->name : "none",
+               tcp_backend && tcp_backend->enforcing ? " (enforcing)" : "");
+    tcp_sample_ratios(&ratio_min, &ratio_max);
+    seq_printf(m, "Sampling Ratio: 1/%u", ratio_min);
+    if (ratio_max != ratio_min) {
+        seq_printf(m, " to 1/%u", ratio_max);
+    }
+    seq_printf(m, " (configured 1/%u, adaptive above %u/s per CPU)\n",
+               max(READ_ONCE(sample_ratio), 1U), READ_ONCE(sample_auto_rate));
+    seq_printf(m, "\nStatistics%s:\n",
+               ratio_max > 1 ? " (safe-path counts are scaled estimates)" : "");
+    seq_printf(m, "  Total Checks: %llu\n", stats.total_checks);
+    seq_printf(m, "  Fast Path Hits: %llu\n", stats.fast_path_hits);
+    seq_printf(m, "  Blocked Operations: %llu\n", stats.blocked_operations);
+    seq_printf(m, "  Security Events: %llu\n", stats.security_events);
+    seq_printf(m, "  False Positives: %llu\n", stats.false_positives);
+    seq_printf(m, "  Events Dropped: %llu\n", stats.events_dropped);
+    seq_printf(m, "  Untracked Cgroup Checks: %llu\n", stats.cgroup_untracked);
+    seq_printf(m, "  Decision Cache: %llu hits, %llu misses (%llu%% hit rate)%s\n",
+               stats.decision_hits, stats.decision_misses,
+               div64_u64(stats.decision_hits * 100,
+                         max(stats.decision_hits + stats.decision_misses, 1ULL)),
+               READ_ONCE(decision_cache) ? "" : ", disabled");
+    seq_printf(m, "  Tracked Cgroups: %d (%u with policy)\n",
+               atomic_read(&tcp_cgroup_count), READ_ONCE(tcp_cgroup_policies));
+    
+    rcu_read_lock();
+    db = rcu_dereference(tcp_db);
+    if (db && db->replicas) {
+        seq_printf(m, "\nNUMA Nodes:\n");
+        for_each_node_state(node, N_MEMORY) {
+            const struct tcp_descriptor_db *local = db->replicas[node] ?: db;
+
+            tcp_stats_snapshot_node(&stats, node);
+            seq_printf(m, "  Node %d: descriptors on node %d%s, %llu checks, "
+                       "%llu blocked, %llu decision hits\n",
+                       node, tcp_addr_node(local),
+                       local == db ? " (primary)" : "",
+                       stats.total_checks, stats.blocked_operations,
+                       stats.decision_hits);
+        }
+    }
+    seq_printf(m, "\nDescriptor Database (version %u):\n", db ? db->version : 0);
+    for (i = 0; db && i < db->count; i++) {
+        seq_printf(m, "  Syscall %d: flags=0x%04x pattern=%s\n",
+                   db->entries[i].syscall_nr,
+                   db->entries[i].security_flags,
+                   tcp_db_pattern(db, i));
+    }
+    rcu_read_unlock();
+    
+    return 0;
+}
+
+static int tcp_proc_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tcp_proc_show, NULL);
+}
+
+static const struct proc_ops tcp_proc_ops = {
+    .proc_open = tcp_proc_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
+/*
+ * Latency histogram files such as /proc/tcp_kernel_latency: one line per
+ * path with the sample count, p50/p99/p999 in ns (bucket upper bounds)
+ * and the raw bucket counts. The entry's data is the per-CPU histogram.
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 17, 0)
+#define pde_data PDE_DATA
+#endif
+
+static int tcp_latency_show(struct seq_file *m, void *v)
+{
+    struct tcp_latency_hist *hist;
+    int path, bucket;
+
+    hist = kmalloc(sizeof(*hist), GFP_KERNEL);
+    if (!hist) {
+        return -ENOMEM;
+    }
+    tcp_percpu_sum(hist, (struct tcp_latency_hist __percpu *)m->private,
+                   cpu_possible_mask);
+
+    seq_printf(m, "# path count p50_ns p99_ns p999_ns buckets\n");
+    for (path = 0; path < TCP_LAT_NR_PATHS; path++) {
+        const u64 *buckets = hist->buckets[path];
+        u64 count = 0;
+
+        for (bucket = 0; bucket < TCP_LAT_BUCKETS; bucket++) {
+            count += buckets[bucket];
+        }
+
+        seq_printf(m, "%s %llu %llu %llu %llu ", tcp_lat_path_names[path], count,
+                   count ? tcp_latency_quantile(buckets, count, 500) : 0,
+                   count ? tcp_latency_quantile(buckets, count, 990) : 0,
+                   count ? tcp_latency_quantile(buckets, count, 999) : 0);
+        for (bucket = 0; bucket < TCP_LAT_BUCKETS; bucket++) {
+            seq_printf(m, "%s%llu", bucket ? "," : "", buckets[bucket]);
+        }
+        seq_putc(m, '\n');
+    }
+
+    kfree(hist);
+    return 0;
+}
+
+static int tcp_latency_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tcp_latency_show, pde_data(inode));
+}
+
+/* Any write clears the histograms; samples racing with it may survive */
+static ssize_t tcp_latency_write(struct file *file, const char __user *buf,
+                                 size_t len, loff_t *ppos)
+{
+    struct tcp_latency_hist __percpu *hist = pde_data(file_inode(file));
+    int cpu;
+
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+
+    for_each_possible_cpu(cpu) {
+        memset(per_cpu_ptr(hist, cpu), 0, sizeof(struct tcp_latency_hist));
+    }
+
+    return len;
+}
+
+const struct proc_ops tcp_latency_proc_ops = {
+    .proc_open = tcp_latency_open,
+    .proc_read = seq_read,
+    .proc_write = tcp_latency_write,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+EXPORT_SYMBOL_GPL(tcp_latency_proc_ops);
+
+/*
+ * /proc/tcp_kernel_profile lists the profile_top hottest syscalls with
+ * their share of all hits and the global descriptor slot serving them.
+ * Writing "reset" clears the counts. Writing "relayout" rebuilds the
+ * global database with its entries in descending hit order, so the
+ * lookups of the dominant syscalls stay within the first cache lines of
+ * the entry array (eight entries per line); entries never hit keep their
+ * order behind them. Cgroup override databases keep their layout.
+ */
+static bool profile;
+static unsigned int profile_top = 16;
+module_param(profile_top, uint, 0644);
+MODULE_PARM_DESC(profile_top, "Syscalls listed by /proc/tcp_kernel_profile");
+
+struct tcp_profile_rank {
+    u64 hits;
+    u32 index;
+};
+
+/* Hits per syscall summed over all CPUs; caller kvfree()s it */
+static u64 *tcp_profile_snapshot(void)
+{
+    u64 *sum;
+    int cpu, nr;
+
+    sum = kvcalloc(NR_syscalls, sizeof(*sum), GFP_KERNEL);
+    if (!sum) {
+        return NULL;
+    }
+
+    for_each_possible_cpu(cpu) {
+        const struct tcp_profile *p = per_cpu_ptr(tcp_profile, cpu);
+
+        for (nr = 0; nr < NR_syscalls; nr++) {
+            sum[nr] += READ_ONCE(p->hits[nr]);
+        }
+    }
+    return sum;
+}
+
+static int tcp_profile_show(struct seq_file *m, void *v)
+{
+    const struct tcp_descriptor_db *db;
+    const struct tcp_pack_entry *desc;
+    unsigned int rank, top = READ_ONCE(profile_top);
+    u64 *sum, total = 0;
+    int nr, best;
+    u32 slot;
+
+    sum = tcp_profile_snapshot();
+    if (!sum) {
+        return -ENOMEM;
+    }
+    for (nr = 0; nr < NR_syscalls; nr++) {
+        total += sum[nr];
+    }
+
+    seq_printf(m, "# profiling %s, %llu hits\n", READ_ONCE(profile) ? "on" : "off", total);
+    seq_printf(m, "# rank syscall hits permille slot pattern\n");
+
+    rcu_read_lock();
+    db = rcu_dereference(tcp_db);
+    for (rank = 0; rank < top; rank++) {
+        best = -1;
+        for (nr = 0; nr < NR_syscalls; nr++) {
+            if (sum[nr] && (best < 0 || sum[nr] > sum[best])) {
+                best = nr;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+
+        seq_printf(m, "%u %d %llu %llu ", rank + 1, best, sum[best],
+                   div64_u64(sum[best] * 1000, total));
+        desc = db ? db->by_syscall[best] : &tcp_safe_entry;
+        if (desc == &tcp_safe_entry) {
+            seq_printf(m, "- -\n");
+        } else {
+            slot = desc - db->entries;
+            seq_printf(m, "%u %s\n", slot, tcp_db_pattern(db, slot));
+        }
+        sum[best] = 0;
+    }
+    rcu_read_unlock();
+
+    kvfree(sum);
+    return 0;
+}
+
+/* Hottest first; ties keep their current order */
+static int tcp_profile_rank_cmp(const void *a, const void *b)
+{
+    const struct tcp_profile_rank *x = a, *y = b;
+
+    if (x->hits != y->hits) {
+        return x->hits < y->hits ? 1 : -1;
+    }
+    return x->index < y->index ? -1 : 1;
+}
+
+static int tcp_profile_relayout(void)
+{
+    const struct tcp_descriptor_db *db;
+    const struct tcp_pack_entry *old_entries;
+    const struct tcp_pack_meta *old_meta;
+    struct tcp_descriptor_db *new_db;
+    struct tcp_profile_rank *rank;
+    struct tcp_pack_header *hdr;
+    struct tcp_pack_entry *entries;
+    struct tcp_pack_meta *meta;
+    u8 *pack, *old;
+    u32 version, len, i;
+    u64 *sum;
+    int ret;
+
+    sum = tcp_profile_snapshot();
+    rank = kvcalloc(TCP_DB_MAX_DESCRIPTORS, sizeof(*rank), GFP_KERNEL);
+    pack = kvmalloc(TCP_PACK_MAX_SIZE, GFP_KERNEL);
+    old = kvmalloc(TCP_PACK_MAX_SIZE, GFP_KERNEL);
+    if (!sum || !rank || !pack || !old) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    /* Copy the live pack; it was validated when its database was built */
+    rcu_read_lock();
+    db = rcu_dereference(tcp_db);
+    if (!db) {
+        rcu_read_unlock();
+        ret = -ENOENT;
+        goto out;
+    }
+    version = db->version;
+    len = db->pack_len;
+    memcpy(old, db->pack, len);
+    rcu_read_unlock();
+
+    memcpy(pack, old, len);
+    hdr = (struct tcp_pack_header *)pack;
+    old_entries = (const void *)(old + hdr->entries_offset);
+    old_meta = (const void *)(old + hdr->meta_offset);
+    entries = (void *)(pack + hdr->entries_offset);
+    meta = (void *)(pack + hdr->meta_offset);
+
+    for (i = 0; i < hdr->count; i++) {
+        rank[i].hits = sum[old_entries[i].syscall_nr];
+        rank[i].index = i;
+    }
+    sort(rank, hdr->count, sizeof(*rank), tcp_profile_rank_cmp, NULL);
+
+    /* The entry and meta arrays are parallel; permute them together */
+    for (i = 0; i < hdr->count; i++) {
+        entries[i] = old_entries[rank[i].index];
+        meta[i] = old_meta[rank[i].index];
+    }
+    hdr->checksum = crc32_le(0, pack + sizeof(*hdr), len - sizeof(*hdr));
+
+    new_db = tcp_build_db(pack, len);
+    if (IS_ERR(new_db)) {
+        ret = PTR_ERR(new_db);
+        goto out;
+    }
+
+    /* A reload that raced with us wins; its layout can be redone */
+    ret = tcp_replace_db(new_db, version);
+    if (!ret) {
+        pr_info("TCP: Descriptor table laid out by profile\n");
+    }
+
+out:
+    kvfree(old);
+    kvfree(pack);
+    kvfree(rank);
+    kvfree(sum);
+    return ret;
+}
+
+static int tcp_profile_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tcp_profile_show, NULL);
+}
+
+static ssize_t tcp_profile_write(struct file *file, const char __user *ubuf,
+                                 size_t len, loff_t *ppos)
+{
+    char cmd[16];
+    int cpu, ret;
+
+    if (!capable(CAP_SYS_ADMIN)) {
+        return -EPERM;
+    }
+    if (len >= sizeof(cmd)) {
+        return -EINVAL;
+    }
+    if (copy_from_user(cmd, ubuf, len)) {
+        return -EFAULT;
+    }
+    cmd[len] = '\0';
+
+    if (sysfs_streq(cmd, "reset")) {
+        for_each_possible_cpu(cpu) {
+            memset(per_cpu_ptr(tcp_profile, cpu), 0, sizeof(struct tcp_profile));
+        }
+        return len;
+    }
+
+    if (sysfs_streq(cmd, "relayout")) {
+        ret = tcp_profile_relayout();
+        return ret < 0 ? ret : len;
+    }
+
+    return -EINVAL;
+}
+
+static const struct proc_ops tcp_profile_proc_ops = {
+    .proc_open = tcp_profile_open,
+    .proc_read = seq_read,
+    .proc_write = tcp_profile_write,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
+/* The counters exist from init on; before that only the flag is recorded */
+static int tcp_param_set_profile(const char *val, const struct kernel_param *kp)
+{
+    bool on;
+    int ret;
+
+    ret = kstrtobool(val, &on);
+    if (ret) {
+        return ret;
+    }
+
+    mutex_lock(&tcp_control_mutex);
+    profile = on;
+    if (tcp_profile) {
+        if (on) {
+            static_branch_enable(&tcp_profile_key);
+        } else {
+            static_branch_disable(&tcp_profile_key);
+        }
+    }
+    mutex_unlock(&tcp_control_mutex);
+
+    return 0;
+}
+
+static const struct kernel_param_ops tcp_profile_ops = {
+    .set = tcp_param_set_profile,
+    .get = param_get_bool,
+};
+
+module_param_cb(profile, &tcp_profile_ops, &profile, 0644);
+MODULE_PARM_DESC(profile, "Count hits per syscall for /proc/tcp_kernel_profile");
+
+/* Arm the sampling countdown only while a CPU can sample */
+static void tcp_apply_sampling(void)
+{
+    lockdep_assert_held(&tcp_control_mutex);
+
+    if (sample_ratio > 1 || sample_auto_rate) {
+        static_branch_enable(&tcp_sample_key);
+    } else {
+        static_branch_disable(&tcp_sample_key);
+    }
+}
+
+static int tcp_param_set_sampling(const char *val, const struct kernel_param *kp)
+{
+    unsigned int value;
+    int ret;
+
+    ret = kstrtouint(val, 0, &value);
+    if (ret) {
+        return ret;
+    }
+
+    mutex_lock(&tcp_control_mutex);
+    WRITE_ONCE(*(unsigned int *)kp->arg, value);
+    if (tcp_control_live) {
+        tcp_apply_sampling();
+    }
+    mutex_unlock(&tcp_control_mutex);
+
+    return 0;
+}
+
+static const struct kernel_param_ops tcp_sampling_ops = {
+    .set = tcp_param_set_sampling,
+    .get = param_get_uint,
+};
+
+module_param_cb(sample_ratio, &tcp_sampling_ops, &sample_ratio, 0644);
+MODULE_PARM_DESC(sample_ratio, "Account 1 in N safe syscalls (1 = exact)");
+module_param_cb(sample_auto_rate, &tcp_sampling_ops, &sample_auto_rate, 0644);
+MODULE_PARM_DESC(sample_auto_rate,
+                 "Per-CPU safe syscalls/s above which sampling adapts (0 = never)");
+
+/*
+ * Shared statistics page
+ *
+ * Monitoring agents mmap /dev/tcp_kernel_stats instead of parsing
+ * /proc/tcp_kernel. A delayed work is the only writer: it folds the
+ * per-CPU counters and histograms into struct tcp_stats_page under an
+ * open-coded sequence count (a seqcount_t's layout is not ABI), so
+ * readers get a consistent copy without any syscall.
+ */
+static unsigned int stats_interval_ms = 1000;
+module_param(stats_interval_ms, uint, 0644);
+MODULE_PARM_DESC(stats_interval_ms, "Statistics page refresh period in ms (min 10)");
+
+static struct tcp_stats_page *tcp_stats_page;
+static struct tcp_latency_hist tcp_stats_hist;  /* Worker scratch */
+
+static void tcp_stats_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(tcp_stats_work, tcp_stats_work_fn);
+
+static unsigned long tcp_stats_interval(void)
+{
+    return msecs_to_jiffies(max(READ_ONCE(stats_interval_ms), 10U));
+}
+
+static void tcp_stats_page_update(struct tcp_stats_page *page)
+{
+    const struct tcp_descriptor_db *db;
+    struct tcp_stats stats;
+    u32 ratio_min, ratio_max;
+    u32 db_version = 0, db_count = 0;
+    u32 seq;
+
+    tcp_stats_snapshot(&stats);
+    tcp_percpu_sum(&tcp_stats_hist, &tcp_cpu_latency, cpu_possible_mask);
+    tcp_sample_ratios(&ratio_min, &ratio_max);
+
+    rcu_read_lock();
+    db = rcu_dereference(tcp_db);
+    if (db) {
+        db_version = db->version;
+        db_count = db->count;
+    }
+    rcu_read_unlock();
+
+    seq = page->seq;
+    WRITE_ONCE(page->seq, seq + 1);
+    smp_wmb();
+
+    page->interval_ms = jiffies_to_msecs(tcp_stats_interval());
+    page->update_ns = ktime_get_ns();
+    page->enabled = READ_ONCE(tcp_state.enabled);
+    page->security_level = READ_ONCE(tcp_state.security_level);
+    page->db_version = db_version;
+    page->db_count = db_count;
+    page->sample_ratio_min = ratio_min;
+    page->sample_ratio_max = ratio_max;
+    page->total_checks = stats.total_checks;
+    page->fast_path_hits = stats.fast_path_hits;
+    page->blocked_operations = stats.blocked_operations;
+    page->security_events = stats.security_events;
+    page->false_positives = stats.false_positives;
+    page->events_dropped = stats.events_dropped;
+    memcpy(page->latency, tcp_stats_hist.buckets, sizeof(page->latency));
+    page->decision_hits = stats.decision_hits;
+    page->decision_misses = stats.decision_misses;
+
+    smp_wmb();
+    WRITE_ONCE(page->seq, seq + 2);
+}
+
+static void tcp_stats_work_fn(struct work_struct *work)
+{
+    tcp_stats_page_update(tcp_stats_page);
+    tcp_cgroup_prune();
+    schedule_delayed_work(&tcp_stats_work, tcp_stats_interval());
+}
+
+static int tcp_stats_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE) {
+        return -EINVAL;
+    }
+    if (vma->vm_flags & (VM_WRITE | VM_EXEC)) {
+        return -EPERM;
+    }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_mod(vma, VM_DONTEXPAND | VM_DONTDUMP, VM_MAYWRITE | VM_MAYEXEC);
+#else
+    vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+    vma->vm_flags &= ~(VM_MAYWRITE | VM_MAYEXEC);
+#endif
+
+    return remap_pfn_range(vma, vma->vm_start,
+                           virt_to_phys(tcp_stats_page) >> PAGE_SHIFT,
+                           PAGE_SIZE, vma->vm_page_prot);
+}
+
+static const struct file_operations tcp_stats_fops = {
+    .owner = THIS_MODULE,
+    .open = nonseekable_open,
+    .mmap = tcp_stats_mmap,
+};
+
+static struct miscdevice tcp_stats_miscdev = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name = "tcp_kernel_stats",
+    .fops = &tcp_stats_fops,
+    .mode = 0444,
+};
+
+static int tcp_stats_page_init(void)
+{
+    int ret;
+
+    BUILD_BUG_ON(sizeof(struct tcp_stats_page) > PAGE_SIZE);
+
+    tcp_stats_page = (struct tcp_stats_page *)get_zeroed_page(GFP_KERNEL);
+    if (!tcp_stats_page) {
+        return -ENOMEM;
+    }
+    tcp_stats_page->magic = TCP_STATS_MAGIC;
+    tcp_stats_page->version = TCP_STATS_VERSION;
+    tcp_stats_page->size = sizeof(struct tcp_stats_page);
+    tcp_stats_page_update(tcp_stats_page);
+
+    ret = misc_register(&tcp_stats_miscdev);
+    if (ret) {
+        free_page((unsigned long)tcp_stats_page);
+        tcp_stats_page = NULL;
+        return ret;
+    }
+
+    schedule_delayed_work(&tcp_stats_work, tcp_stats_interval());
+    return 0;
+}
+
+/* Mappings hold a module reference, so none remain at exit */
+static void tcp_stats_page_exit(void)
+{
+    cancel_delayed_work_sync(&tcp_stats_work);
+    misc_deregister(&tcp_stats_miscdev);
+    free_page((unsigned long)tcp_stats_page);
+    tcp_stats_page = NULL;
+}
+
+/* Entries are created in order and removed in reverse */
+int tcp_proc_files_create(const struct tcp_proc_file *files, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        if (!proc_create_data(files[i].name, files[i].mode, NULL,
+                              files[i].ops, files[i].data)) {
+            pr_err("TCP: Failed to create /proc/%s\n", files[i].name);
+            tcp_proc_files_remove(files, i);
+            return -ENOMEM;
+        }
+    }
+
+    return 0;
+}
+EXPORT_SYMBOL_GPL(tcp_proc_files_create);
+
+void tcp_proc_files_remove(const struct tcp_proc_file *files, unsigned int count)
+{
+    while (count--) {
+        remove_proc_entry(files[count].name, NULL);
+    }
+}
+EXPORT_SYMBOL_GPL(tcp_proc_files_remove);
+
+static const struct tcp_proc_file tcp_proc_files[] = {
+    { "tcp_kernel",             0444, &tcp_proc_ops },
+    /* Descriptor database hot reload */
+    { "tcp_kernel_descriptors", 0200, &tcp_db_proc_ops },
+    /* Latency histograms, reset by writing to the file */
+    { "tcp_kernel_latency",     0644, &tcp_latency_proc_ops,
+      (void __force *)&tcp_cpu_latency },
+    /* Per-cgroup counters and policy overrides */
+    { "tcp_kernel_cgroups",     0644, &tcp_cgroup_proc_ops },
+    /* Hot-syscall profile, reset and relayout by writing to the file */
+    { "tcp_kernel_profile",     0644, &tcp_profile_proc_ops },
+};
+
+/* Initialize TCP kernel module */
+static int __init tcp_kernel_init(void)
+{
+    struct tcp_descriptor_db *db;
+    int ret;
+    
+    pr_info("TCP: Initializing kernel integration module\n");
+    
+    /* Load the descriptor database from firmware or the built-in defaults */
+    db = tcp_load_initial_db();
+    if (IS_ERR(db)) {
+        pr_err("TCP: Failed to build descriptor database: %ld\n", PTR_ERR(db));
+        return PTR_ERR(db);
+    }
+    tcp_install_db(db);
+    
+    tcp_profile = alloc_percpu(struct tcp_profile);
+    if (!tcp_profile) {
+        tcp_db_free(rcu_replace_pointer(tcp_db, NULL, true));
+        return -ENOMEM;
+    }
+    
+    /* Event ring is optional; monitoring continues without it */
+    ret = tcp_events_init();
+    if (ret < 0) {
+        pr_warn("TCP: Event ring unavailable (%d), events will not be recorded\n",
+                ret);
+    }
+    
+    /* Attach to syscall entry unless loaded with enabled=0 */
+    mutex_lock(&tcp_control_mutex);
+    if (profile) {
+        static_branch_enable(&tcp_profile_key);
+    }
+    tcp_apply_sampling();
+    tcp_apply_level(tcp_state.security_level);
+    ret = tcp_state.enabled ? tcp_arm() : 0;
+    if (ret < 0) {
+        mutex_unlock(&tcp_control_mutex);
+        pr_err("TCP: Failed to attach syscall monitoring: %d\n", ret);
+        goto err_events;
+    }
+    tcp_control_live = true;
+    mutex_unlock(&tcp_control_mutex);
+    
+    /* Status, descriptor reload, latency, cgroup and profile entries */
+    ret = tcp_proc_files_create(tcp_proc_files, ARRAY_SIZE(tcp_proc_files));
+    if (ret < 0) {
+        goto err_detach;
+    }
+    
+    /* Raw counters for monitoring agents */
+    ret = tcp_stats_page_init();
+    if (ret < 0) {
+        pr_err("TCP: Failed to create statistics device: %d\n", ret);
+        goto err_proc;
+    }
+    
+    pr_info("TCP: Kernel integration active (security level %d, %s backend)\n", 
+            tcp_state.security_level, tcp_backend ? tcp_backend->name : "no");
+    pr_info("TCP: Monitoring %u syscall descriptors\n", db->count);
+    pr_info("TCP: Status available at /proc/tcp_kernel and %s\n",
+            TCP_STATS_DEVICE);
+    if (tcp_event_chan) {
+        pr_info("TCP: Events available at /sys/kernel/debug/tcp_kernel/events*\n");
+    }
+    
+    return 0;
+
+err_proc:
+    tcp_proc_files_remove(tcp_proc_files, ARRAY_SIZE(tcp_proc_files));
+err_detach:
+    mutex_lock(&tcp_control_mutex);
+    tcp_control_live = false;
+    if (tcp_state.enabled) {
+        tcp_disarm();
+    }
+    tcp_apply_level(0);
+    mutex_unlock(&tcp_control_mutex);
+err_events:
+    static_branch_disable(&tcp_profile_key);
+    tcp_events_exit();
+    tcp_cgroup_exit();
+    tcp_db_free(rcu_replace_pointer(tcp_db, NULL, true));
+    free_percpu(tcp_profile);
+    return ret;
+}
+
+/* Cleanup TCP kernel module */
+static void __exit tcp_kernel_exit(void)
+{
+    struct tcp_stats stats;
+    
+    pr_info("TCP: Shutting down kernel integration\n");
+    
+    /* Stop the statistics worker and remove its device */
+    tcp_stats_page_exit();
+    
+    /* Remove proc entries; this waits for in-flight reloads */
+    tcp_proc_files_remove(tcp_proc_files, ARRAY_SIZE(tcp_proc_files));
+    
+    /* Detach from syscall entry; later parameter writes are ignored */
+    mutex_lock(&tcp_control_mutex);
+    tcp_control_live = false;
+    if (tcp_state.enabled) {
+        tcp_disarm();
+    }
+    tcp_apply_level(0);
+    mutex_unlock(&tcp_control_mutex);
+    
+    /* Flush and release the event ring */
+    tcp_events_exit();
+    
+    /*
+     * No readers or writers remain once the probe and proc entries are
+     * gone; the rcu_barrier() in tcp_cgroup_exit() also waits for the
+     * replicas of replaced databases to be freed
+     */
+    tcp_cgroup_exit();
+    tcp_db_free(rcu_replace_pointer(tcp_db, NULL, true));
+    
+    /* Nothing samples into the profile once the probe is detached */
+    static_branch_disable(&tcp_profile_key);
+    free_percpu(tcp_profile);
     
     /* Print final statistics */
-    pr_info("TCP: Final stats - Checks: %lld, Events: %lld, Blocked: %lld\n",
-            atomic64_read(&tcp_state.stats.total_checks),
-            atomic64_read(&tcp_state.stats.security_events),
-            atomic64_read(&tcp_state.stats.blocked_operations));
+    tcp_stats_snapshot(&stats);
+    pr_info("TCP: Final stats - Checks: %llu, Events: %llu, Blocked: %llu\n",
+            stats.total_checks, stats.security_events,
+            stats.blocked_operations);
     
     pr_info("TCP: Kernel integration disabled\n");
 }
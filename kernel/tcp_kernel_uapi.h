@@ -0,0 +1,189 @@
+/*
+ * TCP Kernel Integration - Userspace ABI
+ *
+ * Binary structures shared between the tcp_kernel module and userspace
+ * consumers. Everything here is fixed-size and little-endian so that
+ * readers can decode records without any per-kernel knowledge.
+ *
+ * Author: TCP Research Team
+ * License: GPL v2
+ */
+
+#ifndef _TCP_KERNEL_UAPI_H
+#define _TCP_KERNEL_UAPI_H
+
+/* BPF programs get these types from vmlinux.h instead */
+#ifndef __VMLINUX_H__
+#include <linux/types.h>
+#endif
+
+/* TCP Security Flags */
+#define TCP_FLAG_SAFE           0x0001
+#define TCP_FLAG_DESTRUCTIVE    0x0002
+#define TCP_FLAG_FILESYSTEM     0x0004
+#define TCP_FLAG_NETWORK        0x0008
+#define TCP_FLAG_EXECUTION      0x0010
+#define TCP_FLAG_CRITICAL       0x0020
+#define TCP_FLAG_KERNEL         0x0040
+#define TCP_FLAG_PRIVESC        0x0080
+
+/* TCP Context Masks */
+#define TCP_CTX_USER            0x01
+#define TCP_CTX_ADMIN           0x02
+#define TCP_CTX_KERNEL          0x04
+#define TCP_CTX_CONTAINER       0x08
+#define TCP_CTX_ALL             0xFF
+
+/* TCP Privilege Levels */
+#define TCP_PRIV_USER           0
+#define TCP_PRIV_ROOT           1
+#define TCP_PRIV_KERNEL         2
+
+/*
+ * Security event records
+ *
+ * Emitted into per-CPU relay buffers exposed under
+ * /sys/kernel/debug/tcp_kernel/events<cpu>. Records never straddle a
+ * sub-buffer boundary, so a consumer can read() any multiple of
+ * sizeof(struct tcp_event_record) and decode it in place.
+ */
+enum tcp_event_type {
+    TCP_EVENT_CONTEXT_DENIED = 1,   /* Descriptor context mask mismatch */
+    TCP_EVENT_CRITICAL       = 2,   /* TCP_FLAG_CRITICAL operation */
+    TCP_EVENT_DESTRUCTIVE    = 3,   /* TCP_FLAG_DESTRUCTIVE operation */
+};
+
+#define TCP_VERDICT_ALLOWED     0
+#define TCP_VERDICT_BLOCKED     1
+
+struct tcp_event_record {
+    __u64 timestamp_ns;          /* ktime_get_ns() at detection */
+    __u32 pid;                   /* PID of the calling task */
+    __u32 uid;                   /* Real UID of the caller */
+    __s32 syscall_nr;            /* System call number */
+    __u16 security_flags;        /* Descriptor security flags */
+    __u8  type;                  /* enum tcp_event_type */
+    __u8  verdict;               /* TCP_VERDICT_* */
+    char  comm[16];              /* Task command name (TASK_COMM_LEN) */
+};
+
+/*
+ * Descriptor pack
+ *
+ * Versioned, position-independent image of the descriptor database. The
+ * module loads it through request_firmware() at init and accepts it in a
+ * single write() to /proc/tcp_kernel_descriptors for hot reload. The
+ * pack is used in place: the hot entry array is what the syscall path
+ * indexes, while pattern names and per-descriptor checksums live in a
+ * separate cold array and string table that only the status and reload
+ * paths touch.
+ *
+ * Layout (all offsets are from the start of the pack):
+ *
+ *   struct tcp_pack_header
+ *   struct tcp_pack_entry entries[count]   8-byte aligned
+ *   struct tcp_pack_meta  meta[count]      4-byte aligned
+ *   char strtab[strtab_size]               NUL-terminated names
+ *
+ * checksum is crc32_le() with a zero seed over every byte after the
+ * header. The magic is the TCP_MAGIC_CLASSICAL value used by classical
+ * binary descriptors.
+ */
+#define TCP_PACK_MAGIC          0x50435402  /* TCP_MAGIC_CLASSICAL */
+#define TCP_PACK_VERSION        1
+
+struct tcp_pack_header {
+    __u32 magic;                 /* TCP_PACK_MAGIC */
+    __u16 version;               /* TCP_PACK_VERSION */
+    __u16 header_size;           /* sizeof(struct tcp_pack_header) */
+    __u32 total_size;            /* Size of the whole pack in bytes */
+    __u32 checksum;              /* CRC32 of everything after the header */
+    __u32 count;                 /* Number of descriptors */
+    __u32 entries_offset;        /* Hot entry array */
+    __u32 meta_offset;           /* Cold metadata array */
+    __u32 strtab_offset;         /* String table */
+    __u32 strtab_size;           /* String table size in bytes */
+    __u32 reserved;              /* Must be zero */
+};
+
+/* Hot data: everything the syscall path reads, eight entries per cache line */
+struct tcp_pack_entry {
+    __s32 syscall_nr;            /* System call number */
+    __u16 security_flags;        /* TCP_FLAG_* */
+    __u8  context_mask;          /* TCP_CTX_* */
+    __u8  privilege_level;       /* TCP_PRIV_* */
+};
+
+/* Cold data, parallel to the entry array */
+struct tcp_pack_meta {
+    __u32 pattern_offset;        /* Operation pattern, offset into strtab */
+    __u32 checksum;              /* Per-descriptor integrity value */
+};
+
+/*
+ * Per-cgroup policy
+ *
+ * A single write() to /proc/tcp_kernel_cgroups of this header followed by
+ * pack_size bytes of descriptor pack makes that pack the policy of one
+ * cgroup, replacing the global database for its tasks. A header with
+ * pack_size 0 clears the override. cgroup_id is the cgroup v2 ID, the
+ * inode number of the cgroup's directory under /sys/fs/cgroup.
+ */
+struct tcp_cgroup_policy {
+    __u64 cgroup_id;             /* Target cgroup */
+    __u32 pack_size;             /* Bytes of pack that follow, 0 clears */
+    __u32 reserved;              /* Must be zero */
+};
+
+/*
+ * Latency histogram layout, shared by /proc/tcp_kernel_latency and the
+ * statistics page. Bucket b counts samples in [2^b, 2^(b+1)) ns.
+ */
+#define TCP_LAT_BUCKETS         32
+
+enum tcp_lat_path {
+    TCP_LAT_HIT,                 /* Safe fast path */
+    TCP_LAT_MISS,                /* Full analysis, allowed */
+    TCP_LAT_BLOCKED,             /* Full analysis, denied */
+    TCP_LAT_NR_PATHS
+};
+
+/*
+ * Shared statistics page
+ *
+ * TCP_STATS_DEVICE maps one read-only page holding struct tcp_stats_page,
+ * refreshed by the module every interval_ms. seq is odd while an update
+ * is in progress. Readers load seq, retry while it is odd, copy what they
+ * need, then retry if seq changed, with a read barrier after the first
+ * load and before the second. New fields are only ever appended; check
+ * size before reading past the fields you know.
+ */
+#define TCP_STATS_DEVICE        "/dev/tcp_kernel_stats"
+#define TCP_STATS_MAGIC         0x53504354  /* "TCPS" */
+#define TCP_STATS_VERSION       1
+
+struct tcp_stats_page {
+    __u32 magic;                 /* TCP_STATS_MAGIC */
+    __u16 version;               /* TCP_STATS_VERSION */
+    __u16 size;                  /* sizeof(struct tcp_stats_page) */
+    __u32 seq;                   /* Update sequence, odd while writing */
+    __u32 interval_ms;           /* Refresh period */
+    __u64 update_ns;             /* ktime_get_ns() of the last refresh */
+    __u32 enabled;               /* Monitoring armed */
+    __s32 security_level;        /* Current security level */
+    __u32 db_version;            /* Descriptor database generation */
+    __u32 db_count;              /* Descriptors in the live database */
+    __u32 sample_ratio_min;      /* Safe-path sampling, 1 in N */
+    __u32 sample_ratio_max;
+    __u64 total_checks;          /* Counters as in /proc/tcp_kernel */
+    __u64 fast_path_hits;
+    __u64 blocked_operations;
+    __u64 security_events;
+    __u64 false_positives;
+    __u64 events_dropped;
+    __u64 latency[TCP_LAT_NR_PATHS][TCP_LAT_BUCKETS];
+    __u64 decision_hits;         /* Decision cache, as in /proc/tcp_kernel */
+    __u64 decision_misses;
+};
+
+#endif /* _TCP_KERNEL_UAPI_H */
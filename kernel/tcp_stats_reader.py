@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+TCP Kernel Statistics Reader
+
+Maps the tcp_kernel statistics page (/dev/tcp_kernel_stats) read-only and
+prints consistent snapshots of its counters and latency histograms,
+without a syscall per sample. The layout is struct tcp_stats_page from
+tcp_kernel_uapi.h.
+"""
+
+import argparse
+import json
+import mmap
+import os
+import struct
+import sys
+import time
+from typing import Any, Dict
+
+STATS_DEVICE = "/dev/tcp_kernel_stats"
+
+STATS_MAGIC = 0x53504354
+STATS_VERSION = 1
+
+# struct tcp_stats_page (tcp_kernel_uapi.h), up to the histograms
+HEADER = struct.Struct("<IHHIIQIiIIII6Q")
+SEQ_OFFSET = 8
+LAT_PATHS = ("hit", "miss", "blocked")
+LAT_BUCKETS = 32
+LATENCY = struct.Struct(f"<{len(LAT_PATHS) * LAT_BUCKETS}Q")
+# Appended after the histograms; present when the page's size covers them
+DECISIONS = struct.Struct("<2Q")
+
+COUNTERS = ("total_checks", "fast_path_hits", "blocked_operations",
+            "security_events", "false_positives", "events_dropped")
+
+# Give up on a snapshot after this many torn reads in a row
+MAX_RETRIES = 1000
+
+
+def _seq(page: mmap.mmap) -> int:
+    return struct.unpack_from("<I", page, SEQ_OFFSET)[0]
+
+
+def snapshot(page: mmap.mmap) -> Dict[str, Any]:
+    """
+    Copy the page under its sequence count. Python issues no barriers, so
+    this relies on loads not being reordered with each other (x86); a
+    reader on a weakly ordered CPU needs the barriers from the C protocol.
+    """
+    for _ in range(MAX_RETRIES):
+        seq = _seq(page)
+        if seq & 1:
+            continue
+        data = page[:HEADER.size + LATENCY.size + DECISIONS.size]
+        if _seq(page) == seq:
+            break
+    else:
+        raise RuntimeError("statistics page kept changing under the reader")
+
+    (magic, version, size, seq, interval_ms, update_ns, enabled, level,
+     db_version, db_count, ratio_min, ratio_max, *counters) = HEADER.unpack_from(data)
+    if magic != STATS_MAGIC or version != STATS_VERSION:
+        raise RuntimeError("not a version 1 tcp_kernel statistics page")
+
+    latency = LATENCY.unpack_from(data, HEADER.size)
+    decisions = (0, 0)
+    if size >= HEADER.size + LATENCY.size + DECISIONS.size:
+        decisions = DECISIONS.unpack_from(data, HEADER.size + LATENCY.size)
+    return {
+        "seq": seq,
+        "update_ns": update_ns,
+        "interval_ms": interval_ms,
+        "enabled": bool(enabled),
+        "security_level": level,
+        "db_version": db_version,
+        "db_count": db_count,
+        "sample_ratio": [ratio_min, ratio_max],
+        **dict(zip(COUNTERS, counters)),
+        "decision_hits": decisions[0],
+        "decision_misses": decisions[1],
+        "latency": {
+            path: list(latency[i * LAT_BUCKETS:(i + 1) * LAT_BUCKETS])
+            for i, path in enumerate(LAT_PATHS)
+        },
+    }
+
+
+def format_snapshot(snap: Dict[str, Any]) -> str:
+    counts = " ".join(f"{name}={snap[name]}" for name in COUNTERS)
+    latency = " ".join(f"{path}={sum(b)}" for path, b in snap["latency"].items())
+    return (f"[{snap['update_ns']}] db=v{snap['db_version']} {counts} "
+            f"decisions={snap['decision_hits']}/{snap['decision_misses']} samples: {latency}")
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Read the tcp_kernel statistics page")
+    parser.add_argument("--device", default=STATS_DEVICE, help="statistics device")
+    parser.add_argument("--json", action="store_true", help="emit JSON lines")
+    parser.add_argument("--follow", "-f", action="store_true",
+                        help="print a snapshot after every refresh")
+    args = parser.parse_args()
+
+    try:
+        fd = os.open(args.device, os.O_RDONLY)
+    except OSError as e:
+        print(f"Cannot open {args.device}: {e} (is tcp_kernel loaded?)", file=sys.stderr)
+        return 1
+
+    try:
+        with mmap.mmap(fd, mmap.PAGESIZE, mmap.MAP_SHARED, mmap.PROT_READ) as page:
+            last_seq = None
+            while True:
+                snap = snapshot(page)
+                if snap["seq"] != last_seq:
+                    print(json.dumps(snap) if args.json else format_snapshot(snap))
+                    sys.stdout.flush()
+                    last_seq = snap["seq"]
+                if not args.follow:
+                    break
+                time.sleep(snap["interval_ms"] / 1000)
+    except KeyboardInterrupt:
+        pass
+    except RuntimeError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+    finally:
+        os.close(fd)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -169,17 +169,14 @@ test_security_events() {
     # Wait for events to be processed
     sleep 2
     
-    # Check for security events in dmesg
-    local events=$(dmesg | grep "TCP:" | wc -l)
+    # Drain the binary event ring
+    local reader="$(dirname "$0")/tcp_event_reader.py"
+    local events=$(python3 "$reader" 2>/dev/null | wc -l)
     
     if [ "$events" -gt "0" ]; then
         log_success "Security events detected ($events events)"
-        
-        # Show some recent events
-        echo "Recent TCP events:"
-        dmesg | grep "TCP:" | tail -5 | sed 's/^/  /'
     else
-        log_warning "No security events found in dmesg"
+        log_warning "No security events found in the event ring"
     fi
     
     # Check statistics for security events
@@ -75,6 +75,46 @@ def load_config(config_file: Optional[str] = None) -> BenchmarkConfig:
         logger.error("Failed to load config file", path=str(config_path), error=str(e))
         return BenchmarkConfig()
 
+def check_kernel_results(results_file: str, config_file: Optional[str] = None) -> int:
+    """Compare kernel/bench results against the configured regression baseline"""
+    root = Path(__file__).parent
+    config_path = Path(config_file) if config_file else root / "benchmark_config.yaml"
+    kernel_config = {}
+    if config_path.exists():
+        with open(config_path) as f:
+            kernel_config = (yaml.safe_load(f) or {}).get("kernel_benchmark", {})
+    
+    sys.path.insert(0, str(root / "kernel" / "bench"))
+    from run_kernel_bench import compare_results, load_results
+    
+    baseline_path = root / kernel_config.get("baseline", "kernel/bench/baseline.json")
+    max_regression = kernel_config.get("max_regression_pct", 10.0)
+    
+    current = load_results(results_file)
+    
+    print("\n" + "="*60)
+    print("KERNEL SYSCALL OVERHEAD")
+    print("="*60)
+    for run in current["runs"]:
+        if run["threads"] == 1:
+            print(f"  {run['state']:<10} {run['workload']:<8} {run['ns_per_op']:8.1f} ns/op"
+                  f"  ({run['overhead_ns'] or 0:+.1f} ns)")
+    
+    if not baseline_path.exists():
+        logger.warning("No kernel baseline yet, nothing to compare", path=str(baseline_path))
+        return 0
+    
+    regressions = compare_results(current, load_results(str(baseline_path)), max_regression)
+    
+    if regressions:
+        print(f"\nREGRESSIONS (>{max_regression:.0f}% vs {baseline_path}):")
+        for line in regressions:
+            print(f"  {line}")
+        return 1
+    
+    print(f"\nNo regressions against {baseline_path}")
+    return 0
+
 @click.command()
 @click.option('--config', '-c', help='Configuration file path')
 @click.option('--sample-size', '-s', type=int, help='Number of commands to test')
@@ -84,8 +124,10 @@ def load_config(config_file: Optional[str] = None) -> BenchmarkConfig:
 @click.option('--quick', '-q', is_flag=True, help='Quick test with smaller dataset')
 @click.option('--output-dir', '-o', help='Output directory for results')
 @click.option('--verbose', '-v', is_flag=True, help='Verbose output')
+@click.option('--kernel-results', help='Check kernel/bench results JSON against the baseline')
 def main(config: Optional[str], sample_size: Optional[int], models: tuple, 
-         quick: bool, output_dir: Optional[str], verbose: bool):
+         quick: bool, output_dir: Optional[str], verbose: bool,
+         kernel_results: Optional[str]):
     """
     Run comprehensive TCP vs LLM performance benchmark
     
@@ -99,6 +141,9 @@ def main(config: Optional[str], sample_size: Optional[int], models: tuple,
     else:
         logging.basicConfig(level=logging.WARNING)
     
+    if kernel_results:
+        sys.exit(check_kernel_results(kernel_results, config))
+    
     logger.info("Starting TCP Performance Benchmark")
     
     # Load configuration